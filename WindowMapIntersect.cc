@@ -9,6 +9,43 @@
 
 #include <stdexcept>
 #include <cassert>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <random>
+#include <atomic>
+#include <cstring>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <cmath>
+
+// for memory mapping map files, and making the golden image folder (see RunTests)
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <immintrin.h>
+
+// lets a single function use AVX2 without building the whole program for it, the caller checks the CPU first
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
 
 
 // Types
@@ -20,6 +57,14 @@ typedef struct IntVec2
     int Y; // Y coordinate or row number
 } IntVec2_t;
 
+// Where a point is on a grid: the cell it's in, and how far into that cell it is (0 to gridSize - 1 each way),
+// so Cell * gridSize + Offset is the point again. See FindGridPoint.
+struct GridPoint_t
+{
+    IntVec2_t Cell;
+    IntVec2_t Offset;
+};
+
 enum class WindowIntersectType_t
 {
     // window is completely out of the map
@@ -51,26 +96,568 @@ typedef struct InitSDLValues_s
     
 } InitSDLValues_t;
 
-struct TestTextures_t
-{
-    SDL_Texture* NorthWest;
-    SDL_Texture* North;
-    SDL_Texture* NorthEast;
-    SDL_Texture* East;
-    SDL_Texture* SouthEast;
-    SDL_Texture* South;
-    SDL_Texture* SouthWest;
-    SDL_Texture* West;
-    SDL_Texture* AllIn;
-    SDL_Texture* AllOut;
-    SDL_Texture* Moveable;
-};
-
 struct Color_t
 {
     int R, G, B;
 };
 
+// see further down
+struct TileAtlas_t;
+struct SpriteQueue_t;
+
+// most layers a map can be drawn with, see RenderWindows
+#define MAX_TILE_LAYERS 4
+
+// how many sizes each tile atlas page comes in, each half the size of the one before (see BuildTileAtlas).
+// The smallest has a tile down to a single pixel.
+#define TILE_MIP_LEVELS 5
+
+// One simulated window looking at the map, and everything needed to render what it sees
+struct Viewport_t
+{
+    SDL_Texture* ScreenRenderTexture;   // what the window sees, with the background behind the map (orange)
+    SDL_Texture* MapRenderTexture;      // the tiles the window touches (cyan), from the map's bottom layer
+    const TileAtlas_t* TileAtlas;       // where the map's tiles are drawn from
+
+    IntVec2_t WindowSize_Tiles;
+
+    // top left corner of the window, in absolute screen px (the map is drawn at cMapOrigin)
+    IntVec2_t WindowTopLeft_px;
+
+    // DEMO ONLY: where to show the map render texture and the screen render texture on the real screen
+    IntVec2_t MapTexRenderPoint;
+    IntVec2_t ScreenRenderPoint;
+
+    // a map render texture for each layer above the bottom one (transparent where that layer has no tiles),
+    // nullptr past however many layers AcquireViewportTextures was asked for
+    SDL_Texture* UpperLayerRenderTextures[MAX_TILE_LAYERS - 1];
+
+    // screen px per map px, e.g., 0.25 shows 4x as much of the map each way (a minimap). Anything other than 1 is drawn
+    // from chunk thumbnails instead of the map render textures, see CopyChunkThumbnailsToScreen.
+    float Zoom = 1.0f;
+
+    // sprites drawn over the map this frame, see QueueSprite. nullptr for a viewport that only shows the map.
+    SpriteQueue_t* SpriteQueue = nullptr;
+};
+
+// Everything RenderWindows works out about its viewports before touching the GPU, one array per value (index i is viewport i)
+// so that each pass only walks the data it needs.
+struct ViewportFrameData_t
+{
+    std::vector<IntVec2_t> RelToMap_WindowTopLeft;
+
+    // where RelToMap_WindowTopLeft is on the tile grid, see FindGridPoint
+    std::vector<GridPoint_t> WindowGridPoints;
+
+    std::vector<IntVec2_t> WindowSize_px;
+    std::vector<WindowIntersectType_t> IntersectTypes;
+
+    // how much of the map the window sees, in map px (WindowSize_px unless the viewport is zoomed)
+    std::vector<IntVec2_t> ViewSize_px;
+
+    // area of the map (in map px) that's rendered into the map render texture. For a zoomed viewport,
+    // the chunks (in chunk coordinates) whose thumbnails it's drawn from instead.
+    std::vector<SDL_Rect> RenderedRects;
+
+    // area of the map render texture to read, relative to the top left rendered tile
+    std::vector<SDL_Rect> ReadRects;
+
+    // where the read area goes in the screen render texture
+    std::vector<IntVec2_t> DrawOffsets;
+
+    // 1 if the viewport's render textures have to be drawn again this frame, see ViewportNeedsRedraw
+    std::vector<Uint8> Redraw;
+};
+
+// Index into a tile map's TileSources, 0 (cEmptyTile) means nothing is drawn there
+typedef Uint16 TileId_t;
+
+// side length of the square chunks a tile map is split into, in tiles
+#define TILE_CHUNK_SIZE 32
+
+// A TILE_CHUNK_SIZE x TILE_CHUNK_SIZE piece of a tile map, row major so a row of tiles is contiguous in memory
+struct TileChunk_t
+{
+    TileId_t Tiles[TILE_CHUNK_SIZE * TILE_CHUNK_SIZE];
+};
+
+// Whether a mapped file chunk's tile IDs have been checked against the map's TileSources yet
+enum FileChunkState_t
+{
+    cFileChunkUnchecked = 0,
+    cFileChunkValid,
+    // has tile IDs past the end of TileSources, so it's read as an empty chunk
+    cFileChunkDamaged
+};
+
+// A read only file mapped into memory. Nothing is actually read until a page of it is touched, the OS pages it in then.
+struct MappedFile_t
+{
+    const Uint8* Data = nullptr;
+    size_t Size = 0;
+
+#ifdef _WIN32
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Mapping = nullptr;
+#endif
+
+    ~MappedFile_t();
+};
+
+// The start of a map file, see SaveTileMapFile for the whole layout
+struct TileMapFileHeader_t
+{
+    char Magic[8];              // cTileMapFileMagic
+    Uint32 Version;             // cTileMapFileVersion
+    Uint32 ChunkSize;           // TILE_CHUNK_SIZE the file was written with
+    Sint32 Width_Tiles;
+    Sint32 Height_Tiles;
+    Uint32 TileSourceCount;     // entries in the tile source table, including the cEmptyTile placeholder
+    Uint32 ChunkColumns;
+    Uint32 ChunkRows;
+    Uint32 Reserved;
+    Uint64 TileSourceTableOffset;
+    Uint64 ChunkTableOffset;
+};
+
+// Where a tile's picture is: an area of one page of a TileAtlas_t
+struct TileSource_t
+{
+    int Page;
+    SDL_Rect Rect;      // in px
+};
+
+// One picture of an animated tile, and how long it's shown for
+struct TileAnimationFrame_t
+{
+    TileSource_t Source;
+    Uint32 Duration_ms;
+};
+
+// A tile ID whose picture changes over time, see AddTileAnimation. The frames loop forever.
+struct TileAnimation_t
+{
+    TileId_t TileId;
+    std::vector<TileAnimationFrame_t> Frames;
+    Uint32 Length_ms;       // every frame's Duration_ms added up
+    int CurrentFrame;       // the one that's in the map's TileSources right now
+};
+
+// A map made of tile IDs.
+//
+// The map is split into chunks, and only chunks that have had a tile put in them are allocated, so a huge mostly
+// empty map costs next to nothing.
+//
+// A map can also be backed by a map file (see OpenTileMapFile), then chunks are read straight out of the mapped file
+// the first time something looks at them. Chunks that get written to are copied out of the file into Chunks first.
+struct TileMap_t
+{
+    IntVec2_t Size_Tiles;
+
+    // goes up every time a tile changes, so anything drawn from the map can tell when it's out of date
+    Uint64 Version = 0;
+
+    // populated chunks, keyed by ChunkKey(). For a file backed map, only the ones that have been written to.
+    std::unordered_map<Uint64, std::unique_ptr<TileChunk_t>> Chunks;
+
+    // only for file backed maps: the file, and its table of where each chunk is in it (row major, 0 for an empty chunk)
+    std::unique_ptr<MappedFile_t> File;
+    const Uint64* FileChunkOffsets = nullptr;
+    IntVec2_t FileSize_Chunks = {0, 0};
+
+    // only for file backed maps: a FileChunkState_t per chunk (same order as FileChunkOffsets), so each chunk's tile IDs are only
+    // checked the first time it comes out of FindFileChunk. Atomic since ParallelFor jobs look chunks up too.
+    std::unique_ptr<std::atomic<Uint8>[]> FileChunkStates;
+
+    // tile ID -> where in the tile atlas to draw it from; entry 0 is a placeholder for cEmptyTile
+    std::vector<TileSource_t> TileSources;
+
+    // tile IDs whose TileSources entry changes over time, see UpdateTileAnimations
+    std::vector<TileAnimation_t> Animations;
+};
+
+// Everything needed to copy a window's view of the map into the window, see ComputeWindowClip
+struct WindowClip_t
+{
+    // area of the map the window sees, in map px (same as GetMapRenderRectangle)
+    SDL_Rect MapRect;
+
+    // area of the map covered by the tiles rendered into the map render texture, in map px (same as what RenderMapToTexture returns)
+    SDL_Rect RenderedRect;
+
+    // area of the map render texture to read, relative to the top left rendered tile (same as GetScreenReadArea)
+    SDL_Rect SourceRect;
+
+    // where SourceRect goes in the window (same as GetDrawRenderOffset)
+    IntVec2_t DestOffset;
+};
+
+// one tile copy from the tileset into a map render texture
+struct TileDraw_t
+{
+    int Page;           // page of the tile atlas Source is on
+    SDL_Rect Source;    // area of the atlas page, in px
+    SDL_Rect Dest;      // area of the map render texture, in px
+};
+
+// All of the tile copies for one map render texture, gathered up so they can be submitted in one go
+// instead of doing a render target switch and an SDL_RenderCopy per tile.
+struct TileBatch_t
+{
+    std::vector<TileDraw_t> Draws;
+
+    // scratch space for SDL_RenderGeometry, kept around so it doesn't get reallocated every frame
+    std::vector<SDL_Vertex> Vertices;
+    std::vector<int> Indices;
+};
+
+// An image in CPU memory, one Uint32 per pixel in SDL_PIXELFORMAT_RGBA8888 (R in the top byte, A in the bottom byte),
+// rows are packed with no padding
+struct PixelBuffer_t
+{
+    IntVec2_t Size_px;
+    std::vector<Uint32> Pixels;
+};
+
+// A tileset for the CPU compositor
+struct CpuTileSet_t
+{
+    PixelBuffer_t Image;
+
+    // for every cGridSize_px x cGridSize_px cell of the image, 1 if every pixel in it is opaque.
+    // Opaque tiles can just be copied, anything else has to be blended.
+    IntVec2_t Size_Cells;
+    std::vector<Uint8> OpaqueCells;
+};
+
+// What a viewport's screen render texture was last drawn from, see ViewportNeedsRedraw
+struct ViewportRenderState_t
+{
+    SDL_Texture* MapRenderTexture;
+    SDL_Texture* UpperLayerRenderTextures[MAX_TILE_LAYERS - 1];
+    const TileAtlas_t* TileAtlas;
+
+    // the map layers, and each one's Version at the time
+    int LayerCount;
+    const TileMap_t* Layers[MAX_TILE_LAYERS];
+    Uint64 LayerVersions[MAX_TILE_LAYERS];
+
+    IntVec2_t WindowTopLeft_px;
+    IntVec2_t WindowSize_Tiles;
+    float Zoom;
+};
+
+// Tileset images packed together into as few big textures (pages) as possible, see BuildTileAtlas.
+// A tile map's TileSources say which page and where on it each tile is, so a map that uses lots of tilesets
+// usually still only needs one source texture, and every tile copy can go out in one batch.
+struct TileAtlas_t
+{
+    std::vector<SDL_Texture*> Pages;
+
+    // MipPages[level - 1][page] is Pages[page] shrunk by 2^level each way, for drawing tiles cGridSize_px >> level px big
+    std::vector<SDL_Texture*> MipPages[TILE_MIP_LEVELS - 1];
+
+    // CPU copies of the pages, for the CPU compositor and ParallelMapRender. Empty unless BuildTileAtlas was asked to keep them,
+    // and then the map render textures are always drawn by the renderer.
+    std::vector<CpuTileSet_t> CpuPages;
+};
+
+// One worker thread's share of a ParallelFor. The owner takes jobs off the back, anyone who runs out of their own work
+// steals off the front (the far end from the owner, so they're usually working on a different part of the image).
+struct WorkerQueue_t
+{
+    std::mutex Lock;
+    std::deque<int> Jobs;
+};
+
+// Some chunks of a file backed map to page in, see RequestChunkPrefetch
+struct ChunkPrefetchRequest_t
+{
+    const TileMap_t* TileMap;
+    SDL_Rect Chunks;            // in chunk coordinates
+};
+
+// A thread that reads ahead in file backed maps, so the render thread doesn't stall on a page fault when a window scrolls somewhere new
+struct ChunkPrefetcher_t
+{
+    std::thread Thread;
+
+    std::mutex Lock;
+    std::condition_variable Signal;
+    std::vector<ChunkPrefetchRequest_t> Requests;
+    bool Quit;
+
+    std::atomic<Uint64> ChunksTouched;
+    volatile Uint32 Sink;       // keeps the reads that page chunks in from being optimized away
+};
+
+// How a window has been moving, for PredictChunkPrefetch
+struct ViewportMotion_t
+{
+    bool HasPosition;
+    IntVec2_t Position;         // relative to the map, last frame
+
+    // average px per frame
+    float VelocityX;
+    float VelocityY;
+
+    // what was last asked for, in chunk coordinates
+    SDL_Rect RequestedChunks;
+};
+
+// Worker threads for ParallelFor. Queue 0 belongs to the thread that calls ParallelFor, it works too instead of just waiting.
+struct WorkerPool_t
+{
+    std::vector<std::thread> Threads;
+    std::unique_ptr<WorkerQueue_t[]> Queues;
+    int QueueCount;
+
+    // the ParallelFor currently running
+    std::function<void(int)> Job;
+    std::atomic<int> JobsRemaining;
+
+    // bumped to wake the workers up for a new ParallelFor
+    std::mutex WakeLock;
+    std::condition_variable WakeSignal;
+    Uint64 Generation;
+    bool Quit;
+};
+
+// A render target texture that belongs to a RenderTargetPool_t
+struct PooledRenderTarget_t
+{
+    Uint32 Format;
+    IntVec2_t Size_px;      // the size class, can be bigger than what was asked for
+    size_t Bytes;
+
+    bool InUse;
+    Uint64 ReleaseOrder;    // when it was last handed back, the pool throws out the longest unused texture first
+};
+
+// Render target textures, handed out by size class and pixel format and recycled instead of destroyed,
+// so viewports can come and go without an SDL_CreateTexture (and the renderer stall that comes with it) each time.
+//
+// A size class is the requested width and height each rounded up to a power of 2, so e.g. every window between 17x17 and 32x32 px
+// shares the same textures. Whoever acquires a texture only uses the top left corner they asked for.
+struct RenderTargetPool_t
+{
+    std::unordered_map<SDL_Texture*, PooledRenderTarget_t> Targets;
+
+    // textures not in use, keyed by RenderTargetClassKey
+    std::unordered_map<Uint64, std::vector<SDL_Texture*>> FreeTargets;
+
+    // total size of every texture the pool owns (in use or not), never allowed past MaxBytes
+    size_t BytesAllocated;
+    size_t MaxBytes;
+
+    Uint64 ReleaseCount;
+
+    // how many acquires were handed a recycled texture vs a new one
+    Uint64 Reused;
+    Uint64 Created;
+};
+
+// Decides when each frame should start.
+//
+// Deadlines are on an absolute timeline (Epoch + frame number * frame length) instead of "now + frame length", so a late frame
+// doesn't push every frame after it later too, and the frame length doesn't have to be a whole number of ms (or ticks).
+struct FrameScheduler_t
+{
+    int TargetFPS;              // 0 means uncapped
+
+    Uint64 TicksPerSecond;      // SDL_GetPerformanceFrequency
+    Uint64 Epoch;               // when frame 0 of the current timeline started
+    Uint64 FrameNumber;         // frames since Epoch
+    Uint64 EarlierTimelines;    // in ticks, how long the timelines before this one ran for, see GetFrameTime_ms
+    Uint64 SpinMargin;          // in ticks, see cMinSpinMargin_us
+
+    // missed deadlines, in total and since the last report
+    Uint64 MissedFrames;
+    Uint64 MissedFramesSinceReport;
+    Uint64 FramesSinceReport;
+    Uint64 LastReport;
+};
+
+// Bookkeeping for a map render texture that's used as a ring buffer.
+//
+// Map tile (x, y) always lives in slot (x % Capacity_Tiles.X, y % Capacity_Tiles.Y) of the texture, so when the window scrolls
+// the tiles it could already see stay where they are, and only the newly exposed row / column has to be drawn.
+struct MapRenderCache_t
+{
+    // false until the first draw, or after something invalidates the texture's contents
+    bool Valid;
+
+    // tiles currently drawn in the texture, in map tile coordinates
+    SDL_Rect Tiles;
+
+    // the map they came from, and its Version at the time
+    const TileMap_t* TileMap;
+    Uint64 MapVersion;
+
+    // one per slot (row major), 1 if the tile in it changed after it was drawn (see SetTiles, UpdateTileAnimations).
+    // Those are drawn again the next time the texture is. Empty until something's marked.
+    std::vector<Uint8> PendingSlots;
+    int PendingSlotCount;
+
+    // how many tiles fit in the texture
+    IntVec2_t Capacity_Tiles;
+};
+
+// One chunk of a map drawn at one mip level, see UpdateChunkThumbnail. A zoomed out viewport copies a handful of these
+// instead of drawing every tile it can see.
+struct ChunkThumbnail_t
+{
+    SDL_Texture* Texture;       // from RenderTargetPool, so it can be bigger than Size_px
+    IntVec2_t Chunk;            // chunk coordinate
+    IntVec2_t Size_px;          // the chunk's tiles at the mip level (less than a whole chunk along the map's right and bottom edges)
+
+    // what it was drawn with
+    const TileAtlas_t* TileAtlas;
+    bool TransparentBackground;
+
+    // the map's Version when it was drawn
+    Uint64 MapVersion;
+
+    // ChunkThumbnailFrame the last time a viewport used it, the least recently used go first when there are too many
+    Uint64 LastUsedFrame;
+};
+
+// Every chunk thumbnail of one map, keyed by ChunkKey(), one table per mip level
+struct ChunkThumbnailCache_t
+{
+    std::unordered_map<Uint64, ChunkThumbnail_t> Levels[TILE_MIP_LEVELS];
+};
+
+// Something that moves around on top of the map (a sprite, an NPC, a pickup...) in a SpatialGrid_t, see AddEntity
+struct GridEntity_t
+{
+    SDL_Rect Bounds;        // in map px, can hang off the map (or be nowhere near it)
+    int Cell;               // the cell it's filed in, -1 if this entity ID is free
+
+    // each cell's entities are a doubly linked list through these, -1 at either end
+    int PreviousInCell;
+    int NextInCell;
+};
+
+// A loose uniform grid over a map, for finding which of a lot of entities a window can see, see QueryWindow.
+//
+// An entity is filed in the cell its top left corner is in, however big it is, so moving one is O(1): it only gets relinked when
+// its corner crosses into another cell. That makes the grid "loose": entities stick out of their cells by up to MaxEntitySize_px,
+// so a query also looks that much further up and to the left of the window.
+struct SpatialGrid_t
+{
+    int CellSize_px;            // a whole number of tiles
+    IntVec2_t Size_Cells;       // enough to cover the map, anything off the map is filed in the nearest edge cell
+
+    // first entity in each cell (row major), -1 for an empty cell
+    std::vector<int> CellHeads;
+
+    // indexed by entity ID
+    std::vector<GridEntity_t> Entities;
+    std::vector<int> FreeEntityIds;
+
+    // the biggest any entity has been, each way. Only ever grows.
+    IntVec2_t MaxEntitySize_px;
+};
+
+// One entity a window can see, and which part of it goes where in the window, see QueryWindow
+struct VisibleEntity_t
+{
+    int EntityId;
+    SDL_Rect SourceRect;    // the part of the entity inside the window, relative to the entity's top left corner
+    SDL_Rect DestRect;      // where that part goes, relative to the window's top left corner
+};
+
+// One image drawn over the map in a viewport, see QueueSprite
+struct Sprite_t
+{
+    SDL_Texture* Texture;
+    SDL_Rect Source;        // area of the texture, drawn the same size (times the viewport's Zoom)
+    IntVec2_t Position_px;  // where the top left corner goes, in map px
+    int Layer;              // 0 - 255, higher layers are drawn over lower ones
+};
+
+// Everything to draw over the map in one viewport this frame. Fill it in with QueueSprite every frame,
+// RenderWindows draws it (see DrawSpriteQueue) and empties it.
+struct SpriteQueue_t
+{
+    std::vector<Sprite_t> Sprites;
+
+    // how many sprites are in the viewport's screen render texture, so it gets drawn again once they're gone
+    int LastDrawnCount;
+
+    // scratch space for DrawSpriteQueue, kept around so it doesn't get reallocated every frame
+    std::vector<Uint64> SortKeys;
+    std::vector<Uint64> SortScratch;
+    std::vector<SDL_Texture*> Textures;
+    std::vector<SDL_Vertex> Vertices;
+    std::vector<int> Indices;
+};
+
+// DEMO ONLY: a tile wandering around the map as a sprite, see DEMO_MoveCritters
+struct DemoCritter_t
+{
+    int EntityId;               // in DemoCritterGrid
+    IntVec2_t Velocity_px;      // per frame
+    TileSource_t Tile;
+    int Layer;
+};
+
+// The parts of a frame that get timed, see ProfileStageBegin / ProfileStageEnd
+enum class ProfileStage_t
+{
+    Input = 0,
+    RenderMapToTexture,         // drawing tiles into every map render texture
+    CopyRenderedMapToScreen,    // copying every map render texture into its screen render texture
+    Present,
+    Delay,
+
+    Count
+};
+
+// Everything recorded about one frame. Times are in SDL_GetPerformanceCounter ticks.
+//
+// Note these are CPU side times. The renderer is free to queue up work and do it later, so GPU heavy work tends to show up
+// wherever the renderer decides to flush (usually Present).
+struct FrameProfile_t
+{
+    Uint64 FrameIndex;
+    Uint64 FrameStart;
+    Uint64 FrameEnd;
+
+    // when each stage first started this frame, and the total time spent in it (a stage can be entered more than once)
+    Uint64 StageStart[(int)ProfileStage_t::Count];
+    Uint64 StageTicks[(int)ProfileStage_t::Count];
+
+    int TilesDrawn;
+    int MissedDeadlines;        // frame deadlines the scheduler gave up on, see WaitForNextFrame
+    int RenderTargetSwitches;
+    int RenderCopies;           // SDL_RenderCopy calls, plus SDL_RenderGeometry calls (each one replaces a pile of copies)
+    int ViewportsRedrawn;       // viewports whose render textures were drawn, the rest were still up to date
+    int SpritesDrawn;
+    int ChunksPrefetched;       // file backed map chunks the prefetch thread paged in since the last frame ended
+};
+
+// How many frames of history FrameProfiler keeps, must be a power of 2
+#define FRAME_PROFILE_HISTORY 1024
+
+// The last FRAME_PROFILE_HISTORY frames.
+//
+// Single producer (the render loop), any number of readers, no locks: the producer fills in a slot and then publishes it
+// by bumping FramesWritten. A reader copies the slots it wants, then checks FramesWritten again and throws away any slot
+// that could have been overwritten while it was copying.
+struct FrameProfiler_t
+{
+    FrameProfile_t Frames[FRAME_PROFILE_HISTORY];
+    std::atomic<Uint64> FramesWritten;
+
+    // the frame being recorded right now, only touched by the render loop
+    FrameProfile_t Current;
+
+    // ChunkPrefetcher's count when the last frame ended
+    Uint64 LastChunksTouched;
+};
+
 // Constants
 //---------------------------------------------------------------------------------------------------
 
@@ -83,16 +670,27 @@ constexpr int cGridSize_px = 16;
 // change this to change the size of the window
 const IntVec2_t cScreenResolution = {1024, 768};
 
-// this is more FYI than anything
+// frame rate the demo starts at, press 1 / 2 / 3 / 4 for 60 / 120 / 144 / uncapped
 const int cFPS = 60;
 
-// 1/60 is 0.016666666666666666
-const int cFrameDuration_ms = 16;
+// 0 means uncapped
+const int cFrameRateChoices[] = {60, 120, 144, 0};
+
+// DEMO ONLY: what Z steps the mouse's viewport through, see Viewport_t::Zoom
+const float cDemoZoomChoices[] = {1.0f, 0.75f, 0.5f, 0.25f, 0.0625f};
+
+// DEMO ONLY: how many sprites S lets loose on the map
+const int cDemoCritterCount = 48;
+
+// FrameScheduler sleeps until this close to a deadline and then spins the rest of the way, because a sleep can overshoot
+// by a millisecond or more (much more on some Windows timers). It grows if sleeps are seen overshooting by more than this.
+const int cMinSpinMargin_us = 1500;
+const int cMaxSpinMargin_us = 4000;
 
 // imaginary, simulated window looking at our map
-const IntVec2_t cWindowSize_px = {32, 32};
+constexpr IntVec2_t cWindowSize_px = {32, 32};
 
-const IntVec2_t cWindowSize_Tiles = {cWindowSize_px.X / cGridSize_px, cWindowSize_px.Y / cGridSize_px};
+constexpr IntVec2_t cWindowSize_Tiles = {cWindowSize_px.X / cGridSize_px, cWindowSize_px.Y / cGridSize_px};
 
 // account for one more tile in the map render size; if a tile is partially out of view it still has to be rendered.
 // in this demo's case, a 2 x 2 viewable area will need a 3 x 3 tile map render area.
@@ -102,11 +700,42 @@ const IntVec2_t cMapRenderTextureSize_px = {cMapRenderTextureSize_Tiles.X * cGri
 
 const IntVec2_t cMapOrigin = {432, 322};
 
+// RenderTargetPool won't own more than this much texture memory, counting textures that aren't in use
+const size_t cRenderTargetPoolMaxBytes = 256 * 1024 * 1024;
+
+// side length of a chunk, in map px
+const int cChunkSize_px = TILE_CHUNK_SIZE * cGridSize_px;
+
+// how far around a window RenderWindows asks for a file backed map's chunks to be paged in, in px
+const int cPageInMargin_px = TILE_CHUNK_SIZE * cGridSize_px;
+
+// PredictChunkPrefetch: how far ahead to guess where a window's going, how much of each frame's movement goes into the average,
+// and how slow a window has to be going (px per frame) to be treated as stopped
+const int cPrefetchLookahead_frames = 30;
+const float cVelocitySmoothing = 0.5f;
+const float cMinPrefetchVelocity = 0.5f;
+
+// requests the prefetch thread can have queued up before the oldest get thrown away
+const size_t cMaxChunkPrefetchRequests = 64;
+
+// smallest size class RenderTargetPool hands out, in px
+const int cMinRenderTargetSize_px = 16;
+
 constexpr IntVec2_t cTileSetSize_Tiles = {8, 8};
 
+// biggest atlas page BuildTileAtlas makes (or smaller, if that's all the renderer can do)
+const int cMaxAtlasPageSize_px = 2048;
+
 // DEMO: The map size would definitely NOT be the same as the tileset size in a real game
 constexpr IntVec2_t cMapSize_Tiles = cTileSetSize_Tiles;
 
+constexpr TileId_t cEmptyTile = 0;
+
+// chunk thumbnails past this are given back to RenderTargetPool, least recently used first (a whole chunk at mip level 0 is 1MB)
+const size_t cMaxChunkThumbnailBytes = 128 * 1024 * 1024;
+
+static_assert((cGridSize_px >> (TILE_MIP_LEVELS - 1)) == 1, "the smallest mip level should have one pixel tiles");
+
 
 // Globals
 //---------------------------------------------------------------------------------------------------
@@ -118,11 +747,89 @@ SDL_Texture* MapTestTexture = nullptr;
 
 IntVec2_t MapTextureSize;
 
-TestTextures_t ScreenRenderTextures;
-TestTextures_t MapRenderTextures;
+// the map every demo window is looking at, and what its tiles are drawn from
+TileMap_t DemoTileMap;
+TileAtlas_t DemoTileAtlas;
+
+// DEMO ONLY: a second layer drawn over DemoTileMap, L turns it on and off
+TileMap_t DemoDecorationLayer;
+bool DEMO_ShowDecorationLayer = false;
+
+// DEMO ONLY: index into cDemoZoomChoices for the mouse's viewport
+int DEMO_ZoomChoice = 0;
+
+// every simulated window in the demo, the last one follows the mouse
+std::vector<Viewport_t> DemoViewports;
+
+// DEMO ONLY: sprites wandering around the map, S turns them on and off. Each viewport finds the ones it can see with QueryWindow
+// and queues them in its own DemoSpriteQueues entry.
+std::vector<DemoCritter_t> DemoCritters;
+SpatialGrid_t DemoCritterGrid;
+std::vector<SpriteQueue_t> DemoSpriteQueues;
+bool DEMO_ShowCritters = false;
+
+// reused by every RenderWindows call
+ViewportFrameData_t ViewportFrameData;
+
+// DEMO ONLY: whether RenderWindows shows each viewport's render textures on the real screen (the benchmarks turn this off)
+bool DEMO_ShowRenderTextures = true;
+
+// every render target texture the demo uses comes from here
+RenderTargetPool_t RenderTargetPool = {};
 
 IntVec2_t MousePosition;
 
+// reused by every RenderMapRegion call, only the contents change from one window to the next
+TileBatch_t TileBatch;
+
+// when set, map render textures are kept between frames as ring buffers instead of being redrawn from scratch
+bool IncrementalMapRender = true;
+
+// when set, map render textures are drawn by the CPU on every core and uploaded, see RenderMapRegionParallel. Press P to toggle it.
+bool ParallelMapRender = false;
+
+// threads for ParallelMapRender, started the first time they're needed
+WorkerPool_t WorkerPool;
+
+// reads ahead in file backed maps in the direction the windows are moving
+ChunkPrefetcher_t ChunkPrefetcher;
+
+// one per map render texture (so one per viewport), for PredictChunkPrefetch
+std::unordered_map<SDL_Texture*, ViewportMotion_t> ViewportMotions;
+
+// what RenderMapRegionParallel draws into before uploading, plus a tile batch for each band so the bands don't share anything
+PixelBuffer_t MapStagingBuffer;
+std::vector<TileBatch_t> BandTileBatches;
+
+// one per map render texture, only used when IncrementalMapRender is set
+std::unordered_map<SDL_Texture*, MapRenderCache_t> MapRenderCaches;
+
+// reused by every RenderMapRegionIncremental call, the ring buffer slots it clears before drawing into them
+std::vector<SDL_Rect> RingSlotRects;
+
+// one per screen render texture that's been drawn, so viewports that haven't changed don't get drawn again
+std::unordered_map<SDL_Texture*, ViewportRenderState_t> ViewportRenderStates;
+
+// one per map a zoomed viewport has looked at, see UpdateChunkThumbnail
+std::unordered_map<const TileMap_t*, ChunkThumbnailCache_t> ChunkThumbnailCaches;
+size_t ChunkThumbnailBytes = 0;
+
+// goes up every RenderWindows call, for ChunkThumbnail_t::LastUsedFrame
+Uint64 ChunkThumbnailFrame = 0;
+
+// reused by every UpdateTileAnimations call: 1 for each tile ID whose picture changed this tick
+std::vector<Uint8> ChangedTileIds;
+
+// DEMO ONLY: set when something other than the viewports changes what should be on screen (e.g., the window was uncovered),
+// otherwise Render() leaves the last frame up when no viewport needs redrawing
+bool ScreenNeedsRedraw = true;
+
+// paces the demo's main loop
+FrameScheduler_t FrameScheduler;
+
+// stage timings and counters for recent frames, hit F12 in the demo to write them out
+FrameProfiler_t FrameProfiler;
+
 //--------------------------------------------------------------------------------------
 // Misc. Utility Functions
 //--------------------------------------------------------------------------------------
@@ -184,1110 +891,8028 @@ bool PointInRect(const IntVec2_t& point, const IntVec2_t& rectTopLeft, const Int
     return bInRect;
 }
 
-IntVec2_t FindGridCoordinateForPoint_RoundUp(IntVec2_t point, int gridSize)
+static inline constexpr int max(int a, int b)
 {
-    int columnIndex = point.X / gridSize;
-    int rowIndex = point.Y / gridSize;    
-
-    if((point.X % gridSize) != 0)
+    if(a > b)
     {
-        columnIndex++;
+        return a;
     }
-
-    if((point.Y % gridSize) != 0)
+    else
     {
-        rowIndex++;
+        return b;
     }
-
-    return {columnIndex, rowIndex};
 }
 
-IntVec2_t FindGridCoordinateForPoint(IntVec2_t point, int gridSize)
+static inline constexpr int min(int a, int b)
 {
-    int columnIndex = point.X / gridSize;
-    int rowIndex = point.Y / gridSize;    
-
-    return {columnIndex, rowIndex};
+    if(a < b)
+    {
+        return a;
+    }
+    else
+    {
+        return b;        
+    }
+    
 }
 
-//--------------------------------------------------------------------------------------
-// Demo / placeholder only functions
-//--------------------------------------------------------------------------------------
-
-static inline int InRange(int min, int value, int max);
+static inline constexpr bool IsPowerOfTwo(int value)
+{
+    return (value > 0) && ((value & (value - 1)) == 0);
+}
 
-// this is only for the sake of the demo, in a real game you would look up the image 
-// you need to draw from the map
-void DEMO_DrawTile(SDL_Texture* mapRenderTexture, SDL_Texture* tileSetTexture, const IntVec2_t& sourceTileCoordinate_tiles, const IntVec2_t& textureDestCoordinate_tiles)
+// only for powers of 2
+static inline constexpr int Log2(int value)
 {
-    
+    return (value <= 1) ? 0 : 1 + Log2(value / 2);
+}
 
-    assert(InRange(0, sourceTileCoordinate_tiles.X, cTileSetSize_Tiles.X));
-    assert(InRange(0, sourceTileCoordinate_tiles.Y, cTileSetSize_Tiles.Y));
-    
-    assert(InRange(0, textureDestCoordinate_tiles.X, cMapRenderTextureSize_Tiles.X));
-    assert(InRange(0, textureDestCoordinate_tiles.Y, cMapRenderTextureSize_Tiles.Y));
+static inline int InRange(int min, int value, int max)
+{
+    if(value < min)
+    {
+        return false;
+    }
 
-    // in this demo's case, the tileset is the same as the map size, this will certainly NOT be the case in a real game
+    if(value > max)
+    {
+        return false;
+    }
 
-    const IntVec2_t sourceTilesetCoord_px = {sourceTileCoordinate_tiles.X * cGridSize_px, sourceTileCoordinate_tiles.Y * cGridSize_px};
+    return true;
+}
 
-    // For this partiuclar demo we could reduce the amount of calls to SDL_RenderCopy by copying the entire contiguous area at once,
-    // but this might not be a useful optimization in a real game unless it just so happened that the tileset exactly contained
-    // what was in the player's fov (unlikely unless you rendered the map itself into the tileset, which is not what I have in mind)
-    SDL_Rect srcRect = {0};
-    srcRect.x = sourceTilesetCoord_px.X;
-    srcRect.y = sourceTilesetCoord_px.Y;
-    srcRect.w = cGridSize_px;
-    srcRect.h = cGridSize_px;
+// like %, but never negative
+static inline int WrapIndex(int value, int size)
+{
+    const int wrapped = value % size;
 
-    SDL_Rect destRect = {0};
-    destRect.x = textureDestCoordinate_tiles.X * cGridSize_px;
-    destRect.y = textureDestCoordinate_tiles.Y * cGridSize_px;
-    destRect.w = srcRect.w;
-    destRect.h = srcRect.h;
-    
-    SDL_SetRenderTarget(SDLGlobals.Renderer, mapRenderTexture);
-    SDL_RenderCopy(SDLGlobals.Renderer, tileSetTexture, &srcRect, &destRect);
-    SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
-}
+    if(wrapped < 0)
+    {
+        return wrapped + size;
+    }
 
+    return wrapped;
+}
 
+// value / divisor, rounded down (toward -infinity) instead of toward 0 like / does. divisor has to be > 0.
+static inline constexpr int FloorDiv(int value, int divisor)
+{
+    return (value / divisor) - ((value % divisor < 0) ? 1 : 0);
+}
 
-//--------------------------------------------------------------------------------------
-// Tile rendering functions
-//--------------------------------------------------------------------------------------
+// value / divisor, rounded up. divisor has to be > 0.
+static inline constexpr int CeilDiv(int value, int divisor)
+{
+    return -FloorDiv(-value, divisor);
+}
 
-static inline void CheckArea(const SDL_Rect& offset, const IntVec2_t& windowSize)
+// The grid cell a point is in, and where in that cell it is.
+//
+// / and % round toward 0, so they put a point 1 px west of the map in cell 0 instead of cell -1, which is wrong for every window
+// that hangs off the north or west of the map. This rounds down, so it's right for any point: -1 is in cell -1, at offset gridSize - 1.
+constexpr GridPoint_t FindGridPoint(const IntVec2_t& point, int gridSize)
 {
-    assert(offset.x >= 0);
-    assert(offset.y >= 0);
-    assert(offset.w >= 0);
-    assert(offset.h >= 0);
+    const IntVec2_t cell = {FloorDiv(point.X, gridSize), FloorDiv(point.Y, gridSize)};
 
-    assert(offset.x < windowSize.X);
-    assert(offset.y < windowSize.Y);
-    assert(offset.w <= windowSize.X);
-    assert(offset.h <= windowSize.Y);
+    return {cell, {point.X - cell.X * gridSize, point.Y - cell.Y * gridSize}};
+}
+
+static_assert(FindGridPoint({-1, 17}, 16).Cell.X == -1 && FindGridPoint({-1, 17}, 16).Offset.X == 15, "west of the grid's origin");
+static_assert(FindGridPoint({-1, 17}, 16).Cell.Y == 1 && FindGridPoint({-1, 17}, 16).Offset.Y == 1, "east of the grid's origin");
+static_assert(FindGridPoint({-32, -20}, 10).Cell.X == -4 && FindGridPoint({-32, -20}, 10).Offset.X == 8, "not a power of 2");
+static_assert(FindGridPoint({-32, -20}, 10).Cell.Y == -2 && FindGridPoint({-32, -20}, 10).Offset.Y == 0, "on a grid line");
 
+static void FindGridPoints_Scalar(const IntVec2_t* points, int pointCount, int gridSize, GridPoint_t* gridPoints)
+{
+    for(int pointIndex = 0; pointIndex < pointCount; pointIndex++)
+    {
+        gridPoints[pointIndex] = FindGridPoint(points[pointIndex], gridSize);
+    }
 }
 
-static inline int max(int a, int b)
+#ifdef HAVE_SSE2
+static_assert(sizeof(IntVec2_t) == 2 * sizeof(int) && sizeof(GridPoint_t) == 2 * sizeof(IntVec2_t), "FindGridPoints_SSE2 loads and stores these as packed ints");
+
+// 2 points at a time, only for power of 2 grid sizes: an arithmetic shift right rounds down, so it's exactly the cell,
+// and the low bits are the offset (for negative points too, -1 & 15 is 15). SSE2 has no integer divide for the other sizes.
+// Returns how many points it handled, the rest are left for the scalar version.
+static int FindGridPoints_SSE2(const IntVec2_t* points, int pointCount, int gridSize, GridPoint_t* gridPoints)
 {
-    if(a > b)
+    if(!IsPowerOfTwo(gridSize))
     {
-        return a;
+        return 0;
     }
-    else
+
+    const __m128i shift = _mm_cvtsi32_si128(Log2(gridSize));
+    const __m128i offsetMask = _mm_set1_epi32(gridSize - 1);
+
+    int pointIndex = 0;
+
+    for(; pointIndex + 2 <= pointCount; pointIndex += 2)
     {
-        return b;
+        // x0 y0 x1 y1
+        const __m128i xy = _mm_loadu_si128((const __m128i*)&points[pointIndex]);
+
+        const __m128i cells = _mm_sra_epi32(xy, shift);
+        const __m128i offsets = _mm_and_si128(xy, offsetMask);
+
+        // each GridPoint_t is its cell's x y then its offset's x y
+        _mm_storeu_si128((__m128i*)&gridPoints[pointIndex], _mm_unpacklo_epi64(cells, offsets));
+        _mm_storeu_si128((__m128i*)&gridPoints[pointIndex + 1], _mm_unpackhi_epi64(cells, offsets));
     }
+
+    return pointIndex;
 }
+#endif
 
-static inline int min(int a, int b)
+// FindGridPoint for pointCount points at once
+void FindGridPoints(const IntVec2_t* points, int pointCount, int gridSize, GridPoint_t* gridPoints)
 {
-    if(a < b)
-    {
-        return a;
-    }
-    else
+    int found = 0;
+
+#ifdef HAVE_SSE2
+    found += FindGridPoints_SSE2(points, pointCount, gridSize, gridPoints);
+#endif
+
+    FindGridPoints_Scalar(points + found, pointCount - found, gridSize, gridPoints + found);
+}
+
+// The first grid line at or past point, i.e. how many cells it takes to cover 0 to point
+IntVec2_t FindGridCoordinateForPoint_RoundUp(IntVec2_t point, int gridSize)
+{
+    return {CeilDiv(point.X, gridSize), CeilDiv(point.Y, gridSize)};
+}
+
+// The grid cell a point is in (rounded down, see FindGridPoint)
+IntVec2_t FindGridCoordinateForPoint(IntVec2_t point, int gridSize)
+{
+    return FindGridPoint(point, gridSize).Cell;
+}
+
+//--------------------------------------------------------------------------------------
+// Frame profiling functions
+//--------------------------------------------------------------------------------------
+
+static const char* const cProfileStageNames[(int)ProfileStage_t::Count] = {"Input", "RenderMapToTexture", "CopyRenderedMapToScreen", "Present", "Delay"};
+
+void ProfileBeginFrame()
+{
+    FrameProfile_t& current = FrameProfiler.Current;
+
+    const Uint64 frameIndex = FrameProfiler.FramesWritten.load(std::memory_order_relaxed);
+
+    current = {};
+    current.FrameIndex = frameIndex;
+    current.FrameStart = SDL_GetPerformanceCounter();
+}
+
+// Returns the time the stage started, hand it to ProfileStageEnd
+static inline Uint64 ProfileStageBegin(ProfileStage_t stage)
+{
+    const Uint64 now = SDL_GetPerformanceCounter();
+
+    if(FrameProfiler.Current.StageStart[(int)stage] == 0)
     {
-        return b;        
+        FrameProfiler.Current.StageStart[(int)stage] = now;
     }
-    
+
+    return now;
 }
 
-static inline int InRange(int min, int value, int max)
+static inline void ProfileStageEnd(ProfileStage_t stage, Uint64 stageStart)
 {
-    if(value < min)
+    FrameProfiler.Current.StageTicks[(int)stage] += SDL_GetPerformanceCounter() - stageStart;
+}
+
+// Publishes the current frame to the history
+void ProfileEndFrame()
+{
+    FrameProfile_t& current = FrameProfiler.Current;
+    current.FrameEnd = SDL_GetPerformanceCounter();
+
+    // the prefetch thread keeps a running count, this frame gets whatever it's added since the last one
+    const Uint64 chunksTouched = ChunkPrefetcher.ChunksTouched.load(std::memory_order_relaxed);
+    current.ChunksPrefetched = (int)(chunksTouched - FrameProfiler.LastChunksTouched);
+    FrameProfiler.LastChunksTouched = chunksTouched;
+
+    const Uint64 frameIndex = FrameProfiler.FramesWritten.load(std::memory_order_relaxed);
+
+    FrameProfiler.Frames[frameIndex & (FRAME_PROFILE_HISTORY - 1)] = current;
+
+    // release: anyone who sees the new count also sees the slot it covers
+    FrameProfiler.FramesWritten.store(frameIndex + 1, std::memory_order_release);
+}
+
+// Copies the most recent frames (oldest first) out of the history, returns how many were copied.
+// Safe to call from any thread while the render loop keeps recording.
+int CopyRecentFrameProfiles(std::vector<FrameProfile_t>& frames)
+{
+    const Uint64 writtenBefore = FrameProfiler.FramesWritten.load(std::memory_order_acquire);
+    const Uint64 first = (writtenBefore > FRAME_PROFILE_HISTORY) ? writtenBefore - FRAME_PROFILE_HISTORY : 0;
+
+    frames.clear();
+
+    for(Uint64 frameIndex = first; frameIndex < writtenBefore; frameIndex++)
     {
-        return false;
+        frames.push_back(FrameProfiler.Frames[frameIndex & (FRAME_PROFILE_HISTORY - 1)]);
     }
 
-    if(value > max)
+    // anything the producer could have started overwriting while we were copying is suspect
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const Uint64 writtenAfter = FrameProfiler.FramesWritten.load(std::memory_order_relaxed);
+    const Uint64 overwrittenEnd = (writtenAfter + 1 > FRAME_PROFILE_HISTORY) ? writtenAfter + 1 - FRAME_PROFILE_HISTORY : 0;
+
+    if(overwrittenEnd > first)
     {
-        return false;
+        const size_t dropCount = (size_t)min((int)(overwrittenEnd - first), (int)frames.size());
+        frames.erase(frames.begin(), frames.begin() + dropCount);
     }
 
-    return true;
+    return (int)frames.size();
 }
 
-// You really need to see this drawn out on a sheet of paper to best understand this to be honest
-// see scanned png hand written pages in this folder.
-//
-// Returns a value that represents the window's positioning; This value tells you if the window hangs off the corner of the map, the sides, or neither.
-WindowIntersectType_t GetWindowIntersectType(const IntVec2_t& mapSize_px, const IntVec2_t& windowNorthWestCorner, const IntVec2_t& windowSize_px)
+static double ProfileTicksToMicroseconds(Uint64 ticks)
 {
-    const IntVec2_t windowNorthEastCorner = {windowNorthWestCorner.X + windowSize_px.X, windowNorthWestCorner.Y + 0};
-    const IntVec2_t windowSouthWestCorner = {windowNorthWestCorner.X + 0,               windowNorthWestCorner.Y + windowSize_px.Y};
-    const IntVec2_t windowSouthEastCorner = {windowNorthWestCorner.X + windowSize_px.X, windowNorthWestCorner.Y + windowSize_px.Y};
+    return ticks * 1e6 / (double)SDL_GetPerformanceFrequency();
+}
 
-    const IntVec2_t mapTopLeft = {0, 0};
+// One line per frame, times in microseconds
+bool DumpFrameProfilesCSV(const char* path)
+{
+    std::vector<FrameProfile_t> frames;
+    CopyRecentFrameProfiles(frames);
 
-    const bool northWestCornerIn = PointInRect(windowNorthWestCorner, mapTopLeft, mapSize_px);
-    const bool northEastCornerIn = PointInRect(windowNorthEastCorner, mapTopLeft, mapSize_px);
-    const bool southWestCornerIn = PointInRect(windowSouthWestCorner, mapTopLeft, mapSize_px);
-    const bool southEastCornerIn = PointInRect(windowSouthEastCorner, mapTopLeft, mapSize_px);
-    
+    FILE* file = fopen(path, "w");
 
-    if(northWestCornerIn && northEastCornerIn && southWestCornerIn && southEastCornerIn)
+    if(file == nullptr)
     {
-        return WindowIntersectType_t::TotallyIn;
+        printf("Couldn't open %s for writing\n", path);
+        return false;
     }
 
-    if(!northWestCornerIn && !northEastCornerIn && !southWestCornerIn && !southEastCornerIn)
+    fprintf(file, "frame,frame_us");
+
+    for(const char* stageName : cProfileStageNames)
     {
-        return WindowIntersectType_t::TotallyOut;
+        fprintf(file, ",%s_us", stageName);
     }
 
-    if(southWestCornerIn && southEastCornerIn)
+    fprintf(file, ",tiles_drawn,missed_deadlines,render_target_switches,render_copies,viewports_redrawn,sprites_drawn,chunks_prefetched\n");
+
+    for(const FrameProfile_t& frame : frames)
     {
-        return WindowIntersectType_t::North;
+        fprintf(file, "%llu,%.1f", (unsigned long long)frame.FrameIndex, ProfileTicksToMicroseconds(frame.FrameEnd - frame.FrameStart));
+
+        for(Uint64 stageTicks : frame.StageTicks)
+        {
+            fprintf(file, ",%.1f", ProfileTicksToMicroseconds(stageTicks));
+        }
+
+        fprintf(file, ",%d,%d,%d,%d,%d,%d,%d\n", frame.TilesDrawn, frame.MissedDeadlines, frame.RenderTargetSwitches, frame.RenderCopies, frame.ViewportsRedrawn, frame.SpritesDrawn, frame.ChunksPrefetched);
     }
-    else if(northWestCornerIn && southWestCornerIn)
+
+    fclose(file);
+
+    printf("Wrote %d frames to %s\n", (int)frames.size(), path);
+    return true;
+}
+
+// Chrome's trace event format, open it with chrome://tracing or https://ui.perfetto.dev
+// Each frame and each stage is a complete ("X") event, the counters are counter ("C") events.
+bool DumpFrameProfilesChromeTrace(const char* path)
+{
+    std::vector<FrameProfile_t> frames;
+    CopyRecentFrameProfiles(frames);
+
+    FILE* file = fopen(path, "w");
+
+    if(file == nullptr)
     {
-        return WindowIntersectType_t::East;
+        printf("Couldn't open %s for writing\n", path);
+        return false;
     }
-    else if(northWestCornerIn && northEastCornerIn)
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    bool firstEvent = true;
+
+    for(const FrameProfile_t& frame : frames)
     {
-        return WindowIntersectType_t::South;
+        const double frameStart_us = ProfileTicksToMicroseconds(frame.FrameStart);
+
+        fprintf(file, "%s{\"name\":\"Frame %llu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}", firstEvent ? "" : ",\n",
+            (unsigned long long)frame.FrameIndex, frameStart_us, ProfileTicksToMicroseconds(frame.FrameEnd - frame.FrameStart));
+        firstEvent = false;
+
+        for(int stageIndex = 0; stageIndex < (int)ProfileStage_t::Count; stageIndex++)
+        {
+            if(frame.StageStart[stageIndex] == 0)
+            {
+                continue;
+            }
+
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.1f,\"dur\":%.1f}", cProfileStageNames[stageIndex],
+                ProfileTicksToMicroseconds(frame.StageStart[stageIndex]), ProfileTicksToMicroseconds(frame.StageTicks[stageIndex]));
+        }
+
+        fprintf(file, ",\n{\"name\":\"Counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.1f,\"args\":{\"tiles_drawn\":%d,\"missed_deadlines\":%d,\"render_target_switches\":%d,\"render_copies\":%d,\"viewports_redrawn\":%d,\"sprites_drawn\":%d,\"chunks_prefetched\":%d}}",
+            frameStart_us, frame.TilesDrawn, frame.MissedDeadlines, frame.RenderTargetSwitches, frame.RenderCopies, frame.ViewportsRedrawn, frame.SpritesDrawn, frame.ChunksPrefetched);
     }
-    else if(northEastCornerIn && southEastCornerIn)
+
+    fprintf(file, "\n]}\n");
+    fclose(file);
+
+    printf("Wrote %d frames to %s\n", (int)frames.size(), path);
+    return true;
+}
+
+void DumpFrameProfiles()
+{
+    DumpFrameProfilesCSV("frame_profile.csv");
+    DumpFrameProfilesChromeTrace("frame_trace.json");
+}
+
+//--------------------------------------------------------------------------------------
+// Frame pacing functions
+//--------------------------------------------------------------------------------------
+
+static inline Uint64 FrameDeadline(const FrameScheduler_t& scheduler, Uint64 frameNumber);
+
+// see GetFrameTime_ms
+static Uint64 GetFrameTicks(const FrameScheduler_t& scheduler)
+{
+    const Uint64 intoTimeline = (scheduler.TargetFPS == 0) ? SDL_GetPerformanceCounter() - scheduler.Epoch : FrameDeadline(scheduler, scheduler.FrameNumber) - scheduler.Epoch;
+
+    return scheduler.EarlierTimelines + intoTimeline;
+}
+
+// How far into the game the current frame is, in ms, for anything that moves with time (e.g., UpdateTileAnimations).
+// With a capped frame rate this is when the frame was due rather than when it actually started, so animations step
+// exactly in time with the frames even when one runs late. Changing the frame rate doesn't start it over.
+Uint64 GetFrameTime_ms(const FrameScheduler_t& scheduler)
+{
+    return GetFrameTicks(scheduler) * 1000 / scheduler.TicksPerSecond;
+}
+
+// Starts a new deadline timeline at the given rate (0 for uncapped), the next frame is due one frame length from now
+void SetFrameRate(FrameScheduler_t& scheduler, int targetFPS)
+{
+    // so the frame time keeps going from where it is instead of starting over
+    if(scheduler.TicksPerSecond != 0)
     {
-        return WindowIntersectType_t::West;
+        scheduler.EarlierTimelines = GetFrameTicks(scheduler);
     }
-    else if(southEastCornerIn)
+
+    scheduler.TargetFPS = targetFPS;
+    scheduler.TicksPerSecond = SDL_GetPerformanceFrequency();
+    scheduler.Epoch = SDL_GetPerformanceCounter();
+    scheduler.FrameNumber = 0;
+
+    if(scheduler.SpinMargin == 0)
     {
-        return WindowIntersectType_t::NorthWest;
+        scheduler.SpinMargin = scheduler.TicksPerSecond * cMinSpinMargin_us / 1000000;
     }
-    else if(southWestCornerIn)
+
+    if(scheduler.LastReport == 0)
     {
-        return WindowIntersectType_t::NorthEast;
+        scheduler.LastReport = scheduler.Epoch;
     }
-    else if(northWestCornerIn)
+
+    if(targetFPS == 0)
     {
-        return WindowIntersectType_t::SouthEast;
+        printf("Frame rate: uncapped\n");
     }
-    else if(northEastCornerIn)
-    {
-        return WindowIntersectType_t::SouthWest;
-    } 
     else
     {
-        assert(0);
-        throw std::logic_error("Impossible intersect type detected.");
+        printf("Frame rate: %d fps\n", targetFPS);
     }
-
 }
 
-// See scanned png hand written pages in this folder.
-// Returns a rectangle (top left corner in map coordinates) containing the dimensions of the map to copy into the window.
-SDL_Rect GetMapRenderRectangle(const IntVec2_t& mapSize_px, const IntVec2_t& windowNorthWestCorner_px, const IntVec2_t& windowSize_px)
+// when frame number frameNumber of the current timeline is due
+static inline Uint64 FrameDeadline(const FrameScheduler_t& scheduler, Uint64 frameNumber)
 {
+    // done as whole seconds + leftover frames so a 144 fps frame length (6944.44 us) doesn't get rounded
+    const Uint64 wholeSeconds = frameNumber / scheduler.TargetFPS;
+    const Uint64 leftoverFrames = frameNumber % scheduler.TargetFPS;
 
-    WindowIntersectType_t intersectType = GetWindowIntersectType(mapSize_px, windowNorthWestCorner_px, windowSize_px);
+    return scheduler.Epoch + wholeSeconds * scheduler.TicksPerSecond + leftoverFrames * scheduler.TicksPerSecond / scheduler.TargetFPS;
+}
 
-    if(intersectType == WindowIntersectType_t::TotallyOut)
+// Once a second, says how many deadlines were missed (if any)
+static void ReportMissedFrames(FrameScheduler_t& scheduler, Uint64 now)
+{
+    scheduler.FramesSinceReport++;
+
+    if(now - scheduler.LastReport < scheduler.TicksPerSecond)
     {
-        // nothing to draw from the map
-        return {0,0,0,0};
+        return;
     }
 
-    if(intersectType == WindowIntersectType_t::TotallyIn)
+    if(scheduler.MissedFramesSinceReport > 0)
     {
-        SDL_Rect mapRenderRect{0};
-        mapRenderRect.x = windowNorthWestCorner_px.X;
-        mapRenderRect.y = windowNorthWestCorner_px.Y;
+        printf("Missed %llu of %llu frame deadlines in the last second (%llu total)\n", (unsigned long long)scheduler.MissedFramesSinceReport,
+            (unsigned long long)scheduler.FramesSinceReport, (unsigned long long)scheduler.MissedFrames);
+    }
 
-        mapRenderRect.w = windowSize_px.X;
-        mapRenderRect.h = windowSize_px.Y;
+    scheduler.MissedFramesSinceReport = 0;
+    scheduler.FramesSinceReport = 0;
+    scheduler.LastReport = now;
+}
 
-        return mapRenderRect;
-    }
+// Blocks until the next frame's deadline. Sleeps for most of the wait, then spins for the last SpinMargin ticks to land on it.
+//
+// If the frame ran past its deadline, the deadlines it blew through are counted as missed and skipped over rather than
+// rushed through back to back, the next frame is just due at the next deadline still in the future.
+// Returns how many deadlines were missed.
+int WaitForNextFrame(FrameScheduler_t& scheduler)
+{
+    Uint64 now = SDL_GetPerformanceCounter();
 
-    // abbreviations
-    const IntVec2_t& winP   = windowNorthWestCorner_px; 
-    const IntVec2_t& winSiz = windowSize_px;
-    const IntVec2_t& mSiz   = mapSize_px;
+    if(scheduler.TargetFPS == 0)
+    {
+        ReportMissedFrames(scheduler, now);
+        return 0;
+    }
 
-    const int northHeight   = winP.Y + winSiz.Y;
-    const int southHeight   = mSiz.Y - winP.Y;
+    scheduler.FrameNumber++;
+    Uint64 deadline = FrameDeadline(scheduler, scheduler.FrameNumber);
 
-    const int westWidth     = winP.X + winSiz.X;
-    const int eastWidth     = mSiz.X - winP.X;
+    int missedDeadlines = 0;
 
-    switch(intersectType)
+    if(now > deadline)
     {
-        case WindowIntersectType_t::NorthWest:
-        {
-            SDL_Rect mapRenderRect{0};    
-            mapRenderRect.x = 0;
-            mapRenderRect.y = 0;
+        // number of deadlines that have already gone by, including this one
+        const Uint64 lateFrames = (now - deadline) * scheduler.TargetFPS / scheduler.TicksPerSecond + 1;
 
-            mapRenderRect.w = westWidth;
-            mapRenderRect.h = northHeight;
+        missedDeadlines = (int)lateFrames;
+        scheduler.FrameNumber += lateFrames;
+        deadline = FrameDeadline(scheduler, scheduler.FrameNumber);
 
-            return mapRenderRect;
-        }
+        scheduler.MissedFrames += lateFrames;
+        scheduler.MissedFramesSinceReport += lateFrames;
+    }
 
-        case WindowIntersectType_t::North:
+    // sleep
+    if(deadline - now > scheduler.SpinMargin)
+    {
+        const Uint64 sleepTicks = deadline - now - scheduler.SpinMargin;
+        const Uint32 sleep_ms = (Uint32)(sleepTicks * 1000 / scheduler.TicksPerSecond);
+
+        if(sleep_ms > 0)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = winP.X;
-            mapRenderRect.y = 0;
+            SDL_Delay(sleep_ms);
 
-            mapRenderRect.w = winSiz.X;
-            mapRenderRect.h = northHeight;
+            // if the sleep overshot by more than the margin, spin for longer next time
+            const Uint64 afterSleep = SDL_GetPerformanceCounter();
+            const Uint64 wokeAt = now + sleep_ms * scheduler.TicksPerSecond / 1000;
+            const Uint64 overshoot = (afterSleep > wokeAt) ? afterSleep - wokeAt : 0;
+            const Uint64 maxSpinMargin = scheduler.TicksPerSecond * cMaxSpinMargin_us / 1000000;
 
-            return mapRenderRect;
+            if(overshoot > scheduler.SpinMargin)
+            {
+                scheduler.SpinMargin = (overshoot < maxSpinMargin) ? overshoot : maxSpinMargin;
+            }
         }
+    }
+
+    // spin
+    do
+    {
+        now = SDL_GetPerformanceCounter();
+    } while(now < deadline);
+
+    ReportMissedFrames(scheduler, now);
+
+    return missedDeadlines;
+}
+
+//--------------------------------------------------------------------------------------
+// Tile map functions
+//--------------------------------------------------------------------------------------
+
+static inline Uint64 ChunkKey(const IntVec2_t& chunkCoordinate)
+{
+    return ((Uint64)(Uint32)chunkCoordinate.Y << 32) | (Uint32)chunkCoordinate.X;
+}
+
+static inline IntVec2_t ChunkCoordinateForTile(const IntVec2_t& tileCoordinate)
+{
+    // tile coordinates in a map are never negative, so this always rounds down
+    return {tileCoordinate.X / TILE_CHUNK_SIZE, tileCoordinate.Y / TILE_CHUNK_SIZE};
+}
+
+// For a file backed map, where the chunk is in the mapped file. Returns nullptr if the file doesn't have it (or it's empty).
+// Nothing in the chunk itself is read here, so it isn't paged in yet. OpenTileMapFile already checked every offset.
+static const TileChunk_t* FindFileChunkData(const TileMap_t& tileMap, const IntVec2_t& chunkCoordinate)
+{
+    if(tileMap.FileChunkOffsets == nullptr || !InRange(0, chunkCoordinate.X, tileMap.FileSize_Chunks.X - 1) || !InRange(0, chunkCoordinate.Y, tileMap.FileSize_Chunks.Y - 1))
+    {
+        return nullptr;
+    }
+
+    const Uint64 offset = tileMap.FileChunkOffsets[(size_t)chunkCoordinate.Y * tileMap.FileSize_Chunks.X + chunkCoordinate.X];
+
+    if(offset == 0)
+    {
+        return nullptr;
+    }
+
+    return (const TileChunk_t*)(tileMap.File->Data + offset);
+}
+
+// FindFileChunkData, but the first time a chunk comes out of here all its tile IDs are checked against TileSources,
+// so nothing that draws from it can index off the end. A chunk with a bad ID reads as empty, same as a missing one.
+// This reads the whole chunk the first time, so it gets paged in.
+static const TileChunk_t* FindFileChunk(const TileMap_t& tileMap, const IntVec2_t& chunkCoordinate)
+{
+    const TileChunk_t* chunk = FindFileChunkData(tileMap, chunkCoordinate);
+
+    if(chunk == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::atomic<Uint8>& state = tileMap.FileChunkStates[(size_t)chunkCoordinate.Y * tileMap.FileSize_Chunks.X + chunkCoordinate.X];
+    Uint8 checked = state.load(std::memory_order_relaxed);
+
+    if(checked == cFileChunkUnchecked)
+    {
+        // the file doesn't change while it's open, so two threads checking the same chunk at once just get the same answer
+        const size_t tileSourceCount = tileMap.TileSources.size();
+        bool valid = true;
+
+        for(size_t tileIndex = 0; tileIndex < TILE_CHUNK_SIZE * TILE_CHUNK_SIZE; tileIndex++)
+        {
+            valid = valid && (chunk->Tiles[tileIndex] < tileSourceCount);
+        }
+
+        checked = valid ? cFileChunkValid : cFileChunkDamaged;
+        state.store(checked, std::memory_order_relaxed);
+
+        if(!valid)
+        {
+            printf("Map file chunk (%d, %d) has tile IDs with no tile source, it'll be left empty\n", chunkCoordinate.X, chunkCoordinate.Y);
+        }
+    }
+
+    return (checked == cFileChunkValid) ? chunk : nullptr;
+}
+
+// returns nullptr if nothing has been put in the chunk yet
+const TileChunk_t* FindChunk(const TileMap_t& tileMap, const IntVec2_t& chunkCoordinate)
+{
+    auto found = tileMap.Chunks.find(ChunkKey(chunkCoordinate));
+
+    if(found == tileMap.Chunks.end())
+    {
+        return FindFileChunk(tileMap, chunkCoordinate);
+    }
+
+    return found->second.get();
+}
+
+TileId_t GetTile(const TileMap_t& tileMap, const IntVec2_t& tileCoordinate)
+{
+    assert(InRange(0, tileCoordinate.X, tileMap.Size_Tiles.X - 1));
+    assert(InRange(0, tileCoordinate.Y, tileMap.Size_Tiles.Y - 1));
+
+    const IntVec2_t chunkCoordinate = ChunkCoordinateForTile(tileCoordinate);
+    const TileChunk_t* chunk = FindChunk(tileMap, chunkCoordinate);
+
+    if(chunk == nullptr)
+    {
+        return cEmptyTile;
+    }
+
+    const IntVec2_t inChunk = {tileCoordinate.X - chunkCoordinate.X * TILE_CHUNK_SIZE, tileCoordinate.Y - chunkCoordinate.Y * TILE_CHUNK_SIZE};
+
+    return chunk->Tiles[inChunk.Y * TILE_CHUNK_SIZE + inChunk.X];
+}
+
+// Puts a tile ID in the map's storage, allocating its chunk if needed. This does NOT redraw anything.
+void WriteTile(TileMap_t& tileMap, const IntVec2_t& tileCoordinate, TileId_t tileId)
+{
+    assert(InRange(0, tileCoordinate.X, tileMap.Size_Tiles.X - 1));
+    assert(InRange(0, tileCoordinate.Y, tileMap.Size_Tiles.Y - 1));
+    assert(tileId < tileMap.TileSources.size());
+
+    const IntVec2_t chunkCoordinate = ChunkCoordinateForTile(tileCoordinate);
+    std::unique_ptr<TileChunk_t>& chunk = tileMap.Chunks[ChunkKey(chunkCoordinate)];
+
+    if(!chunk)
+    {
+        const TileChunk_t* fileChunk = FindFileChunk(tileMap, chunkCoordinate);
+
+        if(fileChunk != nullptr)
+        {
+            // the file is read only, edits go in a copy
+            chunk.reset(new TileChunk_t(*fileChunk));
+        }
+        else if(tileId == cEmptyTile)
+        {
+            // it's already empty, don't allocate a chunk just to say so
+            tileMap.Chunks.erase(ChunkKey(chunkCoordinate));
+            return;
+        }
+        else
+        {
+            chunk.reset(new TileChunk_t());
+        }
+    }
+
+    const IntVec2_t inChunk = {tileCoordinate.X - chunkCoordinate.X * TILE_CHUNK_SIZE, tileCoordinate.Y - chunkCoordinate.Y * TILE_CHUNK_SIZE};
+
+    TileId_t& tile = chunk->Tiles[inChunk.Y * TILE_CHUNK_SIZE + inChunk.X];
+
+    if(tile != tileId)
+    {
+        tile = tileId;
+        tileMap.Version++;
+    }
+}
+
+// Adds a tile picture (an area of a tile atlas page) to the map's tile ID lookup table, returns the new tile's ID
+TileId_t AddTileSource(TileMap_t& tileMap, const SDL_Rect& atlasRect, int page = 0)
+{
+    if(tileMap.TileSources.empty())
+    {
+        // reserve ID 0 for cEmptyTile
+        tileMap.TileSources.push_back({0, {0, 0, 0, 0}});
+    }
+
+    assert(tileMap.TileSources.size() <= 0xFFFF);
+
+    tileMap.TileSources.push_back({page, atlasRect});
+
+    return (TileId_t)(tileMap.TileSources.size() - 1);
+}
+
+// Gives every cGridSize_px cell of a tileset its own tile ID, a row at a time. tileSet is where BuildTileAtlas put the tileset.
+// Returns the first ID, cell (x, y) of the tileset is firstTileId + y * (columns in the tileset) + x.
+TileId_t AddTileSetTiles(TileMap_t& tileMap, const TileSource_t& tileSet)
+{
+    const IntVec2_t size_Cells = {tileSet.Rect.w / cGridSize_px, tileSet.Rect.h / cGridSize_px};
+
+    TileId_t firstTileId = cEmptyTile;
+
+    for(int rowIndex = 0; rowIndex < size_Cells.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < size_Cells.X; columnIndex++)
+        {
+            const SDL_Rect cellRect = {tileSet.Rect.x + columnIndex * cGridSize_px, tileSet.Rect.y + rowIndex * cGridSize_px, cGridSize_px, cGridSize_px};
+
+            const TileId_t tileId = AddTileSource(tileMap, cellRect, tileSet.Page);
+
+            if(firstTileId == cEmptyTile)
+            {
+                firstTileId = tileId;
+            }
+        }
+    }
+
+    return firstTileId;
+}
+
+// Makes a new tile ID that cycles through frames (frameCount of them, each shown for its Duration_ms) and returns it.
+// Every tile with the ID animates together, see UpdateTileAnimations. Animations aren't saved in map files.
+TileId_t AddTileAnimation(TileMap_t& tileMap, const TileAnimationFrame_t* frames, int frameCount)
+{
+    assert(frameCount > 0);
+
+    TileAnimation_t animation;
+    animation.TileId = AddTileSource(tileMap, frames[0].Source.Rect, frames[0].Source.Page);
+    animation.Frames.assign(frames, frames + frameCount);
+    animation.Length_ms = 0;
+    animation.CurrentFrame = 0;
+
+    for(const TileAnimationFrame_t& frame : animation.Frames)
+    {
+        assert(frame.Duration_ms > 0);
+        animation.Length_ms += frame.Duration_ms;
+    }
+
+    tileMap.Animations.push_back(animation);
+
+    return animation.TileId;
+}
+
+IntVec2_t GetMapSize_px(const TileMap_t& tileMap)
+{
+    return {tileMap.Size_Tiles.X * cGridSize_px, tileMap.Size_Tiles.Y * cGridSize_px};
+}
+
+//--------------------------------------------------------------------------------------
+// Map file functions
+//--------------------------------------------------------------------------------------
+
+// Map file layout (everything little endian, which is every machine this runs on):
+//
+//     TileMapFileHeader_t
+//     tile source table:  TileSourceCount x {Sint32 x, y, w, h, page}, an area of a tile atlas page per tile ID
+//     chunk table:        ChunkRows x ChunkColumns x Uint64, row major, file offset of each chunk or 0 if it's empty (padded to start on 8 bytes)
+//     chunks:             TILE_CHUNK_SIZE x TILE_CHUNK_SIZE TileId_ts each, laid out exactly like TileChunk_t
+//
+// Each chunk starts on a sizeof(TileChunk_t) boundary, so a chunk never straddles more pages than it has to and the mapped
+// chunk can be used as a TileChunk_t in place, with no copying or decoding.
+//
+// Opening a map only reads the header and the tile source table, the chunk table and the chunks are paged in by the OS as
+// they're looked at. Rendering only looks at the chunks under a window's tiles, so startup time and memory use don't depend on how big the map is.
+
+static const char cTileMapFileMagic[8] = {'W', 'M', 'I', 'M', 'A', 'P', '\0', '\0'};
+const Uint32 cTileMapFileVersion = 2;
+
+// Sint32s per entry in the tile source table
+const int cTileSourceFields = 5;
+
+MappedFile_t::~MappedFile_t()
+{
+#ifdef _WIN32
+    if(Data != nullptr)
+    {
+        UnmapViewOfFile(Data);
+    }
+
+    if(Mapping != nullptr)
+    {
+        CloseHandle(Mapping);
+    }
+
+    if(File != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(File);
+    }
+#else
+    if(Data != nullptr)
+    {
+        munmap((void*)Data, Size);
+    }
+#endif
+}
+
+// Maps a whole file read only, returns nullptr if it couldn't be opened or is empty
+std::unique_ptr<MappedFile_t> MapFile(const char* path)
+{
+    std::unique_ptr<MappedFile_t> file(new MappedFile_t());
+
+#ifdef _WIN32
+    file->File = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+
+    LARGE_INTEGER fileSize = {0};
+
+    if(file->File == INVALID_HANDLE_VALUE || !GetFileSizeEx(file->File, &fileSize) || fileSize.QuadPart == 0)
+    {
+        printf("Couldn't open '%s' for mapping\n", path);
+        return nullptr;
+    }
+
+    file->Size = (size_t)fileSize.QuadPart;
+    file->Mapping = CreateFileMappingA(file->File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if(file->Mapping != nullptr)
+    {
+        file->Data = (const Uint8*)MapViewOfFile(file->Mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    const int fileDescriptor = open(path, O_RDONLY);
+    struct stat fileStatus;
+
+    if(fileDescriptor < 0 || fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size == 0)
+    {
+        printf("Couldn't open '%s' for mapping\n", path);
+
+        if(fileDescriptor >= 0)
+        {
+            close(fileDescriptor);
+        }
+
+        return nullptr;
+    }
+
+    file->Size = (size_t)fileStatus.st_size;
+
+    void* data = mmap(nullptr, file->Size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+    // the mapping keeps the file open by itself
+    close(fileDescriptor);
+
+    if(data != MAP_FAILED)
+    {
+        file->Data = (const Uint8*)data;
+
+        // chunks get looked at wherever the windows are, not front to back
+        madvise(data, file->Size, MADV_RANDOM);
+    }
+#endif
+
+    if(file->Data == nullptr)
+    {
+        printf("Couldn't map '%s'\n", path);
+        return nullptr;
+    }
+
+    return file;
+}
+
+// Writes a map out in the map file format, returns false if the file couldn't be written
+bool SaveTileMapFile(const TileMap_t& tileMap, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+
+    if(file == nullptr)
+    {
+        printf("Couldn't open '%s' for writing\n", path);
+        return false;
+    }
+
+    const IntVec2_t size_Chunks = FindGridCoordinateForPoint_RoundUp(tileMap.Size_Tiles, TILE_CHUNK_SIZE);
+    const size_t chunkCount = (size_t)size_Chunks.X * size_Chunks.Y;
+
+    TileMapFileHeader_t header = {};
+    memcpy(header.Magic, cTileMapFileMagic, sizeof(header.Magic));
+    header.Version = cTileMapFileVersion;
+    header.ChunkSize = TILE_CHUNK_SIZE;
+    header.Width_Tiles = tileMap.Size_Tiles.X;
+    header.Height_Tiles = tileMap.Size_Tiles.Y;
+    header.TileSourceCount = (Uint32)tileMap.TileSources.size();
+    header.ChunkColumns = (Uint32)size_Chunks.X;
+    header.ChunkRows = (Uint32)size_Chunks.Y;
+    header.TileSourceTableOffset = sizeof(TileMapFileHeader_t);
+
+    // the chunk table is read in place as Uint64s, so it's lined up on a Uint64 boundary
+    const Uint64 tileSourceTableEnd = header.TileSourceTableOffset + header.TileSourceCount * cTileSourceFields * sizeof(Sint32);
+    header.ChunkTableOffset = (tileSourceTableEnd + sizeof(Uint64) - 1) / sizeof(Uint64) * sizeof(Uint64);
+
+    // chunks go after the chunk table, lined up on a chunk boundary
+    const Uint64 chunkTableEnd = header.ChunkTableOffset + chunkCount * sizeof(Uint64);
+    const Uint64 firstChunkOffset = (chunkTableEnd + sizeof(TileChunk_t) - 1) / sizeof(TileChunk_t) * sizeof(TileChunk_t);
+
+    Uint64 nextChunkOffset = firstChunkOffset;
+
+    std::vector<Uint64> chunkOffsets(chunkCount, 0);
+    std::vector<const TileChunk_t*> chunksToWrite;
+
+    for(int chunkY = 0; chunkY < size_Chunks.Y; chunkY++)
+    {
+        for(int chunkX = 0; chunkX < size_Chunks.X; chunkX++)
+        {
+            const TileChunk_t* chunk = FindChunk(tileMap, {chunkX, chunkY});
+
+            if(chunk != nullptr)
+            {
+                chunkOffsets[(size_t)chunkY * size_Chunks.X + chunkX] = nextChunkOffset;
+                chunksToWrite.push_back(chunk);
+                nextChunkOffset += sizeof(TileChunk_t);
+            }
+        }
+    }
+
+    bool written = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+    for(const TileSource_t& tileSource : tileMap.TileSources)
+    {
+        const Sint32 entry[cTileSourceFields] = {tileSource.Rect.x, tileSource.Rect.y, tileSource.Rect.w, tileSource.Rect.h, tileSource.Page};
+        written = written && (fwrite(entry, sizeof(entry), 1, file) == 1);
+    }
+
+    const Uint8 tableAlignment[sizeof(Uint64)] = {0};
+    const size_t tableAlignmentSize = (size_t)(header.ChunkTableOffset - tileSourceTableEnd);
+    written = written && (tableAlignmentSize == 0 || fwrite(tableAlignment, 1, tableAlignmentSize, file) == tableAlignmentSize);
+
+    written = written && (chunkCount == 0 || fwrite(chunkOffsets.data(), sizeof(Uint64), chunkCount, file) == chunkCount);
+
+    if(!chunksToWrite.empty())
+    {
+        // pad up to the first chunk
+        const std::vector<Uint8> padding((size_t)(firstChunkOffset - chunkTableEnd), 0);
+        written = written && (padding.empty() || fwrite(padding.data(), 1, padding.size(), file) == padding.size());
+    }
+
+    for(const TileChunk_t* chunk : chunksToWrite)
+    {
+        written = written && (fwrite(chunk, sizeof(TileChunk_t), 1, file) == 1);
+    }
+
+    written = (fclose(file) == 0) && written;
+
+    if(!written)
+    {
+        printf("Couldn't write '%s'\n", path);
+    }
+
+    return written;
+}
+
+// Makes tileMap a file backed map of the map file at path. Returns false (and leaves tileMap alone) if the file isn't a valid map file.
+bool OpenTileMapFile(TileMap_t& tileMap, const char* path)
+{
+    std::unique_ptr<MappedFile_t> file = MapFile(path);
+
+    if(!file)
+    {
+        return false;
+    }
+
+    TileMapFileHeader_t header = {};
+
+    if(file->Size < sizeof(header))
+    {
+        printf("'%s' is too small to be a map file\n", path);
+        return false;
+    }
+
+    memcpy(&header, file->Data, sizeof(header));
+
+    if(memcmp(header.Magic, cTileMapFileMagic, sizeof(header.Magic)) != 0 || header.Version != cTileMapFileVersion)
+    {
+        printf("'%s' isn't a version %u map file\n", path, cTileMapFileVersion);
+        return false;
+    }
+
+    if(header.ChunkSize != TILE_CHUNK_SIZE)
+    {
+        printf("'%s' was written with %u tile chunks, this was built with %d\n", path, header.ChunkSize, TILE_CHUNK_SIZE);
+        return false;
+    }
+
+    const IntVec2_t size_Tiles = {header.Width_Tiles, header.Height_Tiles};
+    const IntVec2_t size_Chunks = FindGridCoordinateForPoint_RoundUp(size_Tiles, TILE_CHUNK_SIZE);
+
+    const Uint64 tileSourceTableSize = (Uint64)header.TileSourceCount * cTileSourceFields * sizeof(Sint32);
+    const Uint64 chunkTableSize = (Uint64)size_Chunks.X * size_Chunks.Y * sizeof(Uint64);
+
+    // the offsets come from the file, so they're compared against what's left of it rather than added to (which could wrap)
+    const bool validSize = (size_Tiles.X >= 0 && size_Tiles.Y >= 0 && header.ChunkColumns == (Uint32)size_Chunks.X && header.ChunkRows == (Uint32)size_Chunks.Y);
+    const bool validTables = (header.TileSourceTableOffset <= file->Size && tileSourceTableSize <= file->Size - header.TileSourceTableOffset) &&
+                             (header.ChunkTableOffset <= file->Size && chunkTableSize <= file->Size - header.ChunkTableOffset) && (header.ChunkTableOffset % sizeof(Uint64) == 0);
+
+    if(!validSize || !validTables || header.TileSourceCount == 0 || header.TileSourceCount - 1 > 0xFFFF)
+    {
+        printf("'%s' is damaged\n", path);
+        return false;
+    }
+
+    // every chunk has to be lined up for TileChunk_t and all inside the file, FindFileChunkData hands them out as they are
+    const Uint64* chunkOffsets = (const Uint64*)(file->Data + header.ChunkTableOffset);
+    const size_t chunkCount = (size_t)size_Chunks.X * size_Chunks.Y;
+
+    for(size_t chunkIndex = 0; chunkIndex < chunkCount; chunkIndex++)
+    {
+        const Uint64 offset = chunkOffsets[chunkIndex];
+
+        if(offset != 0 && (offset % alignof(TileChunk_t) != 0 || file->Size < sizeof(TileChunk_t) || offset > file->Size - sizeof(TileChunk_t)))
+        {
+            printf("'%s' is damaged, chunk %zu is at %llu\n", path, chunkIndex, (unsigned long long)offset);
+            return false;
+        }
+    }
+
+    std::vector<TileSource_t> tileSources(header.TileSourceCount);
+
+    for(Uint32 tileId = 0; tileId < header.TileSourceCount; tileId++)
+    {
+        Sint32 entry[cTileSourceFields] = {0};
+        memcpy(entry, file->Data + header.TileSourceTableOffset + tileId * sizeof(entry), sizeof(entry));
+
+        // which pages there are depends on the atlas it's drawn with, that's checked when drawing. Negative is never right.
+        if(entry[4] < 0 || entry[2] < 0 || entry[3] < 0)
+        {
+            printf("'%s' is damaged, tile %u has source page %d (%d, %d, %d, %d)\n", path, tileId, entry[4], entry[0], entry[1], entry[2], entry[3]);
+            return false;
+        }
+
+        tileSources[tileId] = {entry[4], {entry[0], entry[1], entry[2], entry[3]}};
+    }
+
+    tileMap = TileMap_t();
+    tileMap.Size_Tiles = size_Tiles;
+    tileMap.TileSources = std::move(tileSources);
+
+    tileMap.FileChunkOffsets = chunkOffsets;
+    tileMap.FileSize_Chunks = size_Chunks;
+    tileMap.FileChunkStates.reset(new std::atomic<Uint8>[chunkCount]());
+    tileMap.File = std::move(file);
+
+    return true;
+}
+
+// The chunks (in chunk coordinates) under an area of the map (in map px), clipped to the map
+static SDL_Rect ChunkRectForArea(const TileMap_t& tileMap, const SDL_Rect& area_MapPx)
+{
+    SDL_Rect chunkRect = {0, 0, 0, 0};
+
+    if(area_MapPx.w <= 0 || area_MapPx.h <= 0)
+    {
+        return chunkRect;
+    }
+
+    const IntVec2_t firstTile = FindGridCoordinateForPoint({max(0, area_MapPx.x), max(0, area_MapPx.y)}, cGridSize_px);
+    const IntVec2_t endTile = FindGridCoordinateForPoint_RoundUp({area_MapPx.x + area_MapPx.w, area_MapPx.y + area_MapPx.h}, cGridSize_px);
+
+    const IntVec2_t firstChunk = ChunkCoordinateForTile(firstTile);
+    const IntVec2_t endChunk = FindGridCoordinateForPoint_RoundUp({min(endTile.X, tileMap.Size_Tiles.X), min(endTile.Y, tileMap.Size_Tiles.Y)}, TILE_CHUNK_SIZE);
+
+    chunkRect.x = firstChunk.X;
+    chunkRect.y = firstChunk.Y;
+    chunkRect.w = max(0, endChunk.X - firstChunk.X);
+    chunkRect.h = max(0, endChunk.Y - firstChunk.Y);
+
+    return chunkRect;
+}
+
+// Asks the OS to start reading in the chunks under an area of the map (in map px) now, so they're already there when they're drawn.
+// Give it the window's map rect (see GetMapRenderRectangle / ComputeWindowClip) grown by however far the window could move before then.
+// Does nothing for maps that aren't file backed (or on Windows, where chunks are just paged in when they're first looked at).
+void PageInTileMapArea(const TileMap_t& tileMap, const SDL_Rect& area_MapPx)
+{
+#ifndef _WIN32
+    if(tileMap.FileChunkOffsets == nullptr)
+    {
+        return;
+    }
+
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    const SDL_Rect chunkRect = ChunkRectForArea(tileMap, area_MapPx);
+
+    for(int chunkY = chunkRect.y; chunkY < chunkRect.y + chunkRect.h; chunkY++)
+    {
+        for(int chunkX = chunkRect.x; chunkX < chunkRect.x + chunkRect.w; chunkX++)
+        {
+            // edited chunks are already in memory
+            if(tileMap.Chunks.count(ChunkKey({chunkX, chunkY})) != 0)
+            {
+                continue;
+            }
+
+            const TileChunk_t* chunk = FindFileChunkData(tileMap, {chunkX, chunkY});
+
+            if(chunk != nullptr)
+            {
+                const uintptr_t pageStart = (uintptr_t)chunk / pageSize * pageSize;
+                madvise((void*)pageStart, (uintptr_t)chunk + sizeof(TileChunk_t) - pageStart, MADV_WILLNEED);
+            }
+        }
+    }
+#else
+    (void)tileMap;
+    (void)area_MapPx;
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Chunk prefetching functions
+//--------------------------------------------------------------------------------------
+
+// Reads a little of every page under a chunk, so the OS has to page the whole chunk in
+static Uint32 TouchFileChunk(const TileChunk_t* chunk)
+{
+    const size_t cTouchStride = 4096 / sizeof(TileId_t);
+
+    Uint32 sum = 0;
+
+    for(size_t tileIndex = 0; tileIndex < TILE_CHUNK_SIZE * TILE_CHUNK_SIZE; tileIndex += cTouchStride)
+    {
+        sum += chunk->Tiles[tileIndex];
+    }
+
+    return sum + chunk->Tiles[TILE_CHUNK_SIZE * TILE_CHUNK_SIZE - 1];
+}
+
+static void ChunkPrefetcherMain(ChunkPrefetcher_t* prefetcher)
+{
+    std::vector<ChunkPrefetchRequest_t> requests;
+
+    while(1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(prefetcher->Lock);
+            prefetcher->Signal.wait(lock, [&]{ return prefetcher->Quit || !prefetcher->Requests.empty(); });
+
+            if(prefetcher->Quit)
+            {
+                return;
+            }
+
+            requests.swap(prefetcher->Requests);
+        }
+
+        Uint32 sum = 0;
+
+        // newest first, the older ones are more likely to be out of date
+        for(auto request = requests.rbegin(); request != requests.rend(); ++request)
+        {
+            for(int chunkY = request->Chunks.y; chunkY < request->Chunks.y + request->Chunks.h; chunkY++)
+            {
+                for(int chunkX = request->Chunks.x; chunkX < request->Chunks.x + request->Chunks.w; chunkX++)
+                {
+                    // only the file part of the map is looked at, and that doesn't change while the map is open,
+                    // so there's nothing to race with the render thread over
+                    const TileChunk_t* chunk = FindFileChunkData(*request->TileMap, {chunkX, chunkY});
+
+                    if(chunk != nullptr)
+                    {
+                        sum += TouchFileChunk(chunk);
+                        prefetcher->ChunksTouched.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+
+        prefetcher->Sink = sum;
+        requests.clear();
+    }
+}
+
+// Queues up chunks (in chunk coordinates) of a file backed map to be paged in on the prefetch thread, starting it if needed.
+// Maps that aren't file backed are ignored.
+void RequestChunkPrefetch(ChunkPrefetcher_t& prefetcher, const TileMap_t& tileMap, const SDL_Rect& chunkRect)
+{
+    if(tileMap.FileChunkOffsets == nullptr || chunkRect.w <= 0 || chunkRect.h <= 0)
+    {
+        return;
+    }
+
+    if(!prefetcher.Thread.joinable())
+    {
+        prefetcher.Quit = false;
+        prefetcher.Thread = std::thread(ChunkPrefetcherMain, &prefetcher);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(prefetcher.Lock);
+
+        // if the prefetcher is falling behind, the oldest requests are the least useful
+        if(prefetcher.Requests.size() >= cMaxChunkPrefetchRequests)
+        {
+            prefetcher.Requests.erase(prefetcher.Requests.begin());
+        }
+
+        prefetcher.Requests.push_back({&tileMap, chunkRect});
+    }
+
+    prefetcher.Signal.notify_one();
+}
+
+// Stops the prefetch thread, dropping anything it hadn't got to. Has to be called before a file backed map it's been given is closed.
+void StopChunkPrefetcher(ChunkPrefetcher_t& prefetcher)
+{
+    if(!prefetcher.Thread.joinable())
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(prefetcher.Lock);
+        prefetcher.Quit = true;
+        prefetcher.Requests.clear();
+    }
+
+    prefetcher.Signal.notify_one();
+    prefetcher.Thread.join();
+}
+
+// Works out where a window is heading from how it's been moving, and asks for the chunks between here and there to be prefetched.
+//
+// The velocity is a running average of how far the window moved each frame, and the window is assumed to keep going that way
+// for cPrefetchLookahead_frames. Nothing is asked for if the window isn't moving, or if it would be the same chunks as last time.
+// Returns true if it asked for any.
+bool PredictChunkPrefetch(ViewportMotion_t& motion, const TileMap_t& tileMap, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize_px)
+{
+    if(motion.HasPosition)
+    {
+        const float movedX = (float)(relToMap_WindowTopLeft.X - motion.Position.X);
+        const float movedY = (float)(relToMap_WindowTopLeft.Y - motion.Position.Y);
+
+        motion.VelocityX = motion.VelocityX * (1.0f - cVelocitySmoothing) + movedX * cVelocitySmoothing;
+        motion.VelocityY = motion.VelocityY * (1.0f - cVelocitySmoothing) + movedY * cVelocitySmoothing;
+    }
+
+    motion.Position = relToMap_WindowTopLeft;
+    motion.HasPosition = true;
+
+    if(tileMap.FileChunkOffsets == nullptr || (std::fabs(motion.VelocityX) < cMinPrefetchVelocity && std::fabs(motion.VelocityY) < cMinPrefetchVelocity))
+    {
+        return false;
+    }
+
+    const IntVec2_t predictedTopLeft = {relToMap_WindowTopLeft.X + (int)(motion.VelocityX * cPrefetchLookahead_frames),
+                                        relToMap_WindowTopLeft.Y + (int)(motion.VelocityY * cPrefetchLookahead_frames)};
+
+    // everything the window passes over on the way there
+    const IntVec2_t sweptTopLeft = {min(relToMap_WindowTopLeft.X, predictedTopLeft.X), min(relToMap_WindowTopLeft.Y, predictedTopLeft.Y)};
+    const IntVec2_t sweptBottomRight = {max(relToMap_WindowTopLeft.X, predictedTopLeft.X) + windowSize_px.X, max(relToMap_WindowTopLeft.Y, predictedTopLeft.Y) + windowSize_px.Y};
+    const SDL_Rect sweptArea_MapPx = {sweptTopLeft.X, sweptTopLeft.Y, sweptBottomRight.X - sweptTopLeft.X, sweptBottomRight.Y - sweptTopLeft.Y};
+
+    const SDL_Rect chunkRect = ChunkRectForArea(tileMap, sweptArea_MapPx);
+
+    if(chunkRect.x == motion.RequestedChunks.x && chunkRect.y == motion.RequestedChunks.y && chunkRect.w == motion.RequestedChunks.w && chunkRect.h == motion.RequestedChunks.h)
+    {
+        return false;
+    }
+
+    motion.RequestedChunks = chunkRect;
+    RequestChunkPrefetch(ChunkPrefetcher, tileMap, chunkRect);
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Demo / placeholder only functions
+//--------------------------------------------------------------------------------------
+
+// this is only for the sake of the demo, in a real game you would load the map from somewhere.
+// Every tile of the tileset gets its own tile ID and is put at the same coordinate in the map, so the map looks exactly like the tileset.
+// tileSet is where the tileset ended up in the tile atlas.
+void DEMO_BuildTileMap(TileMap_t& tileMap, const TileSource_t& tileSet)
+{
+    assert(tileSet.Rect.w == cTileSetSize_Tiles.X * cGridSize_px && tileSet.Rect.h == cTileSetSize_Tiles.Y * cGridSize_px);
+
+    tileMap = TileMap_t();
+    tileMap.Size_Tiles = cMapSize_Tiles;
+
+    const TileId_t firstTileId = AddTileSetTiles(tileMap, tileSet);
+
+    for(int rowIndex = 0; rowIndex < cTileSetSize_Tiles.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < cTileSetSize_Tiles.X; columnIndex++)
+        {
+            WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(firstTileId + rowIndex * cTileSetSize_Tiles.X + columnIndex));
+        }
+    }
+}
+
+// Some tiles scattered around to draw over the map, so there's something to see in the layer above it.
+// Every third tile on a diagonal gets a tile from the other side of the tileset, and every other one of those is animated,
+// everything else is left empty. It has to be the same size as the map it goes over.
+void DEMO_BuildDecorationLayer(TileMap_t& tileMap, const IntVec2_t& mapSize_Tiles, const TileSource_t& tileSet)
+{
+    tileMap = TileMap_t();
+    tileMap.Size_Tiles = mapSize_Tiles;
+
+    const TileId_t firstTileId = AddTileSetTiles(tileMap, tileSet);
+    const int tileSetTileCount = cTileSetSize_Tiles.X * cTileSetSize_Tiles.Y;
+
+    // a quick one that walks along the top row of the tileset, and a slow one that blinks between two corners of it
+    TileAnimationFrame_t quickFrames[4];
+
+    for(int frameIndex = 0; frameIndex < 4; frameIndex++)
+    {
+        quickFrames[frameIndex].Source = {tileSet.Page, {tileSet.Rect.x + frameIndex * cGridSize_px, tileSet.Rect.y, cGridSize_px, cGridSize_px}};
+        quickFrames[frameIndex].Duration_ms = 150;
+    }
+
+    const TileAnimationFrame_t slowFrames[2] = {
+        {{tileSet.Page, {tileSet.Rect.x, tileSet.Rect.y, cGridSize_px, cGridSize_px}}, 600},
+        {{tileSet.Page, {tileSet.Rect.x + tileSet.Rect.w - cGridSize_px, tileSet.Rect.y + tileSet.Rect.h - cGridSize_px, cGridSize_px, cGridSize_px}}, 400},
+    };
+
+    const TileId_t animatedTileIds[2] = {AddTileAnimation(tileMap, quickFrames, 4), AddTileAnimation(tileMap, slowFrames, 2)};
+
+    for(int rowIndex = 0; rowIndex < mapSize_Tiles.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < mapSize_Tiles.X; columnIndex++)
+        {
+            if((columnIndex + rowIndex) % 3 != 0)
+            {
+                continue;
+            }
+
+            if(columnIndex % 2 == 0)
+            {
+                WriteTile(tileMap, {columnIndex, rowIndex}, animatedTileIds[(rowIndex / 3) % 2]);
+            }
+            else
+            {
+                const int mirroredTile = tileSetTileCount - 1 - (rowIndex * cTileSetSize_Tiles.X + columnIndex) % tileSetTileCount;
+
+                WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(firstTileId + mirroredTile));
+            }
+        }
+    }
+}
+
+// Makes tileMap a file backed map of the map file at path, for "WindowMapIntersect map.wmimap". If there's no file there yet
+// the demo map is saved to it first, so there's something to open (and to edit with other tools for next time).
+// Returns false if the file couldn't be written or opened, OpenTileMapFile says why.
+bool DEMO_OpenTileMap(TileMap_t& tileMap, const char* path, const TileSource_t& tileSet)
+{
+    FILE* file = fopen(path, "rb");
+
+    if(file != nullptr)
+    {
+        fclose(file);
+    }
+    else
+    {
+        TileMap_t demoTileMap;
+        DEMO_BuildTileMap(demoTileMap, tileSet);
+
+        if(!SaveTileMapFile(demoTileMap, path))
+        {
+            return false;
+        }
+
+        printf("Saved the demo map to '%s'\n", path);
+    }
+
+    return OpenTileMapFile(tileMap, path);
+}
+
+//--------------------------------------------------------------------------------------
+// Tile batching functions
+//--------------------------------------------------------------------------------------
+
+static void ClearTileBatch(TileBatch_t& batch)
+{
+    // clear() keeps the capacity, so after the first frame there's no more allocating
+    batch.Draws.clear();
+}
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+// Fills in the 4 corners of a quad that copies src (in texture px, uScale and vScale being 1 / the texture's size) to dst
+static inline void SetQuadVertices(SDL_Vertex* corners, const SDL_Rect& src, const SDL_Rect& dst, float uScale, float vScale)
+{
+    const SDL_Color white = {255, 255, 255, 255};
+
+    // corners in the order NW, NE, SE, SW
+    corners[0].position = {(float)dst.x,             (float)dst.y};
+    corners[1].position = {(float)(dst.x + dst.w),   (float)dst.y};
+    corners[2].position = {(float)(dst.x + dst.w),   (float)(dst.y + dst.h)};
+    corners[3].position = {(float)dst.x,             (float)(dst.y + dst.h)};
+
+    corners[0].tex_coord = {src.x * uScale,             src.y * vScale};
+    corners[1].tex_coord = {(src.x + src.w) * uScale,   src.y * vScale};
+    corners[2].tex_coord = {(src.x + src.w) * uScale,   (src.y + src.h) * vScale};
+    corners[3].tex_coord = {src.x * uScale,             (src.y + src.h) * vScale};
+
+    for(int cornerIndex = 0; cornerIndex < 4; cornerIndex++)
+    {
+        corners[cornerIndex].color = white;
+    }
+}
+#endif
+
+// Draws every tile in the batch to the current render target. The caller is responsible for binding the render target,
+// that way it only has to happen once per map render texture instead of once per tile.
+//
+// The tiles go out a tile atlas page at a time, so that's one SDL_RenderGeometry call per page the batch uses,
+// which is just the one when all of the map's tilesets fit on a page.
+//
+// For a mip level other than 0 the tiles come from the atlas's MipPages, and the batch has to have been through ShrinkTileBatch.
+static void SubmitTileBatch(TileBatch_t& batch, const TileAtlas_t& tileAtlas, int mipLevel = 0)
+{
+    if(batch.Draws.empty())
+    {
+        return;
+    }
+
+    FrameProfiler.Current.TilesDrawn += (int)batch.Draws.size();
+
+    const int drawCount = (int)batch.Draws.size();
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    batch.Vertices.resize(drawCount * 4);
+    batch.Indices.resize(drawCount * 6);
+#endif
+
+    for(int page = 0; page < (int)tileAtlas.Pages.size(); page++)
+    {
+        SDL_Texture* pageTexture = (mipLevel == 0) ? tileAtlas.Pages[page] : tileAtlas.MipPages[mipLevel - 1][page];
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        // every tile is a quad made of two triangles, all of this page's quads go to the GPU in one SDL_RenderGeometry call
+        const IntVec2_t pageSize = InquireTextureSize(pageTexture);
+        const float uScale = 1.0f / pageSize.X;
+        const float vScale = 1.0f / pageSize.Y;
+
+        int quadCount = 0;
+
+        for(int drawIndex = 0; drawIndex < drawCount; drawIndex++)
+        {
+            if(batch.Draws[drawIndex].Page != page)
+            {
+                continue;
+            }
+
+            SetQuadVertices(&batch.Vertices[quadCount * 4], batch.Draws[drawIndex].Source, batch.Draws[drawIndex].Dest, uScale, vScale);
+
+            const int firstVertex = quadCount * 4;
+            int* indices = &batch.Indices[quadCount * 6];
+
+            indices[0] = firstVertex + 0;
+            indices[1] = firstVertex + 1;
+            indices[2] = firstVertex + 2;
+
+            indices[3] = firstVertex + 0;
+            indices[4] = firstVertex + 2;
+            indices[5] = firstVertex + 3;
+
+            quadCount++;
+        }
+
+        if(quadCount == 0)
+        {
+            continue;
+        }
+
+        SDL_RenderGeometry(SDLGlobals.Renderer, pageTexture, batch.Vertices.data(), quadCount * 4, batch.Indices.data(), quadCount * 6);
+        FrameProfiler.Current.RenderCopies++;
+#else
+        // older SDL doesn't have SDL_RenderGeometry, but the render target is still only bound once and
+        // SDL's own render batching can merge these copies, since they all come from the same texture.
+        for(const TileDraw_t& draw : batch.Draws)
+        {
+            if(draw.Page == page)
+            {
+                SDL_RenderCopy(SDLGlobals.Renderer, pageTexture, &draw.Source, &draw.Dest);
+                FrameProfiler.Current.RenderCopies++;
+            }
+        }
+#endif
+    }
+}
+
+// Scales every draw in the batch down to mipLevel, both where the tile's drawn and where on the atlas page it comes from
+static void ShrinkTileBatch(TileBatch_t& batch, int mipLevel)
+{
+    for(TileDraw_t& draw : batch.Draws)
+    {
+        draw.Source = {draw.Source.x >> mipLevel, draw.Source.y >> mipLevel, draw.Source.w >> mipLevel, draw.Source.h >> mipLevel};
+        draw.Dest = {draw.Dest.x >> mipLevel, draw.Dest.y >> mipLevel, draw.Dest.w >> mipLevel, draw.Dest.h >> mipLevel};
+    }
+}
+
+// Adds every non-empty tile in area (in map tile coordinates) to the batch.
+//
+// Map tile (x, y) is drawn at slot (WrapIndex(x - destOrigin_Tiles.X, destSize_Tiles.X), WrapIndex(y - destOrigin_Tiles.Y, destSize_Tiles.Y))
+// of the map render texture, which covers both a plain texture (destOrigin_Tiles is the top left tile) and a ring buffer (destOrigin_Tiles is {0, 0}).
+//
+// The area is walked a chunk at a time, and a row at a time within a chunk, so the tile IDs are read in the order they sit in memory.
+// Chunks that were never populated are skipped entirely.
+void BatchTileArea(TileBatch_t& batch, const TileMap_t& tileMap, const SDL_Rect& area, const IntVec2_t& destOrigin_Tiles, const IntVec2_t& destSize_Tiles)
+{
+    if(area.w <= 0 || area.h <= 0)
+    {
+        return;
+    }
+
+    const IntVec2_t firstChunk = ChunkCoordinateForTile({area.x, area.y});
+    const IntVec2_t lastChunk = ChunkCoordinateForTile({area.x + area.w - 1, area.y + area.h - 1});
+
+    for(int chunkRow = firstChunk.Y; chunkRow <= lastChunk.Y; chunkRow++)
+    {
+        for(int chunkColumn = firstChunk.X; chunkColumn <= lastChunk.X; chunkColumn++)
+        {
+            const TileChunk_t* chunk = FindChunk(tileMap, {chunkColumn, chunkRow});
+
+            if(chunk == nullptr)
+            {
+                continue;
+            }
+
+            const IntVec2_t chunkTopLeft_Tiles = {chunkColumn * TILE_CHUNK_SIZE, chunkRow * TILE_CHUNK_SIZE};
+
+            // the part of the area inside this chunk, in map tile coordinates
+            const int firstRow = max(area.y, chunkTopLeft_Tiles.Y);
+            const int lastRow = min(area.y + area.h, chunkTopLeft_Tiles.Y + TILE_CHUNK_SIZE) - 1;
+            const int firstColumn = max(area.x, chunkTopLeft_Tiles.X);
+            const int lastColumn = min(area.x + area.w, chunkTopLeft_Tiles.X + TILE_CHUNK_SIZE) - 1;
+
+            for(int rowIndex = firstRow; rowIndex <= lastRow; rowIndex++)
+            {
+                const TileId_t* chunkRowTiles = &chunk->Tiles[(rowIndex - chunkTopLeft_Tiles.Y) * TILE_CHUNK_SIZE];
+                const int destRow = WrapIndex(rowIndex - destOrigin_Tiles.Y, destSize_Tiles.Y);
+
+                for(int columnIndex = firstColumn; columnIndex <= lastColumn; columnIndex++)
+                {
+                    const TileId_t tileId = chunkRowTiles[columnIndex - chunkTopLeft_Tiles.X];
+
+                    if(tileId == cEmptyTile)
+                    {
+                        continue;
+                    }
+
+                    const TileSource_t& tileSource = tileMap.TileSources[tileId];
+
+                    TileDraw_t draw = {0};
+                    draw.Page = tileSource.Page;
+                    draw.Source = tileSource.Rect;
+
+                    draw.Dest.x = WrapIndex(columnIndex - destOrigin_Tiles.X, destSize_Tiles.X) * cGridSize_px;
+                    draw.Dest.y = destRow * cGridSize_px;
+                    draw.Dest.w = cGridSize_px;
+                    draw.Dest.h = cGridSize_px;
+
+                    // nothing is drawn yet, SubmitTileBatch does that once all of the window's tiles are known
+                    batch.Draws.push_back(draw);
+                }
+            }
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Map render texture ring buffer functions
+//--------------------------------------------------------------------------------------
+
+MapRenderCache_t& GetMapRenderCache(SDL_Texture* mapRenderTexture)
+{
+    auto found = MapRenderCaches.find(mapRenderTexture);
+
+    if(found != MapRenderCaches.end())
+    {
+        return found->second;
+    }
+
+    const IntVec2_t textureSize = InquireTextureSize(mapRenderTexture);
+
+    MapRenderCache_t cache = {0};
+    cache.Valid = false;
+    cache.Capacity_Tiles = {textureSize.X / cGridSize_px, textureSize.Y / cGridSize_px};
+
+    return MapRenderCaches[mapRenderTexture] = cache;
+}
+
+// Marks map tile (x, y) (which has to be in cache.Tiles) to be drawn again the next time the cache's map render texture is drawn.
+// Marking a tile twice still only draws it once, which matters for see through tiles: blended over themselves they'd come out darker.
+static void MarkPendingTile(MapRenderCache_t& cache, int x, int y)
+{
+    if(cache.PendingSlots.empty())
+    {
+        cache.PendingSlots.assign((size_t)cache.Capacity_Tiles.X * cache.Capacity_Tiles.Y, 0);
+    }
+
+    Uint8& pending = cache.PendingSlots[WrapIndex(y, cache.Capacity_Tiles.Y) * cache.Capacity_Tiles.X + WrapIndex(x, cache.Capacity_Tiles.X)];
+
+    if(!pending)
+    {
+        pending = 1;
+        cache.PendingSlotCount++;
+    }
+}
+
+static void ClearPendingSlots(MapRenderCache_t& cache)
+{
+    if(cache.PendingSlotCount > 0)
+    {
+        std::fill(cache.PendingSlots.begin(), cache.PendingSlots.end(), 0);
+        cache.PendingSlotCount = 0;
+    }
+}
+
+// Call this when a map render texture's contents can no longer be trusted (e.g., the map changed, or the texture is being freed)
+void InvalidateMapRenderCache(SDL_Texture* mapRenderTexture)
+{
+    MapRenderCaches.erase(mapRenderTexture);
+}
+
+// Copies an area out of a ring buffered map render texture to the current render target.
+// sourceArea_MapPx is in map pixels, it gets wrapped around the edges of the texture, so this can take up to 4 copies.
+void CopyFromRingTexture(SDL_Texture* ringTexture, const IntVec2_t& ringSize_Tiles, const SDL_Rect& sourceArea_MapPx, const IntVec2_t& destTopLeft)
+{
+    const IntVec2_t ringSize_px = {ringSize_Tiles.X * cGridSize_px, ringSize_Tiles.Y * cGridSize_px};
+
+    assert(sourceArea_MapPx.w <= ringSize_px.X);
+    assert(sourceArea_MapPx.h <= ringSize_px.Y);
+
+    int copiedHeight = 0;
+
+    while(copiedHeight < sourceArea_MapPx.h)
+    {
+        const int ringY = WrapIndex(sourceArea_MapPx.y + copiedHeight, ringSize_px.Y);
+        const int spanHeight = min(sourceArea_MapPx.h - copiedHeight, ringSize_px.Y - ringY);
+
+        int copiedWidth = 0;
+
+        while(copiedWidth < sourceArea_MapPx.w)
+        {
+            const int ringX = WrapIndex(sourceArea_MapPx.x + copiedWidth, ringSize_px.X);
+            const int spanWidth = min(sourceArea_MapPx.w - copiedWidth, ringSize_px.X - ringX);
+
+            const SDL_Rect srcRect = {ringX, ringY, spanWidth, spanHeight};
+            const SDL_Rect destRect = {destTopLeft.X + copiedWidth, destTopLeft.Y + copiedHeight, spanWidth, spanHeight};
+
+            SDL_RenderCopy(SDLGlobals.Renderer, ringTexture, &srcRect, &destRect);
+            FrameProfiler.Current.RenderCopies++;
+
+            copiedWidth += spanWidth;
+        }
+
+        copiedHeight += spanHeight;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Viewport dirty tracking functions
+//--------------------------------------------------------------------------------------
+
+// True if what a viewport sees has changed since its screen render texture was last drawn (or it's never been drawn).
+// A viewport that doesn't need redrawing can just show its screen render texture again.
+bool ViewportNeedsRedraw(const Viewport_t& viewport, const TileMap_t* const* layers, int layerCount)
+{
+    // sprites are drawn again every frame, and once they're gone the screen render texture still has the last ones in it
+    if(viewport.SpriteQueue != nullptr && (!viewport.SpriteQueue->Sprites.empty() || viewport.SpriteQueue->LastDrawnCount != 0))
+    {
+        return true;
+    }
+
+    auto found = ViewportRenderStates.find(viewport.ScreenRenderTexture);
+
+    if(found == ViewportRenderStates.end())
+    {
+        return true;
+    }
+
+    const ViewportRenderState_t& state = found->second;
+
+    if((state.MapRenderTexture != viewport.MapRenderTexture) ||
+       (state.TileAtlas != viewport.TileAtlas) ||
+       (state.LayerCount != layerCount) ||
+       (state.WindowTopLeft_px.X != viewport.WindowTopLeft_px.X) || (state.WindowTopLeft_px.Y != viewport.WindowTopLeft_px.Y) ||
+       (state.WindowSize_Tiles.X != viewport.WindowSize_Tiles.X) || (state.WindowSize_Tiles.Y != viewport.WindowSize_Tiles.Y) ||
+       (state.Zoom != viewport.Zoom))
+    {
+        return true;
+    }
+
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        if((state.Layers[layerIndex] != layers[layerIndex]) || (state.LayerVersions[layerIndex] != layers[layerIndex]->Version))
+        {
+            return true;
+        }
+
+        if(layerIndex > 0 && state.UpperLayerRenderTextures[layerIndex - 1] != viewport.UpperLayerRenderTextures[layerIndex - 1])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool AnyViewportNeedsRedraw(const Viewport_t* viewports, int viewportCount, const TileMap_t* const* layers, int layerCount)
+{
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        if(ViewportNeedsRedraw(viewports[viewportIndex], layers, layerCount))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Call this once a viewport's screen render texture has been drawn
+static void RememberViewportRender(const Viewport_t& viewport, const TileMap_t* const* layers, int layerCount)
+{
+    ViewportRenderState_t& state = ViewportRenderStates[viewport.ScreenRenderTexture];
+
+    state.MapRenderTexture = viewport.MapRenderTexture;
+    state.TileAtlas = viewport.TileAtlas;
+    state.LayerCount = layerCount;
+
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        state.Layers[layerIndex] = layers[layerIndex];
+        state.LayerVersions[layerIndex] = layers[layerIndex]->Version;
+
+        if(layerIndex > 0)
+        {
+            state.UpperLayerRenderTextures[layerIndex - 1] = viewport.UpperLayerRenderTextures[layerIndex - 1];
+        }
+    }
+
+    state.WindowTopLeft_px = viewport.WindowTopLeft_px;
+    state.WindowSize_Tiles = viewport.WindowSize_Tiles;
+    state.Zoom = viewport.Zoom;
+}
+
+// Call this when a screen render texture's contents can no longer be trusted, the next viewport that uses it gets redrawn
+void InvalidateViewportRender(SDL_Texture* screenRenderTexture)
+{
+    ViewportRenderStates.erase(screenRenderTexture);
+}
+
+//--------------------------------------------------------------------------------------
+// Render target pool functions
+//--------------------------------------------------------------------------------------
+
+// smallest power of 2 that's >= value (and >= cMinRenderTargetSize_px)
+static inline int RenderTargetSizeClass(int value)
+{
+    int sizeClass = cMinRenderTargetSize_px;
+
+    while(sizeClass < value)
+    {
+        sizeClass *= 2;
+    }
+
+    return sizeClass;
+}
+
+static inline Uint64 RenderTargetClassKey(Uint32 format, const IntVec2_t& sizeClass_px)
+{
+    return ((Uint64)format << 32) | ((Uint64)(Uint16)sizeClass_px.X << 16) | (Uint64)(Uint16)sizeClass_px.Y;
+}
+
+static void DestroyPooledRenderTarget(RenderTargetPool_t& pool, SDL_Texture* texture)
+{
+    auto found = pool.Targets.find(texture);
+    assert(found != pool.Targets.end() && !found->second.InUse);
+
+    std::vector<SDL_Texture*>& freeTargets = pool.FreeTargets[RenderTargetClassKey(found->second.Format, found->second.Size_px)];
+
+    for(size_t freeIndex = 0; freeIndex < freeTargets.size(); freeIndex++)
+    {
+        if(freeTargets[freeIndex] == texture)
+        {
+            freeTargets[freeIndex] = freeTargets.back();
+            freeTargets.pop_back();
+            break;
+        }
+    }
+
+    pool.BytesAllocated -= found->second.Bytes;
+    pool.Targets.erase(found);
+
+    InvalidateMapRenderCache(texture);
+    SDL_DestroyTexture(texture);
+}
+
+// Destroys unused textures, longest unused first, until there's room for neededBytes more. Returns false if there isn't enough unused to make room.
+static bool MakeRoomInRenderTargetPool(RenderTargetPool_t& pool, size_t neededBytes)
+{
+    while(pool.BytesAllocated + neededBytes > pool.MaxBytes)
+    {
+        SDL_Texture* oldest = nullptr;
+        Uint64 oldestReleaseOrder = 0;
+
+        for(const auto& target : pool.Targets)
+        {
+            if(!target.second.InUse && (oldest == nullptr || target.second.ReleaseOrder < oldestReleaseOrder))
+            {
+                oldest = target.first;
+                oldestReleaseOrder = target.second.ReleaseOrder;
+            }
+        }
+
+        if(oldest == nullptr)
+        {
+            return false;
+        }
+
+        DestroyPooledRenderTarget(pool, oldest);
+    }
+
+    return true;
+}
+
+// Returns a render target texture at least size_px big, recycling one if there's a free one in the same size class.
+// Returns nullptr if it would take the pool past MaxBytes, or SDL couldn't create the texture.
+//
+// The contents are whatever the last user left in it.
+SDL_Texture* AcquireRenderTarget(RenderTargetPool_t& pool, const IntVec2_t& size_px, Uint32 format = SDL_PIXELFORMAT_RGBA8888)
+{
+    const IntVec2_t sizeClass_px = {RenderTargetSizeClass(size_px.X), RenderTargetSizeClass(size_px.Y)};
+
+    std::vector<SDL_Texture*>& freeTargets = pool.FreeTargets[RenderTargetClassKey(format, sizeClass_px)];
+
+    if(!freeTargets.empty())
+    {
+        SDL_Texture* texture = freeTargets.back();
+        freeTargets.pop_back();
+
+        pool.Targets[texture].InUse = true;
+        pool.Reused++;
+
+        return texture;
+    }
+
+    const size_t bytes = (size_t)sizeClass_px.X * sizeClass_px.Y * SDL_BYTESPERPIXEL(format);
+
+    if(!MakeRoomInRenderTargetPool(pool, bytes))
+    {
+        printf("Render target pool is full (%zu of %zu bytes in use), can't fit a %dx%d texture\n", pool.BytesAllocated, pool.MaxBytes, sizeClass_px.X, sizeClass_px.Y);
+        return nullptr;
+    }
+
+    SDL_Texture* texture = SDL_CreateTexture(SDLGlobals.Renderer, format, SDL_TEXTUREACCESS_TARGET, sizeClass_px.X, sizeClass_px.Y);
+
+    if(texture == nullptr)
+    {
+        printf("An error occured while trying to create a %dx%d render target: %s\n", sizeClass_px.X, sizeClass_px.Y, SDL_GetError());
+        return nullptr;
+    }
+
+    PooledRenderTarget_t target = {0};
+    target.Format = format;
+    target.Size_px = sizeClass_px;
+    target.Bytes = bytes;
+    target.InUse = true;
+
+    pool.Targets[texture] = target;
+    pool.BytesAllocated += bytes;
+    pool.Created++;
+
+    return texture;
+}
+
+// Hands a texture back to the pool for someone else to use, it isn't destroyed. nullptr is ignored.
+void ReleaseRenderTarget(RenderTargetPool_t& pool, SDL_Texture* texture)
+{
+    if(texture == nullptr)
+    {
+        return;
+    }
+
+    auto found = pool.Targets.find(texture);
+    assert(found != pool.Targets.end() && found->second.InUse);
+
+    // the next user will draw something else in it
+    InvalidateMapRenderCache(texture);
+    InvalidateViewportRender(texture);
+
+    found->second.InUse = false;
+    found->second.ReleaseOrder = ++pool.ReleaseCount;
+
+    pool.FreeTargets[RenderTargetClassKey(found->second.Format, found->second.Size_px)].push_back(texture);
+}
+
+// Destroys every texture that isn't in use
+void TrimRenderTargetPool(RenderTargetPool_t& pool)
+{
+    // making room for a whole pool's worth throws out everything it can
+    MakeRoomInRenderTargetPool(pool, pool.MaxBytes);
+}
+
+// Destroys every texture, everything should have been released by now
+void DestroyRenderTargetPool(RenderTargetPool_t& pool)
+{
+    for(auto& target : pool.Targets)
+    {
+        assert(!target.second.InUse);
+        target.second.InUse = false;
+    }
+
+    TrimRenderTargetPool(pool);
+
+    assert(pool.Targets.empty() && pool.BytesAllocated == 0);
+    pool.FreeTargets.clear();
+}
+
+//--------------------------------------------------------------------------------------
+// Tile rendering functions
+//--------------------------------------------------------------------------------------
+
+static inline void CheckArea(const SDL_Rect& offset, const IntVec2_t& windowSize)
+{
+    assert(offset.x >= 0);
+    assert(offset.y >= 0);
+    assert(offset.w >= 0);
+    assert(offset.h >= 0);
+
+    assert(offset.x < windowSize.X);
+    assert(offset.y < windowSize.Y);
+    assert(offset.w <= windowSize.X);
+    assert(offset.h <= windowSize.Y);
+
+}
+
+// You really need to see this drawn out on a sheet of paper to best understand this to be honest
+// see scanned png hand written pages in this folder.
+//
+// Returns a value that represents the window's positioning; This value tells you if the window hangs off the corner of the map, the sides, or neither.
+WindowIntersectType_t GetWindowIntersectType(const IntVec2_t& mapSize_px, const IntVec2_t& windowNorthWestCorner, const IntVec2_t& windowSize_px)
+{
+    const IntVec2_t windowNorthEastCorner = {windowNorthWestCorner.X + windowSize_px.X, windowNorthWestCorner.Y + 0};
+    const IntVec2_t windowSouthWestCorner = {windowNorthWestCorner.X + 0,               windowNorthWestCorner.Y + windowSize_px.Y};
+    const IntVec2_t windowSouthEastCorner = {windowNorthWestCorner.X + windowSize_px.X, windowNorthWestCorner.Y + windowSize_px.Y};
+
+    const IntVec2_t mapTopLeft = {0, 0};
+
+    const bool northWestCornerIn = PointInRect(windowNorthWestCorner, mapTopLeft, mapSize_px);
+    const bool northEastCornerIn = PointInRect(windowNorthEastCorner, mapTopLeft, mapSize_px);
+    const bool southWestCornerIn = PointInRect(windowSouthWestCorner, mapTopLeft, mapSize_px);
+    const bool southEastCornerIn = PointInRect(windowSouthEastCorner, mapTopLeft, mapSize_px);
+    
+
+    if(northWestCornerIn && northEastCornerIn && southWestCornerIn && southEastCornerIn)
+    {
+        return WindowIntersectType_t::TotallyIn;
+    }
+
+    if(!northWestCornerIn && !northEastCornerIn && !southWestCornerIn && !southEastCornerIn)
+    {
+        return WindowIntersectType_t::TotallyOut;
+    }
+
+    if(southWestCornerIn && southEastCornerIn)
+    {
+        return WindowIntersectType_t::North;
+    }
+    else if(northWestCornerIn && southWestCornerIn)
+    {
+        return WindowIntersectType_t::East;
+    }
+    else if(northWestCornerIn && northEastCornerIn)
+    {
+        return WindowIntersectType_t::South;
+    }
+    else if(northEastCornerIn && southEastCornerIn)
+    {
+        return WindowIntersectType_t::West;
+    }
+    else if(southEastCornerIn)
+    {
+        return WindowIntersectType_t::NorthWest;
+    }
+    else if(southWestCornerIn)
+    {
+        return WindowIntersectType_t::NorthEast;
+    }
+    else if(northWestCornerIn)
+    {
+        return WindowIntersectType_t::SouthEast;
+    }
+    else if(northEastCornerIn)
+    {
+        return WindowIntersectType_t::SouthWest;
+    } 
+    else
+    {
+        assert(0);
+        throw std::logic_error("Impossible intersect type detected.");
+    }
+
+}
+
+// Bits for which of a window's corners are in the map, see GetCornerMask
+enum CornerBits_t
+{
+    cNorthWestCornerBit = 1,
+    cNorthEastCornerBit = 2,
+    cSouthWestCornerBit = 4,
+    cSouthEastCornerBit = 8
+};
+
+// The same decisions GetWindowIntersectType makes, but starting from the 4 corner bits instead of the 4 bools
+constexpr WindowIntersectType_t ClassifyCornerMask(int cornerMask)
+{
+    const bool northWestCornerIn = (cornerMask & cNorthWestCornerBit) != 0;
+    const bool northEastCornerIn = (cornerMask & cNorthEastCornerBit) != 0;
+    const bool southWestCornerIn = (cornerMask & cSouthWestCornerBit) != 0;
+    const bool southEastCornerIn = (cornerMask & cSouthEastCornerBit) != 0;
+
+    return (northWestCornerIn && northEastCornerIn && southWestCornerIn && southEastCornerIn) ? WindowIntersectType_t::TotallyIn :
+           (!northWestCornerIn && !northEastCornerIn && !southWestCornerIn && !southEastCornerIn) ? WindowIntersectType_t::TotallyOut :
+           (southWestCornerIn && southEastCornerIn) ? WindowIntersectType_t::North :
+           (northWestCornerIn && southWestCornerIn) ? WindowIntersectType_t::East :
+           (northWestCornerIn && northEastCornerIn) ? WindowIntersectType_t::South :
+           (northEastCornerIn && southEastCornerIn) ? WindowIntersectType_t::West :
+           (southEastCornerIn) ? WindowIntersectType_t::NorthWest :
+           (southWestCornerIn) ? WindowIntersectType_t::NorthEast :
+           (northWestCornerIn) ? WindowIntersectType_t::SouthEast :
+                                 WindowIntersectType_t::SouthWest;
+}
+
+// corner mask -> intersect type. Every mask has an answer, even the ones a rectangle can't produce (like only the NW and SE corners being in).
+static const WindowIntersectType_t cIntersectTypeForCornerMask[16] =
+{
+    ClassifyCornerMask(0),  ClassifyCornerMask(1),  ClassifyCornerMask(2),  ClassifyCornerMask(3),
+    ClassifyCornerMask(4),  ClassifyCornerMask(5),  ClassifyCornerMask(6),  ClassifyCornerMask(7),
+    ClassifyCornerMask(8),  ClassifyCornerMask(9),  ClassifyCornerMask(10), ClassifyCornerMask(11),
+    ClassifyCornerMask(12), ClassifyCornerMask(13), ClassifyCornerMask(14), ClassifyCornerMask(15)
+};
+
+static_assert(ClassifyCornerMask(cSouthEastCornerBit) == WindowIntersectType_t::NorthWest, "a window hanging off the northwest corner only has its SE corner in the map");
+static_assert(ClassifyCornerMask(cNorthWestCornerBit | cSouthWestCornerBit) == WindowIntersectType_t::East, "a window hanging off the east wall only has its west corners in the map");
+
+// Which corners of the window are in the map, same test as PointInRect
+static inline int GetCornerMask(const IntVec2_t& mapSize_px, const IntVec2_t& windowNorthWestCorner, const IntVec2_t& windowSize_px)
+{
+    const int east = windowNorthWestCorner.X + windowSize_px.X;
+    const int south = windowNorthWestCorner.Y + windowSize_px.Y;
+
+    const bool westIn = (windowNorthWestCorner.X >= 0) && (windowNorthWestCorner.X < mapSize_px.X);
+    const bool eastIn = (east >= 0) && (east < mapSize_px.X);
+    const bool northIn = (windowNorthWestCorner.Y >= 0) && (windowNorthWestCorner.Y < mapSize_px.Y);
+    const bool southIn = (south >= 0) && (south < mapSize_px.Y);
+
+    return (westIn && northIn ? cNorthWestCornerBit : 0) |
+           (eastIn && northIn ? cNorthEastCornerBit : 0) |
+           (westIn && southIn ? cSouthWestCornerBit : 0) |
+           (eastIn && southIn ? cSouthEastCornerBit : 0);
+}
+
+static void ClassifyWindowIntersectTypes_Scalar(const IntVec2_t& mapSize_px, const IntVec2_t* windowNorthWestCorners, const IntVec2_t* windowSizes_px, int windowCount, WindowIntersectType_t* intersectTypes)
+{
+    for(int windowIndex = 0; windowIndex < windowCount; windowIndex++)
+    {
+        const int cornerMask = GetCornerMask(mapSize_px, windowNorthWestCorners[windowIndex], windowSizes_px[windowIndex]);
+
+        intersectTypes[windowIndex] = cIntersectTypeForCornerMask[cornerMask];
+    }
+}
+
+#ifdef HAVE_SSE2
+
+// 4 windows at a time. Returns how many windows it handled, the rest are left for the scalar version.
+static int ClassifyWindowIntersectTypes_SSE2(const IntVec2_t& mapSize_px, const IntVec2_t* windowNorthWestCorners, const IntVec2_t* windowSizes_px, int windowCount, WindowIntersectType_t* intersectTypes)
+{
+    const __m128i minusOne = _mm_set1_epi32(-1);
+    const __m128i mapWidth = _mm_set1_epi32(mapSize_px.X);
+    const __m128i mapHeight = _mm_set1_epi32(mapSize_px.Y);
+
+    const __m128i northWestBit = _mm_set1_epi32(cNorthWestCornerBit);
+    const __m128i northEastBit = _mm_set1_epi32(cNorthEastCornerBit);
+    const __m128i southWestBit = _mm_set1_epi32(cSouthWestCornerBit);
+    const __m128i southEastBit = _mm_set1_epi32(cSouthEastCornerBit);
+
+    alignas(16) int cornerMasks[4];
+
+    int windowIndex = 0;
+
+    for(; windowIndex + 4 <= windowCount; windowIndex += 4)
+    {
+        // IntVec2_t is {X, Y}, so 4 of them load as x0 y0 x1 y1 | x2 y2 x3 y3; split those into xs and ys
+        const __m128 cornersLow = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&windowNorthWestCorners[windowIndex]));
+        const __m128 cornersHigh = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&windowNorthWestCorners[windowIndex + 2]));
+        const __m128 sizesLow = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&windowSizes_px[windowIndex]));
+        const __m128 sizesHigh = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&windowSizes_px[windowIndex + 2]));
+
+        const __m128i west = _mm_castps_si128(_mm_shuffle_ps(cornersLow, cornersHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i north = _mm_castps_si128(_mm_shuffle_ps(cornersLow, cornersHigh, _MM_SHUFFLE(3, 1, 3, 1)));
+        const __m128i width = _mm_castps_si128(_mm_shuffle_ps(sizesLow, sizesHigh, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i height = _mm_castps_si128(_mm_shuffle_ps(sizesLow, sizesHigh, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        const __m128i east = _mm_add_epi32(west, width);
+        const __m128i south = _mm_add_epi32(north, height);
+
+        // x >= 0 is the same as x > -1
+        const __m128i westIn = _mm_and_si128(_mm_cmpgt_epi32(west, minusOne), _mm_cmplt_epi32(west, mapWidth));
+        const __m128i eastIn = _mm_and_si128(_mm_cmpgt_epi32(east, minusOne), _mm_cmplt_epi32(east, mapWidth));
+        const __m128i northIn = _mm_and_si128(_mm_cmpgt_epi32(north, minusOne), _mm_cmplt_epi32(north, mapHeight));
+        const __m128i southIn = _mm_and_si128(_mm_cmpgt_epi32(south, minusOne), _mm_cmplt_epi32(south, mapHeight));
+
+        __m128i cornerMask = _mm_and_si128(_mm_and_si128(westIn, northIn), northWestBit);
+        cornerMask = _mm_or_si128(cornerMask, _mm_and_si128(_mm_and_si128(eastIn, northIn), northEastBit));
+        cornerMask = _mm_or_si128(cornerMask, _mm_and_si128(_mm_and_si128(westIn, southIn), southWestBit));
+        cornerMask = _mm_or_si128(cornerMask, _mm_and_si128(_mm_and_si128(eastIn, southIn), southEastBit));
+
+        _mm_store_si128((__m128i*)cornerMasks, cornerMask);
+
+        intersectTypes[windowIndex + 0] = cIntersectTypeForCornerMask[cornerMasks[0]];
+        intersectTypes[windowIndex + 1] = cIntersectTypeForCornerMask[cornerMasks[1]];
+        intersectTypes[windowIndex + 2] = cIntersectTypeForCornerMask[cornerMasks[2]];
+        intersectTypes[windowIndex + 3] = cIntersectTypeForCornerMask[cornerMasks[3]];
+    }
+
+    return windowIndex;
+}
+
+// 8 windows at a time. Returns how many windows it handled, the rest are left for the SSE2 / scalar versions.
+TARGET_AVX2 static int ClassifyWindowIntersectTypes_AVX2(const IntVec2_t& mapSize_px, const IntVec2_t* windowNorthWestCorners, const IntVec2_t* windowSizes_px, int windowCount, WindowIntersectType_t* intersectTypes)
+{
+    const __m256i minusOne = _mm256_set1_epi32(-1);
+    const __m256i mapWidth = _mm256_set1_epi32(mapSize_px.X);
+    const __m256i mapHeight = _mm256_set1_epi32(mapSize_px.Y);
+
+    const __m256i northWestBit = _mm256_set1_epi32(cNorthWestCornerBit);
+    const __m256i northEastBit = _mm256_set1_epi32(cNorthEastCornerBit);
+    const __m256i southWestBit = _mm256_set1_epi32(cSouthWestCornerBit);
+    const __m256i southEastBit = _mm256_set1_epi32(cSouthEastCornerBit);
+
+    alignas(32) int cornerMasks[8];
+
+    int windowIndex = 0;
+
+    for(; windowIndex + 8 <= windowCount; windowIndex += 8)
+    {
+        const __m256 cornersLow = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&windowNorthWestCorners[windowIndex]));
+        const __m256 cornersHigh = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&windowNorthWestCorners[windowIndex + 4]));
+        const __m256 sizesLow = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&windowSizes_px[windowIndex]));
+        const __m256 sizesHigh = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&windowSizes_px[windowIndex + 4]));
+
+        // the shuffle works within each 128 bit half, which leaves the windows in the order 0 1 4 5 2 3 6 7.
+        // That order doesn't matter for the math, the permute at the end of each line puts them back in order.
+        const __m256i west = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(cornersLow, cornersHigh, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i north = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(cornersLow, cornersHigh, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i width = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(sizesLow, sizesHigh, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+        const __m256i height = _mm256_permute4x64_epi64(_mm256_castps_si256(_mm256_shuffle_ps(sizesLow, sizesHigh, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+
+        const __m256i east = _mm256_add_epi32(west, width);
+        const __m256i south = _mm256_add_epi32(north, height);
+
+        // AVX2 only has a greater than compare, so x < map is map > x
+        const __m256i westIn = _mm256_and_si256(_mm256_cmpgt_epi32(west, minusOne), _mm256_cmpgt_epi32(mapWidth, west));
+        const __m256i eastIn = _mm256_and_si256(_mm256_cmpgt_epi32(east, minusOne), _mm256_cmpgt_epi32(mapWidth, east));
+        const __m256i northIn = _mm256_and_si256(_mm256_cmpgt_epi32(north, minusOne), _mm256_cmpgt_epi32(mapHeight, north));
+        const __m256i southIn = _mm256_and_si256(_mm256_cmpgt_epi32(south, minusOne), _mm256_cmpgt_epi32(mapHeight, south));
+
+        __m256i cornerMask = _mm256_and_si256(_mm256_and_si256(westIn, northIn), northWestBit);
+        cornerMask = _mm256_or_si256(cornerMask, _mm256_and_si256(_mm256_and_si256(eastIn, northIn), northEastBit));
+        cornerMask = _mm256_or_si256(cornerMask, _mm256_and_si256(_mm256_and_si256(westIn, southIn), southWestBit));
+        cornerMask = _mm256_or_si256(cornerMask, _mm256_and_si256(_mm256_and_si256(eastIn, southIn), southEastBit));
+
+        _mm256_store_si256((__m256i*)cornerMasks, cornerMask);
+
+        for(int lane = 0; lane < 8; lane++)
+        {
+            intersectTypes[windowIndex + lane] = cIntersectTypeForCornerMask[cornerMasks[lane]];
+        }
+    }
+
+    return windowIndex;
+}
+
+#endif
+
+// Same as calling GetWindowIntersectType for each window, but done in bulk with SIMD compares where the CPU supports it.
+// windowNorthWestCorners, windowSizes_px and intersectTypes all hold windowCount entries.
+void ClassifyWindowIntersectTypes(const IntVec2_t& mapSize_px, const IntVec2_t* windowNorthWestCorners, const IntVec2_t* windowSizes_px, int windowCount, WindowIntersectType_t* intersectTypes)
+{
+    int classified = 0;
+
+#ifdef HAVE_SSE2
+    static const bool hasAVX2 = (SDL_HasAVX2() == SDL_TRUE);
+
+    if(hasAVX2)
+    {
+        classified += ClassifyWindowIntersectTypes_AVX2(mapSize_px, windowNorthWestCorners, windowSizes_px, windowCount, intersectTypes);
+    }
+
+    classified += ClassifyWindowIntersectTypes_SSE2(mapSize_px, windowNorthWestCorners + classified, windowSizes_px + classified, windowCount - classified, intersectTypes + classified);
+#endif
+
+    ClassifyWindowIntersectTypes_Scalar(mapSize_px, windowNorthWestCorners + classified, windowSizes_px + classified, windowCount - classified, intersectTypes + classified);
+}
+
+// See scanned png hand written pages in this folder.
+// Returns a rectangle (top left corner in map coordinates) containing the dimensions of the map to copy into the window.
+SDL_Rect GetMapRenderRectangle(const IntVec2_t& mapSize_px, const IntVec2_t& windowNorthWestCorner_px, const IntVec2_t& windowSize_px)
+{
+
+    WindowIntersectType_t intersectType = GetWindowIntersectType(mapSize_px, windowNorthWestCorner_px, windowSize_px);
+
+    if(intersectType == WindowIntersectType_t::TotallyOut)
+    {
+        // nothing to draw from the map
+        return {0,0,0,0};
+    }
+
+    if(intersectType == WindowIntersectType_t::TotallyIn)
+    {
+        SDL_Rect mapRenderRect{0};
+        mapRenderRect.x = windowNorthWestCorner_px.X;
+        mapRenderRect.y = windowNorthWestCorner_px.Y;
+
+        mapRenderRect.w = windowSize_px.X;
+        mapRenderRect.h = windowSize_px.Y;
+
+        return mapRenderRect;
+    }
+
+    // abbreviations
+    const IntVec2_t& winP   = windowNorthWestCorner_px; 
+    const IntVec2_t& winSiz = windowSize_px;
+    const IntVec2_t& mSiz   = mapSize_px;
+
+    const int northHeight   = winP.Y + winSiz.Y;
+    const int southHeight   = mSiz.Y - winP.Y;
+
+    const int westWidth     = winP.X + winSiz.X;
+    const int eastWidth     = mSiz.X - winP.X;
+
+    switch(intersectType)
+    {
+        case WindowIntersectType_t::NorthWest:
+        {
+            SDL_Rect mapRenderRect{0};    
+            mapRenderRect.x = 0;
+            mapRenderRect.y = 0;
+
+            mapRenderRect.w = westWidth;
+            mapRenderRect.h = northHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::North:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = winP.X;
+            mapRenderRect.y = 0;
+
+            mapRenderRect.w = winSiz.X;
+            mapRenderRect.h = northHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::NorthEast:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = winP.X;
+            mapRenderRect.y = 0;
+
+            mapRenderRect.w = eastWidth;
+            mapRenderRect.h = northHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::East:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = winP.X;
+            mapRenderRect.y = winP.Y;
+
+            mapRenderRect.w = eastWidth;
+            mapRenderRect.h = winSiz.Y;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::SouthEast:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = winP.X;
+            mapRenderRect.y = winP.Y;
+
+            mapRenderRect.w = eastWidth;
+            mapRenderRect.h = southHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::South:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = winP.X;
+            mapRenderRect.y = winP.Y;
+
+            mapRenderRect.w = winSiz.X;
+            mapRenderRect.h = southHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::SouthWest:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = 0;
+            mapRenderRect.y = winP.Y;
+
+            mapRenderRect.w = westWidth;
+            mapRenderRect.h = southHeight;
+
+            return mapRenderRect;
+        }
+
+        case WindowIntersectType_t::West:
+        {
+            SDL_Rect mapRenderRect{0};
+            mapRenderRect.x = 0;
+            mapRenderRect.y = winP.Y;
+
+            mapRenderRect.w = westWidth;
+            mapRenderRect.h = winSiz.Y;
+
+            return mapRenderRect;
+        }
+
+        default:
+        {
+            assert(0);
+            throw std::logic_error("Impossible intersect type dected.");
+        }
+    }
+    
+
+}
+
+// Returns the tiles (in map tile coordinates) that have to be rendered for a window whose northwest corner is in topLeftTile,
+// clipped to the map. One extra tile to the east and south is always included, because a window that isn't lined up with
+// the grid hangs partway into it.
+//
+// The width and height are both 0 if none of the map is visible.
+SDL_Rect GetTileRangeToRender(const IntVec2_t& topLeftTile, const IntVec2_t& windowSize_Tiles, const IntVec2_t& mapSize_Tiles)
+{
+    const int minWest = max(0, topLeftTile.X);
+    const int minNorth = max(0, topLeftTile.Y);
+
+    const int maxEast = min(mapSize_Tiles.X - 1, topLeftTile.X + windowSize_Tiles.X);
+    const int maxSouth = min(mapSize_Tiles.Y - 1, topLeftTile.Y + windowSize_Tiles.Y);
+
+    SDL_Rect range = {0};
+    range.x = minWest;
+    range.y = minNorth;
+    range.w = max(0, maxEast - minWest + 1);
+    range.h = max(0, maxSouth - minNorth + 1);
+
+    if(range.w == 0 || range.h == 0)
+    {
+        range.w = 0;
+        range.h = 0;
+    }
+
+    return range;
+}
+
+// DrawTiles for any grid and window size. See DrawTilesAtOrigin.
+static SDL_Rect DrawTiles_Generic(TileBatch_t& batch, const TileMap_t& tileMap, const IntVec2_t& topLeftTile, const IntVec2_t& windowSize_Tiles, const IntVec2_t& destOrigin_Tiles, const IntVec2_t& destSize_Tiles)
+{
+    const SDL_Rect tileRange = GetTileRangeToRender(topLeftTile, windowSize_Tiles, tileMap.Size_Tiles);
+
+    BatchTileArea(batch, tileMap, tileRange, destOrigin_Tiles, destSize_Tiles);
+
+    SDL_Rect resultRect = {0};
+    resultRect.w = tileRange.w * cGridSize_px;
+    resultRect.h = tileRange.h * cGridSize_px;
+    resultRect.x = tileRange.x * cGridSize_px;
+    resultRect.y = tileRange.y * cGridSize_px;
+
+    return resultRect;
+}
+
+// DrawTiles with the grid size and the window size baked in at compile time.
+//
+// The generic version has to wrap every tile's destination with a % by the map render texture size, and find its chunk
+// with a / and % by TILE_CHUNK_SIZE. Here the destination columns are wrapped once up front and the destination row once
+// per row, the chunk math is all shifts and masks, and the loops over the window's rows and columns have fixed trip
+// counts, so for small windows the compiler can unroll them completely.
+//
+// Windows near the edges of the map get a clipped tile range, those go to DrawTiles_Generic.
+template<int GridSize_px, int WindowWidth_Tiles, int WindowHeight_Tiles>
+struct TileRenderer_t
+{
+    // the map render texture always has room for one more tile than the window each way
+    static constexpr int cTextureWidth_Tiles = WindowWidth_Tiles + 1;
+    static constexpr int cTextureHeight_Tiles = WindowHeight_Tiles + 1;
+
+    static_assert(IsPowerOfTwo(TILE_CHUNK_SIZE), "chunk lookups are shifts and masks");
+    static constexpr int cChunkShift = Log2(TILE_CHUNK_SIZE);
+    static constexpr int cChunkMask = TILE_CHUNK_SIZE - 1;
+
+    // most chunks a row of the map render texture can touch
+    static constexpr int cMaxChunksAcross = (cTextureWidth_Tiles + TILE_CHUNK_SIZE - 2) / TILE_CHUNK_SIZE + 1;
+
+    static SDL_Rect DrawTiles(TileBatch_t& batch, const TileMap_t& tileMap, const IntVec2_t& topLeftTile, const IntVec2_t& destOrigin_Tiles, const IntVec2_t& destSize_Tiles)
+    {
+        const bool wholeTextureOnMap = (topLeftTile.X >= 0) && (topLeftTile.Y >= 0) &&
+                                       (topLeftTile.X + cTextureWidth_Tiles <= tileMap.Size_Tiles.X) &&
+                                       (topLeftTile.Y + cTextureHeight_Tiles <= tileMap.Size_Tiles.Y);
+
+        if(!wholeTextureOnMap)
+        {
+            return DrawTiles_Generic(batch, tileMap, topLeftTile, {WindowWidth_Tiles, WindowHeight_Tiles}, destOrigin_Tiles, destSize_Tiles);
+        }
+
+        const int firstChunkX = topLeftTile.X >> cChunkShift;
+
+        // which of the row's chunks (counting from firstChunkX) each column of the texture is in, where it is in that chunk's rows,
+        // and where it goes in the map render texture
+        int columnChunks[cTextureWidth_Tiles];
+        int columnOffsets[cTextureWidth_Tiles];
+        int columnDests_px[cTextureWidth_Tiles];
+
+        for(int column = 0; column < cTextureWidth_Tiles; column++)
+        {
+            const int columnIndex = topLeftTile.X + column;
+
+            columnChunks[column] = (columnIndex >> cChunkShift) - firstChunkX;
+            columnOffsets[column] = columnIndex & cChunkMask;
+            columnDests_px[column] = WrapIndex(columnIndex - destOrigin_Tiles.X, destSize_Tiles.X) * GridSize_px;
+        }
+
+        const int rowChunkCount = columnChunks[cTextureWidth_Tiles - 1] + 1;
+        assert(rowChunkCount <= cMaxChunksAcross);
+
+        const TileChunk_t* rowChunks[cMaxChunksAcross] = {};
+        int rowChunksY = -1;
+
+        // there's never more than one draw per texture tile, so the room for them is made once up front and they're written
+        // straight in, instead of push_back checking the capacity for every tile
+        const size_t firstDrawIndex = batch.Draws.size();
+        batch.Draws.resize(firstDrawIndex + cTextureWidth_Tiles * cTextureHeight_Tiles);
+
+        TileDraw_t* nextDraw = &batch.Draws[firstDrawIndex];
+
+        for(int row = 0; row < cTextureHeight_Tiles; row++)
+        {
+            const int rowIndex = topLeftTile.Y + row;
+
+            // the chunks are only looked up again when the rows cross into the next chunk down
+            if((rowIndex >> cChunkShift) != rowChunksY)
+            {
+                rowChunksY = rowIndex >> cChunkShift;
+
+                for(int chunkIndex = 0; chunkIndex < rowChunkCount; chunkIndex++)
+                {
+                    rowChunks[chunkIndex] = FindChunk(tileMap, {firstChunkX + chunkIndex, rowChunksY});
+                }
+            }
+
+            const int rowOffset = (rowIndex & cChunkMask) * TILE_CHUNK_SIZE;
+            const int rowDest_px = WrapIndex(rowIndex - destOrigin_Tiles.Y, destSize_Tiles.Y) * GridSize_px;
+
+            for(int column = 0; column < cTextureWidth_Tiles; column++)
+            {
+                const TileChunk_t* chunk = rowChunks[columnChunks[column]];
+
+                if(chunk == nullptr)
+                {
+                    continue;
+                }
+
+                const TileId_t tileId = chunk->Tiles[rowOffset + columnOffsets[column]];
+
+                if(tileId == cEmptyTile)
+                {
+                    continue;
+                }
+
+                const TileSource_t& tileSource = tileMap.TileSources[tileId];
+
+                nextDraw->Page = tileSource.Page;
+                nextDraw->Source = tileSource.Rect;
+                nextDraw->Dest = {columnDests_px[column], rowDest_px, GridSize_px, GridSize_px};
+                nextDraw++;
+            }
+        }
+
+        batch.Draws.resize(nextDraw - batch.Draws.data());
+
+        return {topLeftTile.X * GridSize_px, topLeftTile.Y * GridSize_px, cTextureWidth_Tiles * GridSize_px, cTextureHeight_Tiles * GridSize_px};
+    }
+};
+
+typedef SDL_Rect (*DrawTilesFn_t)(TileBatch_t& batch, const TileMap_t& tileMap, const IntVec2_t& topLeftTile, const IntVec2_t& destOrigin_Tiles, const IntVec2_t& destSize_Tiles);
+
+struct TileRendererSpecialization_t
+{
+    int GridSize_px;
+    IntVec2_t WindowSize_Tiles;
+    DrawTilesFn_t DrawTiles;
+};
+
+// The window sizes that get their own TileRenderer_t: the demo's window, and the benchmark's 320 x 240 and 1920 x 1072 windows.
+// Add a line here for any other window size a game uses a lot.
+static const TileRendererSpecialization_t cTileRendererSpecializations[] = {
+    {cGridSize_px, cWindowSize_Tiles, TileRenderer_t<cGridSize_px, cWindowSize_Tiles.X, cWindowSize_Tiles.Y>::DrawTiles},
+    {cGridSize_px, {20, 15}, TileRenderer_t<cGridSize_px, 20, 15>::DrawTiles},
+    {cGridSize_px, {120, 67}, TileRenderer_t<cGridSize_px, 120, 67>::DrawTiles},
+};
+
+// Returns the TileRenderer_t made for this grid and window size, or nullptr if there isn't one
+static DrawTilesFn_t FindTileRenderer(int gridSize_px, const IntVec2_t& windowSize_Tiles)
+{
+    for(const TileRendererSpecialization_t& specialization : cTileRendererSpecializations)
+    {
+        if(specialization.GridSize_px == gridSize_px && specialization.WindowSize_Tiles.X == windowSize_Tiles.X && specialization.WindowSize_Tiles.Y == windowSize_Tiles.Y)
+        {
+            return specialization.DrawTiles;
+        }
+    }
+
+    return nullptr;
+}
+
+// Adds a window's worth of tiles to the batch, with map tile (x, y) going in the same slot of a destSize_Tiles map render texture
+// as BatchTileArea puts it. destSize_Tiles has to be at least one tile bigger than the window each way. Returns the rectangle
+// of the map it covers.
+//
+// Window sizes with a TileRenderer_t go to it, everything else goes to DrawTiles_Generic.
+static SDL_Rect DrawTilesAt(TileBatch_t& batch, const TileMap_t& tileMap, const IntVec2_t& topLeftTile, const IntVec2_t& windowSize_Tiles, const IntVec2_t& destOrigin_Tiles, const IntVec2_t& destSize_Tiles)
+{
+    assert(destSize_Tiles.X > windowSize_Tiles.X && destSize_Tiles.Y > windowSize_Tiles.Y);
+
+    const DrawTilesFn_t drawTiles = FindTileRenderer(cGridSize_px, windowSize_Tiles);
+
+    if(drawTiles != nullptr)
+    {
+        return drawTiles(batch, tileMap, topLeftTile, destOrigin_Tiles, destSize_Tiles);
+    }
+
+    return DrawTiles_Generic(batch, tileMap, topLeftTile, windowSize_Tiles, destOrigin_Tiles, destSize_Tiles);
+}
+
+// try and draw a window, return the rectangle that it drew
+// draw the tileset underneath it in red, draw the area it rendered in white maybe
+//
+// The tiles are only added to the batch here, SubmitTileBatch is what actually draws them.
+// The top left tile that's on the map goes in the top left of the map render texture, which always has room for one more
+// tile than the window each way.
+SDL_Rect DrawTiles(TileBatch_t& batch, const TileMap_t& tileMap, const IntVec2_t& topLeftTile, const IntVec2_t& windowSize_Tiles)
+{
+    const IntVec2_t destOrigin_Tiles = {max(0, topLeftTile.X), max(0, topLeftTile.Y)};
+    const IntVec2_t mapRenderTextureSize_Tiles = {windowSize_Tiles.X + 1, windowSize_Tiles.Y + 1};
+
+    return DrawTilesAt(batch, tileMap, topLeftTile, windowSize_Tiles, destOrigin_Tiles, mapRenderTextureSize_Tiles);
+}
+
+// Returns a 2D point giving the top left corner of a rectangle that serves as the destination of where the map pixels will be copied to the screen.
+// This is needed because we don't copy the map pixels to the bottom left of the map render texture
+// (and it wouldn't help anyway because the map render texture is 1 tile bigger than the screen in width and height)
+//
+// This might be a bit hard to visualize, but if you stood on the northwest corner of the map, you would see the map in the bottom right corner,
+// and the sky would fill the rest of the top left
+IntVec2_t GetDrawRenderOffset(const SDL_Rect& srcFromRenderRect, const IntVec2_t& windowSize, const WindowIntersectType_t& intersectType)
+{
+    switch(intersectType)
+    {
+        case WindowIntersectType_t::TotallyOut:
+        case WindowIntersectType_t::TotallyIn:
+        {
+            return {0, 0};
+        }
+
+        case WindowIntersectType_t::NorthWest:
+        {
+            // put it in the bottom right corner
+            IntVec2_t result = {windowSize.X - srcFromRenderRect.w, windowSize.Y - srcFromRenderRect.h};
+            return result;
+        }
+
+        case WindowIntersectType_t::North:
+        {
+            // put it on the bottom
+            IntVec2_t result = {0, windowSize.Y - srcFromRenderRect.h};
+            return result;
+        }
+        case WindowIntersectType_t::NorthEast:
+        {
+            // put it on the bottom
+            IntVec2_t result = {0, windowSize.Y - srcFromRenderRect.h};
+            return result;
+        }
+
+        case WindowIntersectType_t::East:
+        {
+            // leave as is
+            IntVec2_t result = {0,0};
+            return result;
+        }
+
+        case WindowIntersectType_t::SouthEast:
+        {
+            // leave as is
+            IntVec2_t result = {0,0};
+            return result;
+        }
+
+        case WindowIntersectType_t::South:
+        {
+            // leave as is
+            IntVec2_t result = {0,0};
+            return result;
+        }
+
+
+        case WindowIntersectType_t::SouthWest:
+        {
+            // offset to right
+            IntVec2_t result = {windowSize.X - srcFromRenderRect.w,0};
+            return result;
+        }
+        
+        case WindowIntersectType_t::West:
+        {
+            //offset to right
+            IntVec2_t result = {windowSize.X - srcFromRenderRect.w,0};
+            return result;
+        }
+
+        default:
+        {
+            assert(0);
+            throw std::logic_error("Impossible intersection type");
+        }
+        
+    }
+}
+
+// Returns a rectangle showing the area to copy from, to get all of the useful pixels rendered from the map that would be in the player's view
+SDL_Rect GetTextureReadArea(const IntVec2_t& windowTopLeft_RelToTextureTopLeft, const IntVec2_t& windowSize, const WindowIntersectType_t& intersectType, const SDL_Rect& renderedRectangle)
+{
+    switch(intersectType)
+    {
+        case WindowIntersectType_t::TotallyOut:
+        {
+            SDL_Rect rect = {0,0,0,0};
+
+            // there's really no reason for CheckArea to be in this case, but it's a handy breakpoint location
+            CheckArea(rect, windowSize);
+            return rect;
+        }
+        case WindowIntersectType_t::TotallyIn:
+        {
+            SDL_Rect rect = {0};
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = windowSize.X;
+            rect.h = windowSize.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+
+        // maybe I can reduce some of this by doing some kind of absolute value for some of the width and height calculations
+        // I'm not sure it's worth it, I thought I had a more elegant method about 3 times now.
+
+        // very special case, can't be merged with anything
+        case WindowIntersectType_t::NorthWest:
+        {
+            SDL_Rect rect = {0};
+            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft.X, which is NOT zero
+            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
+            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // really is plus! windowTopLeft is negative!
+            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // really is plus! windowTopLeft is negative!
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+
+        // possible merge with N/NE
+        case WindowIntersectType_t::North:
+        {
+            SDL_Rect rect = {0};
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
+            rect.w = windowSize.X;
+            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // really is plus! windowTopLeft is negative!
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+        case WindowIntersectType_t::East:
+        {
+            SDL_Rect rect = {0};
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
+            rect.h = windowSize.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+        
+        case WindowIntersectType_t::NorthEast:
+        {
+            SDL_Rect rect = {0};
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
+            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
+            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // for east, windowTopLeft_RelToTexturetopLeft will be 0; really is plus, Y is negative for NE
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+        case WindowIntersectType_t::SouthEast:
+        {
+            SDL_Rect rect = {0};
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
+            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+        case WindowIntersectType_t::South:
+        {
+            SDL_Rect rect = {0};
+
+            rect.x = windowTopLeft_RelToTextureTopLeft.X;
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = windowSize.X;
+            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+
+        case WindowIntersectType_t::SouthWest:
+        {
+            SDL_Rect rect = {0};
+            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft, which is NOT zero
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // is NOT minus, X is negative, we want to truncate off the part to the left of the texture's bounds
+            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+
+        case WindowIntersectType_t::West:
+        {
+            SDL_Rect rect = {0};
+            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft, which is NOT zero
+            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
+            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // is NOT minus, X is negative, we want to truncate off the part to the left of the texture's bounds
+            rect.h = windowSize.Y;
+
+            CheckArea(rect, windowSize);
+
+            return rect;
+        }
+
+        default:
+        {
+            assert(0);
+            throw std::logic_error("Impossible intersection type");
+        }
+        
+    }
+}
+
+// The intersection of [start, start + length) with [0, limit), as a start and a length. Both are 0 if there's no overlap.
+static inline constexpr IntVec2_t ClipSpan(int start, int length, int limit)
+{
+    const int clippedStart = max(0, start);
+    const int clippedLength = max(0, min(limit, start + length) - clippedStart);
+
+    return {clippedStart, clippedLength};
+}
+
+// Works out the same rectangles as GetMapRenderRectangle, RenderMapToTexture, GetScreenReadArea and GetDrawRenderOffset in one go.
+//
+// If you draw the ten intersect cases out, each of those rectangles turns out to be an intersection of two spans per axis, plus an offset
+// for whatever got cut off the north / west, so there's no need to work out the intersect type first. Everything here is a min / max.
+//
+// Differences from the per-case functions (which are kept as the reference version, see DoClipTests):
+//  - an empty result is always {0, 0, 0, 0}, even for a window that just touches the map's edge
+//  - a window that's bigger than the map and hangs off both sides gets the part of the map it covers, not TotallyOut's empty rect
+//
+// It's constexpr so it can be checked at compile time too.
+//
+// This version takes where the window's top left corner is on the tile grid (FindGridPoint of its position relative to the map),
+// RenderWindows finds those for all of its viewports at once with FindGridPoints. ComputeWindowClip below takes the position.
+constexpr WindowClip_t ComputeWindowClipFromGridPoint(const IntVec2_t& mapSize_px, const GridPoint_t& windowTopLeft, const IntVec2_t& windowSize_px, int gridSize)
+{
+    const IntVec2_t relToMap_WindowTopLeft = {windowTopLeft.Cell.X * gridSize + windowTopLeft.Offset.X, windowTopLeft.Cell.Y * gridSize + windowTopLeft.Offset.Y};
+
+    const IntVec2_t mapSize_Tiles = {mapSize_px.X / gridSize, mapSize_px.Y / gridSize};
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / gridSize, windowSize_px.Y / gridSize};
+
+    // the part of the map the window sees
+    const IntVec2_t mapSpanX = ClipSpan(relToMap_WindowTopLeft.X, windowSize_px.X, mapSize_px.X);
+    const IntVec2_t mapSpanY = ClipSpan(relToMap_WindowTopLeft.Y, windowSize_px.Y, mapSize_px.Y);
+    const int mapRectNotEmpty = (mapSpanX.Y > 0) & (mapSpanY.Y > 0);
+
+    // the tiles that get rendered, see GetTileRangeToRender
+    const IntVec2_t tileSpanX = ClipSpan(windowTopLeft.Cell.X, windowSize_Tiles.X + 1, mapSize_Tiles.X);
+    const IntVec2_t tileSpanY = ClipSpan(windowTopLeft.Cell.Y, windowSize_Tiles.Y + 1, mapSize_Tiles.Y);
+    const int tilesNotEmpty = (tileSpanX.Y > 0) & (tileSpanY.Y > 0);
+
+    const SDL_Rect renderedRect = {tileSpanX.X * gridSize, tileSpanY.X * gridSize, tileSpanX.Y * gridSize * tilesNotEmpty, tileSpanY.Y * gridSize * tilesNotEmpty};
+
+    // the window's top left corner, relative to the top left rendered tile. This is negative when the window hangs off the north / west.
+    const IntVec2_t windowTopLeft_RelToTexture = {relToMap_WindowTopLeft.X - renderedRect.x, relToMap_WindowTopLeft.Y - renderedRect.y};
+
+    // the part of the rendered tiles the window sees
+    const IntVec2_t sourceSpanX = ClipSpan(windowTopLeft_RelToTexture.X, windowSize_px.X, renderedRect.w);
+    const IntVec2_t sourceSpanY = ClipSpan(windowTopLeft_RelToTexture.Y, windowSize_px.Y, renderedRect.h);
+    const int sourceNotEmpty = (sourceSpanX.Y > 0) & (sourceSpanY.Y > 0);
+
+    return {
+        {mapSpanX.X * mapRectNotEmpty, mapSpanY.X * mapRectNotEmpty, mapSpanX.Y * mapRectNotEmpty, mapSpanY.Y * mapRectNotEmpty},
+        renderedRect,
+        {sourceSpanX.X * sourceNotEmpty, sourceSpanY.X * sourceNotEmpty, sourceSpanX.Y * sourceNotEmpty, sourceSpanY.Y * sourceNotEmpty},
+        // whatever was cut off the north / west pushes the map over in the window
+        {max(0, -windowTopLeft_RelToTexture.X) * sourceNotEmpty, max(0, -windowTopLeft_RelToTexture.Y) * sourceNotEmpty}
+    };
+}
+
+constexpr WindowClip_t ComputeWindowClip(const IntVec2_t& mapSize_px, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize_px, int gridSize)
+{
+    return ComputeWindowClipFromGridPoint(mapSize_px, FindGridPoint(relToMap_WindowTopLeft, gridSize), windowSize_px, gridSize);
+}
+
+// the same numbers as DoIntersectCaseTests
+static_assert(ComputeWindowClip({100, 100}, {-20, -20}, {50, 50}, 10).MapRect.w == 30, "northwest map rect");
+static_assert(ComputeWindowClip({100, 100}, {80, -20}, {50, 50}, 10).MapRect.x == 80, "northeast map rect");
+static_assert(ComputeWindowClip({100, 100}, {80, -20}, {50, 50}, 10).MapRect.h == 30, "northeast map rect");
+static_assert(ComputeWindowClip({100, 100}, {25, 80}, {50, 50}, 10).MapRect.h == 20, "south map rect");
+static_assert(ComputeWindowClip({100, 100}, {200, 200}, {50, 50}, 10).MapRect.w == 0, "totally out map rect");
+
+// a 32 x 32 window hanging 20 px off the west of a 128 x 128 map: 12 px of map, pushed to the east side of the window
+static_assert(ComputeWindowClip({128, 128}, {-20, 40}, {32, 32}, 16).SourceRect.w == 12, "west source rect");
+static_assert(ComputeWindowClip({128, 128}, {-20, 40}, {32, 32}, 16).DestOffset.X == 20, "west dest offset");
+static_assert(ComputeWindowClip({128, 128}, {-20, 40}, {32, 32}, 16).SourceRect.y == 8, "west source rect");
+
+// Adds the ring buffer slot of every tile in area (in map tile coordinates) to slotRects
+static void AddRingSlotRects(std::vector<SDL_Rect>& slotRects, const MapRenderCache_t& cache, const SDL_Rect& area)
+{
+    for(int rowIndex = area.y; rowIndex < area.y + area.h; rowIndex++)
+    {
+        for(int columnIndex = area.x; columnIndex < area.x + area.w; columnIndex++)
+        {
+            SDL_Rect slot = {0};
+            slot.x = WrapIndex(columnIndex, cache.Capacity_Tiles.X) * cGridSize_px;
+            slot.y = WrapIndex(rowIndex, cache.Capacity_Tiles.Y) * cGridSize_px;
+            slot.w = cGridSize_px;
+            slot.h = cGridSize_px;
+
+            slotRects.push_back(slot);
+        }
+    }
+}
+
+// The bottom layer of a map is drawn over cyan (see RenderMapRegion), every layer above it over transparent black,
+// so whatever's under it shows through where it has no tiles.
+//
+// Note a tile pixel that's only partly see through gets its alpha applied twice in an upper layer (once when it's drawn over the
+// transparent black, again when the layer is blended on), so it comes out a little fainter than it would drawn straight onto the layer under it.
+static void SetMapBackgroundDrawColor(bool transparentBackground)
+{
+    if(transparentBackground)
+    {
+        SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 0, 0, 0);
+    }
+    else
+    {
+        SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 255, 255, 255);
+    }
+}
+
+// Same result as RenderMapRegion, but the map render texture is treated as a ring buffer and only the tiles that weren't
+// already in it from the last frame get drawn. If the window only moved within the tile it was already in, nothing is drawn at all,
+// and the render target is left alone.
+SDL_Rect RenderMapRegionIncremental(SDL_Texture* mapRenderTexture, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& northWestTile, const IntVec2_t& windowSize_Tiles, bool transparentBackground)
+{
+    MapRenderCache_t& cache = GetMapRenderCache(mapRenderTexture);
+
+    const SDL_Rect neededTiles = GetTileRangeToRender(northWestTile, windowSize_Tiles, tileMap.Size_Tiles);
+
+    // the map render texture is sized to always fit a window's worth of tiles
+    assert(neededTiles.w <= cache.Capacity_Tiles.X);
+    assert(neededTiles.h <= cache.Capacity_Tiles.Y);
+
+    SDL_Rect keptTiles = {0};
+    const bool sameMap = (cache.TileMap == &tileMap) && (cache.MapVersion == tileMap.Version);
+    const bool reuseTiles = cache.Valid && sameMap && (SDL_IntersectRect(&cache.Tiles, &neededTiles, &keptTiles) == SDL_TRUE);
+
+    if(!reuseTiles)
+    {
+        // nothing is kept, so everything is "newly exposed"
+        keptTiles = {neededTiles.x, neededTiles.y, 0, 0};
+    }
+
+    // The newly exposed tiles are whatever's in neededTiles but not keptTiles, which is at most 4 strips:
+    //
+    //  +-----------------+
+    //  |      north      |
+    //  +----+-------+----+
+    //  |west| kept  |east|
+    //  +----+-------+----+
+    //  |      south      |
+    //  +-----------------+
+    const int keptRowsHeight = (keptTiles.w == 0) ? 0 : keptTiles.h;
+    const int northHeight = (keptTiles.w == 0) ? neededTiles.h : keptTiles.y - neededTiles.y;
+    const int southTop = neededTiles.y + northHeight + keptRowsHeight;
+
+    SDL_Rect exposedAreas[4] = {0};
+    exposedAreas[0] = {neededTiles.x, neededTiles.y, neededTiles.w, northHeight};
+    exposedAreas[1] = {neededTiles.x, southTop, neededTiles.w, neededTiles.y + neededTiles.h - southTop};
+    exposedAreas[2] = {neededTiles.x, keptTiles.y, keptTiles.x - neededTiles.x, keptRowsHeight};
+    exposedAreas[3] = {keptTiles.x + keptTiles.w, keptTiles.y, neededTiles.x + neededTiles.w - (keptTiles.x + keptTiles.w), keptRowsHeight};
+
+    ClearTileBatch(TileBatch);
+
+    // the slots of the tiles being drawn, these need to be cleared first because they still hold whatever tile was there before
+    RingSlotRects.clear();
+
+    // redrawing all of it is drawing a whole window, just into the ring's slots, so it gets the TileRenderer_t for the window size if there is one
+    if(!reuseTiles)
+    {
+        DrawTilesAt(TileBatch, tileMap, northWestTile, windowSize_Tiles, {0, 0}, cache.Capacity_Tiles);
+    }
+    else
+    {
+        for(const SDL_Rect& exposedArea : exposedAreas)
+        {
+            BatchTileArea(TileBatch, tileMap, exposedArea, {0, 0}, cache.Capacity_Tiles);
+
+            if(reuseTiles)
+            {
+                AddRingSlotRects(RingSlotRects, cache, exposedArea);
+            }
+        }
+    }
+
+    // tiles that changed after they were drawn (see MarkPendingTile). Only the ones that are being kept need it,
+    // the newly exposed ones were just batched and anything else has scrolled out.
+    if(reuseTiles && cache.PendingSlotCount > 0)
+    {
+        for(int rowIndex = keptTiles.y; rowIndex < keptTiles.y + keptTiles.h; rowIndex++)
+        {
+            const Uint8* pendingRow = &cache.PendingSlots[WrapIndex(rowIndex, cache.Capacity_Tiles.Y) * cache.Capacity_Tiles.X];
+
+            for(int columnIndex = keptTiles.x; columnIndex < keptTiles.x + keptTiles.w; columnIndex++)
+            {
+                if(pendingRow[WrapIndex(columnIndex, cache.Capacity_Tiles.X)])
+                {
+                    const SDL_Rect pendingTile = {columnIndex, rowIndex, 1, 1};
+
+                    BatchTileArea(TileBatch, tileMap, pendingTile, {0, 0}, cache.Capacity_Tiles);
+                    AddRingSlotRects(RingSlotRects, cache, pendingTile);
+                }
+            }
+        }
+    }
+
+    ClearPendingSlots(cache);
+
+    // only switch render targets if there's something to draw, just moving within a tile costs nothing here
+    if(!reuseTiles || !RingSlotRects.empty())
+    {
+        SDL_SetRenderTarget(SDLGlobals.Renderer, mapRenderTexture);
+        FrameProfiler.Current.RenderTargetSwitches++;
+
+        // same background as RenderMapRegion, see the note there
+        SetMapBackgroundDrawColor(transparentBackground);
+
+        if(!reuseTiles)
+        {
+            SDL_RenderClear(SDLGlobals.Renderer);
+        }
+        else
+        {
+            SDL_RenderFillRects(SDLGlobals.Renderer, RingSlotRects.data(), (int)RingSlotRects.size());
+        }
+
+        SubmitTileBatch(TileBatch, tileAtlas);
+    }
+
+    cache.Tiles = neededTiles;
+    cache.TileMap = &tileMap;
+    cache.MapVersion = tileMap.Version;
+    cache.Valid = (neededTiles.w != 0);
+
+    // same as what DrawTiles returns
+    SDL_Rect renderedArea = {0};
+    renderedArea.x = neededTiles.x * cGridSize_px;
+    renderedArea.y = neededTiles.y * cGridSize_px;
+    renderedArea.w = neededTiles.w * cGridSize_px;
+    renderedArea.h = neededTiles.h * cGridSize_px;
+
+    return renderedArea;
+}
+
+// Draws the tiles a window can see into the map render texture.
+// The map render texture is left as the render target, it's up to the caller to switch to whatever it needs next.
+//
+// transparentBackground is for the layers over a map's bottom layer, see SetMapBackgroundDrawColor.
+SDL_Rect RenderMapRegion(SDL_Texture* mapRenderTexture, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& northWestTile, const IntVec2_t& windowSize_Tiles, bool transparentBackground)
+{
+    SDL_SetRenderTarget(SDLGlobals.Renderer, mapRenderTexture);
+    FrameProfiler.Current.RenderTargetSwitches++;
+
+    // you should never see this cyan color in this example, because the map has no transparent pixels.
+    // in a real game you may want transparent pixels in the middle of the map to show some background.
+    // 
+    // If you do want that, use
+    //     SDL_SetTextureBlendMode(mapRenderTexture, SDL_BLENDMODE_BLEND);
+    //     SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 0, 0, 0);
+    // instead. That's what the layers over the bottom one do.
+    SetMapBackgroundDrawColor(transparentBackground);
+    SDL_RenderClear(SDLGlobals.Renderer);
+
+    ClearTileBatch(TileBatch);
+
+    SDL_Rect renderedArea = DrawTiles(TileBatch, tileMap, northWestTile, windowSize_Tiles);
+
+    // the map render texture is still bound from the clear above, so all of the tiles go out with no more target switches
+    SubmitTileBatch(TileBatch, tileAtlas);
+
+    return renderedArea;
+
+}
+
+// with the CPU compositor further down
+SDL_Rect RenderMapRegionParallel(SDL_Texture* mapRenderTexture, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& northWestTile, const IntVec2_t& windowSize_Tiles, bool transparentBackground);
+
+// Draws one layer of the map into a map render texture. Every layer has its own map render texture (and its own ring buffer cache),
+// so a layer that hasn't changed costs next to nothing no matter how often the layers around it do.
+SDL_Rect RenderMapToTexture(SDL_Texture* mapRenderTexture, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& windowSize_Tiles, const IntVec2_t& relToMap_WindowTopLeft, bool transparentBackground)
+{
+    const IntVec2_t gridCoordOfWindow_TopLeft = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+
+    // an atlas with no CPU copies is always drawn by the renderer
+    if(ParallelMapRender && !tileAtlas.CpuPages.empty())
+    {
+        return RenderMapRegionParallel(mapRenderTexture, tileAtlas, tileMap, gridCoordOfWindow_TopLeft, windowSize_Tiles, transparentBackground);
+    }
+
+    // render the part of the map the player can see to a texture
+    if(IncrementalMapRender)
+    {
+        return RenderMapRegionIncremental(mapRenderTexture, tileAtlas, tileMap, gridCoordOfWindow_TopLeft, windowSize_Tiles, transparentBackground);
+    }
+
+    SDL_Rect renderedRectangle = RenderMapRegion(mapRenderTexture, tileAtlas, tileMap, gridCoordOfWindow_TopLeft, windowSize_Tiles, transparentBackground);
+
+    return renderedRectangle;
+
+}
+
+// Returns the area (in map px) that RenderMapToTexture renders for a window, without rendering anything
+SDL_Rect GetRenderedRectangle(const IntVec2_t& mapSize_Tiles, const IntVec2_t& windowSize_Tiles, const IntVec2_t& relToMap_WindowTopLeft)
+{
+    const IntVec2_t gridCoordOfWindow_TopLeft = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+
+    const SDL_Rect tileRange = GetTileRangeToRender(gridCoordOfWindow_TopLeft, windowSize_Tiles, mapSize_Tiles);
+
+    SDL_Rect renderedRectangle = {0};
+    renderedRectangle.x = tileRange.x * cGridSize_px;
+    renderedRectangle.y = tileRange.y * cGridSize_px;
+    renderedRectangle.w = tileRange.w * cGridSize_px;
+    renderedRectangle.h = tileRange.h * cGridSize_px;
+
+    return renderedRectangle;
+}
+
+// Returns the area of the map render texture to copy to the screen render texture, relative to the top left rendered tile
+SDL_Rect GetScreenReadArea(const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize, const WindowIntersectType_t& intersectType, const SDL_Rect& renderedRectangle)
+{
+    // the top left rendered tile is the northwest most tile our region touches (or the map's top left tile, if the region hangs off the map there)
+    const IntVec2_t validTopLeftTileToRegionTopLeft = {relToMap_WindowTopLeft.X - renderedRectangle.x, relToMap_WindowTopLeft.Y - renderedRectangle.y};
+
+    return GetTextureReadArea(validTopLeftTileToRegionTopLeft , windowSize, intersectType, renderedRectangle);
+}
+
+// Clears the screen render texture to the background color, and copies srcRect out of each layer's map render texture into it at screenDestOrigin,
+// bottom layer first. The screen render texture is left as the render target.
+void CopyMapAreaToScreen(SDL_Texture* screenRenderTexture, SDL_Texture* const* mapRenderTextures, int layerCount, const SDL_Rect& srcRect, const IntVec2_t& screenDestOrigin, const SDL_Rect& renderedRectangle)
+{
+    SDL_SetRenderTarget(SDLGlobals.Renderer, screenRenderTexture);
+    FrameProfiler.Current.RenderTargetSwitches++;
+
+    // I'm using this orangish color to simulate a sky texture or background color.
+    // in a real game you will probably want this to be set to transparent instead, 
+    // If you do want that, use
+    //     SDL_SetTextureBlendMode(screenRenderTexture, SDL_BLENDMODE_BLEND);
+    //     SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 0, 0, 0);
+    // instead.
+    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 255, 180, 0, 255);
+    SDL_RenderClear(SDLGlobals.Renderer);
+
+    SDL_Rect destRect = {0};
+    destRect.x = screenDestOrigin.X;
+    destRect.y = screenDestOrigin.Y;
+    destRect.w = srcRect.w;
+    destRect.h = srcRect.h;
+
+    // srcRect is relative to the top left rendered tile, the ring buffer wants map pixels
+    const SDL_Rect srcRect_MapPx = {renderedRectangle.x + srcRect.x, renderedRectangle.y + srcRect.y, srcRect.w, srcRect.h};
+
+    // the layers over the bottom one are blended on (see AcquireViewportTextures), so the ones under them show through
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        SDL_Texture* mapRenderTexture = mapRenderTextures[layerIndex];
+
+        if(IncrementalMapRender)
+        {
+            CopyFromRingTexture(mapRenderTexture, GetMapRenderCache(mapRenderTexture).Capacity_Tiles, srcRect_MapPx, screenDestOrigin);
+            continue;
+        }
+
+        SDL_RenderCopy(SDLGlobals.Renderer, mapRenderTexture, &srcRect, &destRect);
+        FrameProfiler.Current.RenderCopies++;
+    }
+}
+
+// This is the only place a map's layers come together, each one is drawn into its own map render texture before this
+void CopyRenderedMapToScreen(SDL_Texture* screenRenderTexture, SDL_Texture* const* mapRenderTextures, int layerCount, const IntVec2_t& mapSize_px, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize, const SDL_Rect& renderedRectangle)
+{
+    // DON'T use relToRenderTexture here! It needs to be relative to the map!
+    const WindowClip_t clip = ComputeWindowClip(mapSize_px, relToMap_WindowTopLeft, windowSize, cGridSize_px);
+
+    assert(clip.RenderedRect.x == renderedRectangle.x && clip.RenderedRect.w == renderedRectangle.w);
+    assert(clip.RenderedRect.y == renderedRectangle.y && clip.RenderedRect.h == renderedRectangle.h);
+
+    CopyMapAreaToScreen(screenRenderTexture, mapRenderTextures, layerCount, clip.SourceRect, clip.DestOffset, renderedRectangle);
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Zoomed viewport functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// A zoomed out window can see thousands of tiles, far too many to draw one at a time every time it scrolls. Instead, every chunk
+// of the map it can see is drawn once into a thumbnail, from the tile atlas's mip level closest to the zoom, and the window is made
+// out of those: a few dozen copies at most, about what an unzoomed window costs. The thumbnails are kept (and kept up to date the same way
+// map render textures are, see InvalidateTileArea) until they haven't been used in a while, so scrolling a minimap draws no tiles at all.
+//
+// The thumbnails are always drawn by the renderer, ParallelMapRender only applies to unzoomed viewports.
+
+// How much of the map a window windowSize_px big sees at zoom, in map px
+IntVec2_t GetZoomedWindowSize_px(const IntVec2_t& windowSize_px, float zoom)
+{
+    return {(int)ceil(windowSize_px.X / (double)zoom), (int)ceil(windowSize_px.Y / (double)zoom)};
+}
+
+// The mip level a viewport at zoom is drawn from: the smallest one whose tiles are still at least as big as they're shown,
+// so a thumbnail is never shrunk by half or more when it's copied to the window
+static int GetZoomMipLevel(float zoom)
+{
+    int mipLevel = 0;
+
+    while(mipLevel < TILE_MIP_LEVELS - 1 && zoom * (2 << mipLevel) <= 1.0f)
+    {
+        mipLevel++;
+    }
+
+    return mipLevel;
+}
+
+// Where map px map_px lands in a window whose edge is at windowEdge_px (in map px). Both edges of every thumbnail go through this,
+// so neighbouring chunks always meet with no gap or overlap, no matter how the zoom rounds.
+static inline int ZoomToWindow_px(int map_px, int windowEdge_px, float zoom)
+{
+    return (int)floor((map_px - windowEdge_px) * (double)zoom);
+}
+
+static ChunkThumbnail_t* FindChunkThumbnail(const TileMap_t& tileMap, const IntVec2_t& chunkCoordinate, int mipLevel)
+{
+    auto foundCache = ChunkThumbnailCaches.find(&tileMap);
+
+    if(foundCache == ChunkThumbnailCaches.end())
+    {
+        return nullptr;
+    }
+
+    std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails = foundCache->second.Levels[mipLevel];
+    auto found = thumbnails.find(ChunkKey(chunkCoordinate));
+
+    return (found == thumbnails.end()) ? nullptr : &found->second;
+}
+
+static void ReleaseChunkThumbnail(ChunkThumbnail_t& thumbnail)
+{
+    ReleaseRenderTarget(RenderTargetPool, thumbnail.Texture);
+    ChunkThumbnailBytes -= (size_t)thumbnail.Size_px.X * thumbnail.Size_px.Y * sizeof(Uint32);
+}
+
+// Makes sure a chunk's thumbnail at mipLevel is up to date, drawing it from the atlas's mip pages if it isn't (or doesn't exist yet).
+// A chunk that has never had a tile in it doesn't get a thumbnail, there's nothing to draw but the background, so that returns nullptr
+// (as does running out of render targets).
+//
+// transparentBackground is for the layers over a map's bottom layer, see SetMapBackgroundDrawColor.
+// If anything is drawn, the thumbnail is left as the render target.
+const ChunkThumbnail_t* UpdateChunkThumbnail(const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& chunkCoordinate, int mipLevel, bool transparentBackground)
+{
+    if(FindChunk(tileMap, chunkCoordinate) == nullptr)
+    {
+        return nullptr;
+    }
+
+    std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails = ChunkThumbnailCaches[&tileMap].Levels[mipLevel];
+    ChunkThumbnail_t& thumbnail = thumbnails[ChunkKey(chunkCoordinate)];
+
+    thumbnail.LastUsedFrame = ChunkThumbnailFrame;
+
+    if(thumbnail.Texture != nullptr && thumbnail.MapVersion == tileMap.Version && thumbnail.TileAtlas == &tileAtlas && thumbnail.TransparentBackground == transparentBackground)
+    {
+        return &thumbnail;
+    }
+
+    // the chunk's tiles, less any that would be off the map
+    const IntVec2_t chunkTopLeft_Tiles = {chunkCoordinate.X * TILE_CHUNK_SIZE, chunkCoordinate.Y * TILE_CHUNK_SIZE};
+    const SDL_Rect chunkTiles = {chunkTopLeft_Tiles.X, chunkTopLeft_Tiles.Y,
+                                 min(TILE_CHUNK_SIZE, tileMap.Size_Tiles.X - chunkTopLeft_Tiles.X), min(TILE_CHUNK_SIZE, tileMap.Size_Tiles.Y - chunkTopLeft_Tiles.Y)};
+
+    if(thumbnail.Texture == nullptr)
+    {
+        thumbnail.Chunk = chunkCoordinate;
+        thumbnail.Size_px = {(chunkTiles.w * cGridSize_px) >> mipLevel, (chunkTiles.h * cGridSize_px) >> mipLevel};
+        thumbnail.Texture = AcquireRenderTarget(RenderTargetPool, thumbnail.Size_px);
+
+        if(thumbnail.Texture == nullptr)
+        {
+            thumbnails.erase(ChunkKey(chunkCoordinate));
+            return nullptr;
+        }
+
+        ChunkThumbnailBytes += (size_t)thumbnail.Size_px.X * thumbnail.Size_px.Y * sizeof(Uint32);
+    }
+
+    // the bottom layer's thumbnails are copied straight over the screen render texture's background, the ones above it are blended on
+    SDL_SetTextureBlendMode(thumbnail.Texture, transparentBackground ? SDL_BLENDMODE_BLEND : SDL_BLENDMODE_NONE);
+
+    SDL_SetRenderTarget(SDLGlobals.Renderer, thumbnail.Texture);
+    FrameProfiler.Current.RenderTargetSwitches++;
+
+    SetMapBackgroundDrawColor(transparentBackground);
+    SDL_RenderClear(SDLGlobals.Renderer);
+
+    ClearTileBatch(TileBatch);
+
+    BatchTileArea(TileBatch, tileMap, chunkTiles, chunkTopLeft_Tiles, {TILE_CHUNK_SIZE, TILE_CHUNK_SIZE});
+    ShrinkTileBatch(TileBatch, mipLevel);
+
+    SubmitTileBatch(TileBatch, tileAtlas, mipLevel);
+
+    thumbnail.TileAtlas = &tileAtlas;
+    thumbnail.TransparentBackground = transparentBackground;
+    thumbnail.MapVersion = tileMap.Version;
+
+    return &thumbnail;
+}
+
+// The zoomed version of CopyMapAreaToScreen: clears the screen render texture to the background color, then copies the thumbnail of
+// every chunk in chunkRect (in chunk coordinates, see ChunkRectForArea) into it, scaled by zoom, bottom layer first.
+// The thumbnails have to be up to date, see UpdateChunkThumbnail. The screen render texture is left as the render target.
+void CopyChunkThumbnailsToScreen(SDL_Texture* screenRenderTexture, const TileMap_t* const* layers, int layerCount, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize, float zoom, const SDL_Rect& chunkRect)
+{
+    SDL_SetRenderTarget(SDLGlobals.Renderer, screenRenderTexture);
+    FrameProfiler.Current.RenderTargetSwitches++;
+
+    // same background as CopyMapAreaToScreen
+    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 255, 180, 0, 255);
+    SDL_RenderClear(SDLGlobals.Renderer);
+
+    // the chunks along the edges hang off the window
+    const SDL_Rect windowRect = {0, 0, windowSize.X, windowSize.Y};
+    SDL_RenderSetClipRect(SDLGlobals.Renderer, &windowRect);
+
+    const int mipLevel = GetZoomMipLevel(zoom);
+    const IntVec2_t mapSize_px = GetMapSize_px(*layers[0]);
+
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        for(int chunkRow = chunkRect.y; chunkRow < chunkRect.y + chunkRect.h; chunkRow++)
+        {
+            for(int chunkColumn = chunkRect.x; chunkColumn < chunkRect.x + chunkRect.w; chunkColumn++)
+            {
+                // the chunk's area of the map, less anything off the map
+                const IntVec2_t chunkTopLeft_MapPx = {chunkColumn * cChunkSize_px, chunkRow * cChunkSize_px};
+                const IntVec2_t chunkEnd_MapPx = {min(chunkTopLeft_MapPx.X + cChunkSize_px, mapSize_px.X), min(chunkTopLeft_MapPx.Y + cChunkSize_px, mapSize_px.Y)};
+
+                SDL_Rect destRect = {0};
+                destRect.x = ZoomToWindow_px(chunkTopLeft_MapPx.X, relToMap_WindowTopLeft.X, zoom);
+                destRect.y = ZoomToWindow_px(chunkTopLeft_MapPx.Y, relToMap_WindowTopLeft.Y, zoom);
+                destRect.w = ZoomToWindow_px(chunkEnd_MapPx.X, relToMap_WindowTopLeft.X, zoom) - destRect.x;
+                destRect.h = ZoomToWindow_px(chunkEnd_MapPx.Y, relToMap_WindowTopLeft.Y, zoom) - destRect.y;
+
+                // far enough out, a whole chunk can round away to nothing
+                if(destRect.w <= 0 || destRect.h <= 0)
+                {
+                    continue;
+                }
+
+                const ChunkThumbnail_t* thumbnail = FindChunkThumbnail(*layers[layerIndex], {chunkColumn, chunkRow}, mipLevel);
+
+                if(thumbnail != nullptr)
+                {
+                    const SDL_Rect srcRect = {0, 0, thumbnail->Size_px.X, thumbnail->Size_px.Y};
+
+                    SDL_RenderCopy(SDLGlobals.Renderer, thumbnail->Texture, &srcRect, &destRect);
+                    FrameProfiler.Current.RenderCopies++;
+                }
+                else if(layerIndex == 0)
+                {
+                    // a chunk with no tiles is all map background
+                    SetMapBackgroundDrawColor(false);
+                    SDL_RenderFillRect(SDLGlobals.Renderer, &destRect);
+                }
+            }
+        }
+    }
+
+    SDL_RenderSetClipRect(SDLGlobals.Renderer, nullptr);
+}
+
+// Tells a map's chunk thumbnails that it went from previousVersion to its current Version, and that chunkChanged(chunkTiles) (chunkTiles
+// being the chunk's area in map tile coordinates) says which chunks that changed. The rest are still good, the others get drawn again
+// the next time they're used.
+template<typename ChunkChangedFn>
+static void InvalidateChunkThumbnails(const TileMap_t& tileMap, Uint64 previousVersion, ChunkChangedFn chunkChanged)
+{
+    auto foundCache = ChunkThumbnailCaches.find(&tileMap);
+
+    if(foundCache == ChunkThumbnailCaches.end())
+    {
+        return;
+    }
+
+    for(std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails : foundCache->second.Levels)
+    {
+        for(auto& entry : thumbnails)
+        {
+            ChunkThumbnail_t& thumbnail = entry.second;
+
+            if(thumbnail.MapVersion != previousVersion)
+            {
+                continue;
+            }
+
+            const SDL_Rect chunkTiles = {thumbnail.Chunk.X * TILE_CHUNK_SIZE, thumbnail.Chunk.Y * TILE_CHUNK_SIZE, TILE_CHUNK_SIZE, TILE_CHUNK_SIZE};
+
+            if(!chunkChanged(chunkTiles))
+            {
+                thumbnail.MapVersion = tileMap.Version;
+            }
+        }
+    }
+}
+
+// Gives the least recently used chunk thumbnails back to RenderTargetPool until they're under cMaxChunkThumbnailBytes.
+// Anything used this frame is kept, even if that means going over.
+void TrimChunkThumbnails()
+{
+    if(ChunkThumbnailBytes <= cMaxChunkThumbnailBytes)
+    {
+        return;
+    }
+
+    // oldest first
+    std::vector<std::pair<Uint64, ChunkThumbnail_t*>> thumbnailsByAge;
+
+    for(auto& cacheEntry : ChunkThumbnailCaches)
+    {
+        for(std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails : cacheEntry.second.Levels)
+        {
+            for(auto& entry : thumbnails)
+            {
+                thumbnailsByAge.push_back({entry.second.LastUsedFrame, &entry.second});
+            }
+        }
+    }
+
+    std::sort(thumbnailsByAge.begin(), thumbnailsByAge.end(), [](const std::pair<Uint64, ChunkThumbnail_t*>& a, const std::pair<Uint64, ChunkThumbnail_t*>& b) { return a.first < b.first; });
+
+    for(const std::pair<Uint64, ChunkThumbnail_t*>& entry : thumbnailsByAge)
+    {
+        if(ChunkThumbnailBytes <= cMaxChunkThumbnailBytes || entry.first == ChunkThumbnailFrame)
+        {
+            break;
+        }
+
+        ReleaseChunkThumbnail(*entry.second);
+        entry.second->Texture = nullptr;
+    }
+
+    // now drop the entries that were emptied out
+    for(auto& cacheEntry : ChunkThumbnailCaches)
+    {
+        for(std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails : cacheEntry.second.Levels)
+        {
+            for(auto entry = thumbnails.begin(); entry != thumbnails.end();)
+            {
+                entry = (entry->second.Texture == nullptr) ? thumbnails.erase(entry) : std::next(entry);
+            }
+        }
+    }
+}
+
+// Gives back every chunk thumbnail of a map, call this before the map goes away
+void ReleaseChunkThumbnails(const TileMap_t& tileMap)
+{
+    auto foundCache = ChunkThumbnailCaches.find(&tileMap);
+
+    if(foundCache == ChunkThumbnailCaches.end())
+    {
+        return;
+    }
+
+    for(std::unordered_map<Uint64, ChunkThumbnail_t>& thumbnails : foundCache->second.Levels)
+    {
+        for(auto& entry : thumbnails)
+        {
+            ReleaseChunkThumbnail(entry.second);
+        }
+    }
+
+    ChunkThumbnailCaches.erase(foundCache);
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Sprite batching functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Sprites go out the same way tiles do (see SubmitTileBatch), as quads in SDL_RenderGeometry calls, one call per run of sprites
+// from the same texture. They're sorted by (layer, texture, y) first to make those runs as long as possible, so thousands of sprites
+// from a handful of textures cost a handful of calls instead of an SDL_RenderCopy each.
+//
+// That does mean sprites in a layer are grouped by texture before they're sorted by y. Sprites that have to overlap each other
+// properly should be on different layers, or come from the same texture (put them in an atlas).
+
+// How the bits of a sort key are used, from the bottom up: the sprite's index in the queue (not sorted on, it's there to find
+// the sprite again), the y of its bottom edge, its texture slot, and its layer
+constexpr int cSpriteIndexBits = 20;
+constexpr int cSpriteYBits = 24;
+constexpr int cSpriteTextureBits = 12;
+constexpr int cSpriteLayerBits = 8;
+
+static_assert(cSpriteIndexBits + cSpriteYBits + cSpriteTextureBits + cSpriteLayerBits == 64, "the sprite sort key fields have to fill a Uint64");
+
+constexpr Uint64 cSpriteIndexMask = ((Uint64)1 << cSpriteIndexBits) - 1;
+
+// the radix sort goes through everything above the index this many bits at a time
+constexpr int cSpriteRadixBits = 11;
+constexpr int cSpriteRadixPasses = (64 - cSpriteIndexBits) / cSpriteRadixBits;
+
+static_assert(cSpriteRadixPasses * cSpriteRadixBits == 64 - cSpriteIndexBits, "the radix passes have to cover the sorted bits exactly");
+
+// Adds a sprite to a viewport's queue: the part of texture in source, with its top left corner at position_px (in map px).
+// The sprite's drawn with the texture's blend mode, so that usually wants to be SDL_BLENDMODE_BLEND.
+void QueueSprite(SpriteQueue_t& queue, SDL_Texture* texture, const SDL_Rect& source, const IntVec2_t& position_px, int layer)
+{
+    assert(InRange(0, layer, (1 << cSpriteLayerBits) - 1));
+    assert(queue.Sprites.size() <= cSpriteIndexMask);
+
+    const Sprite_t sprite = {texture, source, position_px, layer};
+    queue.Sprites.push_back(sprite);
+}
+
+// Sorts sprite sort keys on everything above the index bits, least significant digit first, so the sort's stable: sprites that
+// sort the same are drawn in the order they were queued. One pass counts every digit, then there's a pass per digit, less the
+// digits that are the same in every key (e.g., when everything's on layer 0).
+static void RadixSortSpriteKeys(std::vector<Uint64>& keys, std::vector<Uint64>& scratch)
+{
+    constexpr int cBucketCount = 1 << cSpriteRadixBits;
+    constexpr Uint64 cDigitMask = cBucketCount - 1;
+
+    const int keyCount = (int)keys.size();
+
+    if(keyCount < 2)
+    {
+        return;
+    }
+
+    int bucketStarts[cSpriteRadixPasses][cBucketCount] = {};
+
+    for(Uint64 key : keys)
+    {
+        for(int pass = 0; pass < cSpriteRadixPasses; pass++)
+        {
+            bucketStarts[pass][(key >> (cSpriteIndexBits + pass * cSpriteRadixBits)) & cDigitMask]++;
+        }
+    }
+
+    scratch.resize(keyCount);
+
+    for(int pass = 0; pass < cSpriteRadixPasses; pass++)
+    {
+        const int shift = cSpriteIndexBits + pass * cSpriteRadixBits;
+        int* buckets = bucketStarts[pass];
+
+        // every key has this digit, nothing would move
+        if(buckets[(keys[0] >> shift) & cDigitMask] == keyCount)
+        {
+            continue;
+        }
+
+        int bucketStart = 0;
+
+        for(int bucketIndex = 0; bucketIndex < cBucketCount; bucketIndex++)
+        {
+            const int bucketSize = buckets[bucketIndex];
+
+            buckets[bucketIndex] = bucketStart;
+            bucketStart += bucketSize;
+        }
+
+        for(Uint64 key : keys)
+        {
+            scratch[buckets[(key >> shift) & cDigitMask]++] = key;
+        }
+
+        keys.swap(scratch);
+    }
+}
+
+// Works out the part of a sprite a window can see, the same way the map is clipped (see ComputeWindowClip). relToMap_ViewTopLeft
+// and viewSize_px are the area of the map the window sees. sourceRect is the visible part of the sprite's texture, destRect is where
+// that goes in the window, scaled by zoom. Returns false if none of the sprite is visible.
+static bool ClipSpriteToView(const Sprite_t& sprite, const IntVec2_t& relToMap_ViewTopLeft, const IntVec2_t& viewSize_px, float zoom, SDL_Rect& sourceRect, SDL_Rect& destRect)
+{
+    const IntVec2_t relToView = {sprite.Position_px.X - relToMap_ViewTopLeft.X, sprite.Position_px.Y - relToMap_ViewTopLeft.Y};
+
+    const IntVec2_t spanX = ClipSpan(relToView.X, sprite.Source.w, viewSize_px.X);
+    const IntVec2_t spanY = ClipSpan(relToView.Y, sprite.Source.h, viewSize_px.Y);
+
+    if(spanX.Y == 0 || spanY.Y == 0)
+    {
+        return false;
+    }
+
+    sourceRect = {sprite.Source.x + spanX.X - relToView.X, sprite.Source.y + spanY.X - relToView.Y, spanX.Y, spanY.Y};
+
+    if(zoom == 1.0f)
+    {
+        destRect = {spanX.X, spanY.X, spanX.Y, spanY.Y};
+        return true;
+    }
+
+    // both edges go through ZoomToWindow_px, like the chunk thumbnails, so a sprite stays lined up with the tiles under it
+    destRect.x = ZoomToWindow_px(spanX.X, 0, zoom);
+    destRect.y = ZoomToWindow_px(spanY.X, 0, zoom);
+    destRect.w = ZoomToWindow_px(spanX.X + spanX.Y, 0, zoom) - destRect.x;
+    destRect.h = ZoomToWindow_px(spanY.X + spanY.Y, 0, zoom) - destRect.y;
+
+    return destRect.w > 0 && destRect.h > 0;
+}
+
+// Draws every sprite in the queue the window can see into the current render target (the viewport's screen render texture, with the
+// map already in it), then empties the queue. relToMap_ViewTopLeft and viewSize_px are the area of the map the window sees, see
+// GetZoomedWindowSize_px. Returns how many draw calls that took.
+int DrawSpriteQueue(SpriteQueue_t& queue, const IntVec2_t& relToMap_ViewTopLeft, const IntVec2_t& viewSize_px, float zoom)
+{
+    queue.SortKeys.clear();
+    queue.Textures.clear();
+
+    SDL_Texture* lastTexture = nullptr;
+    Uint64 lastTextureSlot = 0;
+
+    // only what the window can see gets sorted
+    for(int spriteIndex = 0; spriteIndex < (int)queue.Sprites.size(); spriteIndex++)
+    {
+        const Sprite_t& sprite = queue.Sprites[spriteIndex];
+        const IntVec2_t relToView = {sprite.Position_px.X - relToMap_ViewTopLeft.X, sprite.Position_px.Y - relToMap_ViewTopLeft.Y};
+
+        if(ClipSpan(relToView.X, sprite.Source.w, viewSize_px.X).Y == 0 || ClipSpan(relToView.Y, sprite.Source.h, viewSize_px.Y).Y == 0)
+        {
+            continue;
+        }
+
+        // textures get slots in the order they're first seen. Sprites tend to be queued in runs from the same texture,
+        // so the search hardly ever happens.
+        if(sprite.Texture != lastTexture)
+        {
+            lastTexture = sprite.Texture;
+            lastTextureSlot = std::find(queue.Textures.begin(), queue.Textures.end(), lastTexture) - queue.Textures.begin();
+
+            if(lastTextureSlot == queue.Textures.size())
+            {
+                assert(queue.Textures.size() < ((size_t)1 << cSpriteTextureBits));
+                queue.Textures.push_back(lastTexture);
+            }
+        }
+
+        // the bottom edge, so something further down the window is drawn over something further up. It's relative to the window,
+        // which keeps it well inside cSpriteYBits for anything the window can see.
+        const int sortY = max(0, min(relToView.Y + sprite.Source.h + (1 << (cSpriteYBits - 1)), (1 << cSpriteYBits) - 1));
+
+        queue.SortKeys.push_back(((Uint64)sprite.Layer << (64 - cSpriteLayerBits)) |
+                                 (lastTextureSlot << (cSpriteIndexBits + cSpriteYBits)) |
+                                 ((Uint64)sortY << cSpriteIndexBits) |
+                                 (Uint64)spriteIndex);
+    }
+
+    RadixSortSpriteKeys(queue.SortKeys, queue.SortScratch);
+
+    const int visibleCount = (int)queue.SortKeys.size();
+    int drawCallCount = 0;
+
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    queue.Vertices.resize(visibleCount * 4);
+
+    // every run of sprites starts at vertex 0, so the indices are the same for all of them
+    if((int)queue.Indices.size() < visibleCount * 6)
+    {
+        const int firstQuad = (int)queue.Indices.size() / 6;
+        queue.Indices.resize(visibleCount * 6);
+
+        for(int quadIndex = firstQuad; quadIndex < visibleCount; quadIndex++)
+        {
+            int* indices = &queue.Indices[quadIndex * 6];
+
+            indices[0] = quadIndex * 4 + 0;
+            indices[1] = quadIndex * 4 + 1;
+            indices[2] = quadIndex * 4 + 2;
+
+            indices[3] = quadIndex * 4 + 0;
+            indices[4] = quadIndex * 4 + 2;
+            indices[5] = quadIndex * 4 + 3;
+        }
+    }
+
+    int keyIndex = 0;
+
+    while(keyIndex < visibleCount)
+    {
+        // one SDL_RenderGeometry call for every sprite from here on that uses the same texture
+        SDL_Texture* texture = queue.Sprites[queue.SortKeys[keyIndex] & cSpriteIndexMask].Texture;
+
+        const IntVec2_t textureSize = InquireTextureSize(texture);
+        const float uScale = 1.0f / textureSize.X;
+        const float vScale = 1.0f / textureSize.Y;
+
+        int quadCount = 0;
+
+        for(; keyIndex < visibleCount; keyIndex++)
+        {
+            const Sprite_t& sprite = queue.Sprites[queue.SortKeys[keyIndex] & cSpriteIndexMask];
+
+            if(sprite.Texture != texture)
+            {
+                break;
+            }
+
+            SDL_Rect sourceRect;
+            SDL_Rect destRect;
+
+            // zoomed out far enough, a sprite can round away to nothing
+            if(ClipSpriteToView(sprite, relToMap_ViewTopLeft, viewSize_px, zoom, sourceRect, destRect))
+            {
+                SetQuadVertices(&queue.Vertices[quadCount * 4], sourceRect, destRect, uScale, vScale);
+                quadCount++;
+            }
+        }
+
+        if(quadCount > 0)
+        {
+            SDL_RenderGeometry(SDLGlobals.Renderer, texture, queue.Vertices.data(), quadCount * 4, queue.Indices.data(), quadCount * 6);
+            drawCallCount++;
+        }
+    }
+#else
+    // older SDL doesn't have SDL_RenderGeometry, but sorting still puts the copies from each texture together for SDL's own batching
+    for(Uint64 key : queue.SortKeys)
+    {
+        const Sprite_t& sprite = queue.Sprites[key & cSpriteIndexMask];
+
+        SDL_Rect sourceRect;
+        SDL_Rect destRect;
+
+        if(ClipSpriteToView(sprite, relToMap_ViewTopLeft, viewSize_px, zoom, sourceRect, destRect))
+        {
+            SDL_RenderCopy(SDLGlobals.Renderer, sprite.Texture, &sourceRect, &destRect);
+            drawCallCount++;
+        }
+    }
+#endif
+
+    FrameProfiler.Current.SpritesDrawn += visibleCount;
+    FrameProfiler.Current.RenderCopies += drawCallCount;
+
+    queue.LastDrawnCount = visibleCount;
+    queue.Sprites.clear();
+
+    return drawCallCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Map editing functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Tells everything drawn from a map that the tiles in area (in map tile coordinates) went from previousVersion to the map's current Version.
+//
+// Map render textures that have any of those tiles queue just them to be drawn again, and viewports that can't see any of them
+// are left alone. Anything that was already out of date (or was drawn from the map before something else changed it with WriteTile)
+// doesn't get caught up here, it gets redrawn in full like it would have anyway.
+static void InvalidateTileArea(const TileMap_t& tileMap, const SDL_Rect& area, Uint64 previousVersion)
+{
+    for(auto& entry : MapRenderCaches)
+    {
+        MapRenderCache_t& cache = entry.second;
+
+        if(!cache.Valid || cache.TileMap != &tileMap || cache.MapVersion != previousVersion)
+        {
+            continue;
+        }
+
+        SDL_Rect drawnEditedTiles = {0};
+
+        if(SDL_IntersectRect(&cache.Tiles, &area, &drawnEditedTiles))
+        {
+            for(int rowIndex = drawnEditedTiles.y; rowIndex < drawnEditedTiles.y + drawnEditedTiles.h; rowIndex++)
+            {
+                for(int columnIndex = drawnEditedTiles.x; columnIndex < drawnEditedTiles.x + drawnEditedTiles.w; columnIndex++)
+                {
+                    MarkPendingTile(cache, columnIndex, rowIndex);
+                }
+            }
+        }
+
+        cache.MapVersion = tileMap.Version;
+    }
+
+    InvalidateChunkThumbnails(tileMap, previousVersion, [&](const SDL_Rect& chunkTiles)
+    {
+        return SDL_HasIntersection(&chunkTiles, &area) == SDL_TRUE;
+    });
+
+    const IntVec2_t mapSize_px = GetMapSize_px(tileMap);
+    const SDL_Rect wholeMap_MapPx = {0, 0, mapSize_px.X, mapSize_px.Y};
+    const SDL_Rect area_MapPx = {area.x * cGridSize_px, area.y * cGridSize_px, area.w * cGridSize_px, area.h * cGridSize_px};
+
+    for(auto& entry : ViewportRenderStates)
+    {
+        ViewportRenderState_t& state = entry.second;
+
+        int layerIndex = 0;
+
+        while(layerIndex < state.LayerCount && state.Layers[layerIndex] != &tileMap)
+        {
+            layerIndex++;
+        }
+
+        if(layerIndex == state.LayerCount || state.LayerVersions[layerIndex] != previousVersion)
+        {
+            continue;
+        }
+
+        // not GetMapRenderRectangle, that comes back empty for a window that's bigger than the whole map
+        const IntVec2_t viewSize_px = GetZoomedWindowSize_px({state.WindowSize_Tiles.X * cGridSize_px, state.WindowSize_Tiles.Y * cGridSize_px}, state.Zoom);
+        const SDL_Rect window_MapPx = {state.WindowTopLeft_px.X - cMapOrigin.X, state.WindowTopLeft_px.Y - cMapOrigin.Y, viewSize_px.X, viewSize_px.Y};
+
+        SDL_Rect visibleArea_MapPx = {0};
+        SDL_IntersectRect(&window_MapPx, &wholeMap_MapPx, &visibleArea_MapPx);
+
+        // a viewport that can see an edited tile stays on the old version, so ViewportNeedsRedraw says it needs redrawing
+        if(!SDL_HasIntersection(&visibleArea_MapPx, &area_MapPx))
+        {
+            state.LayerVersions[layerIndex] = tileMap.Version;
+        }
+    }
+}
+
+// Changes the tiles in area (in map tile coordinates) to tileIds (area.w x area.h of them, row major), and has just the windows
+// that can see them redraw just them. Any part of area that's off the map is ignored.
+//
+// Use this instead of WriteTile for anything that changes a map while it's being shown, e.g., an editor or destructible terrain.
+void SetTiles(TileMap_t& tileMap, const SDL_Rect& area, const TileId_t* tileIds)
+{
+    const SDL_Rect wholeMap = {0, 0, tileMap.Size_Tiles.X, tileMap.Size_Tiles.Y};
+    SDL_Rect clippedArea = {0};
+
+    if(!SDL_IntersectRect(&area, &wholeMap, &clippedArea))
+    {
+        return;
+    }
+
+    const Uint64 previousVersion = tileMap.Version;
+
+    for(int rowIndex = clippedArea.y; rowIndex < clippedArea.y + clippedArea.h; rowIndex++)
+    {
+        const TileId_t* rowTileIds = &tileIds[(size_t)(rowIndex - area.y) * area.w];
+
+        for(int columnIndex = clippedArea.x; columnIndex < clippedArea.x + clippedArea.w; columnIndex++)
+        {
+            WriteTile(tileMap, {columnIndex, rowIndex}, rowTileIds[columnIndex - area.x]);
+        }
+    }
+
+    // nothing actually changed
+    if(tileMap.Version == previousVersion)
+    {
+        return;
+    }
+
+    InvalidateTileArea(tileMap, clippedArea, previousVersion);
+}
+
+void SetTile(TileMap_t& tileMap, const IntVec2_t& tileCoordinate, TileId_t tileId)
+{
+    const SDL_Rect area = {tileCoordinate.X, tileCoordinate.Y, 1, 1};
+
+    SetTiles(tileMap, area, &tileId);
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Tile animation functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// which frame of the animation is showing at time_ms
+static int FindAnimationFrame(const TileAnimation_t& animation, Uint64 time_ms)
+{
+    Uint32 intoLoop_ms = (Uint32)(time_ms % animation.Length_ms);
+
+    int frameIndex = 0;
+
+    while(intoLoop_ms >= animation.Frames[frameIndex].Duration_ms)
+    {
+        intoLoop_ms -= animation.Frames[frameIndex].Duration_ms;
+        frameIndex++;
+    }
+
+    return frameIndex;
+}
+
+// Calls found(x, y) for every tile in area (in map tile coordinates) whose ID is marked in tileIdMarks, a chunk at a time like BatchTileArea.
+// found returns false to stop looking. Returns true if anything was found.
+template<typename FoundFn>
+static bool FindMarkedTiles(const TileMap_t& tileMap, const SDL_Rect& area, const std::vector<Uint8>& tileIdMarks, FoundFn found)
+{
+    bool foundAny = false;
+
+    if(area.w <= 0 || area.h <= 0)
+    {
+        return false;
+    }
+
+    const IntVec2_t firstChunk = ChunkCoordinateForTile({area.x, area.y});
+    const IntVec2_t lastChunk = ChunkCoordinateForTile({area.x + area.w - 1, area.y + area.h - 1});
+
+    for(int chunkRow = firstChunk.Y; chunkRow <= lastChunk.Y; chunkRow++)
+    {
+        for(int chunkColumn = firstChunk.X; chunkColumn <= lastChunk.X; chunkColumn++)
+        {
+            const TileChunk_t* chunk = FindChunk(tileMap, {chunkColumn, chunkRow});
+
+            if(chunk == nullptr)
+            {
+                continue;
+            }
+
+            const IntVec2_t chunkTopLeft_Tiles = {chunkColumn * TILE_CHUNK_SIZE, chunkRow * TILE_CHUNK_SIZE};
+
+            const int firstRow = max(area.y, chunkTopLeft_Tiles.Y);
+            const int lastRow = min(area.y + area.h, chunkTopLeft_Tiles.Y + TILE_CHUNK_SIZE) - 1;
+            const int firstColumn = max(area.x, chunkTopLeft_Tiles.X);
+            const int lastColumn = min(area.x + area.w, chunkTopLeft_Tiles.X + TILE_CHUNK_SIZE) - 1;
+
+            for(int rowIndex = firstRow; rowIndex <= lastRow; rowIndex++)
+            {
+                const TileId_t* chunkRowTiles = &chunk->Tiles[(rowIndex - chunkTopLeft_Tiles.Y) * TILE_CHUNK_SIZE];
+
+                for(int columnIndex = firstColumn; columnIndex <= lastColumn; columnIndex++)
+                {
+                    if(!tileIdMarks[chunkRowTiles[columnIndex - chunkTopLeft_Tiles.X]])
+                    {
+                        continue;
+                    }
+
+                    foundAny = true;
+
+                    if(!found(columnIndex, rowIndex))
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return foundAny;
+}
+
+// Puts every animated tile in the map on the frame it should be showing at time_ms (see GetFrameTime_ms), returns how many animations changed frame.
+//
+// Nothing is drawn here. Map render textures that have a tile that changed queue just those tiles to be drawn again (like SetTiles does),
+// and viewports that can't see any of them stay clean, so a tick where a torch flickers somewhere offscreen costs no drawing at all.
+int UpdateTileAnimations(TileMap_t& tileMap, Uint64 time_ms)
+{
+    ChangedTileIds.assign(tileMap.TileSources.size(), 0);
+
+    int changedCount = 0;
+
+    for(TileAnimation_t& animation : tileMap.Animations)
+    {
+        const int frameIndex = FindAnimationFrame(animation, time_ms);
+
+        if(frameIndex == animation.CurrentFrame)
+        {
+            continue;
+        }
+
+        animation.CurrentFrame = frameIndex;
+        tileMap.TileSources[animation.TileId] = animation.Frames[frameIndex].Source;
+
+        ChangedTileIds[animation.TileId] = 1;
+        changedCount++;
+    }
+
+    if(changedCount == 0)
+    {
+        return 0;
+    }
+
+    // the tile IDs didn't change but what they look like did, so it's still a new version of the map
+    const Uint64 previousVersion = tileMap.Version;
+    tileMap.Version++;
+
+    for(auto& entry : MapRenderCaches)
+    {
+        MapRenderCache_t& cache = entry.second;
+
+        if(!cache.Valid || cache.TileMap != &tileMap || cache.MapVersion != previousVersion)
+        {
+            continue;
+        }
+
+        FindMarkedTiles(tileMap, cache.Tiles, ChangedTileIds, [&](int x, int y)
+        {
+            MarkPendingTile(cache, x, y);
+            return true;
+        });
+
+        cache.MapVersion = tileMap.Version;
+    }
+
+    InvalidateChunkThumbnails(tileMap, previousVersion, [&](const SDL_Rect& chunkTiles)
+    {
+        return FindMarkedTiles(tileMap, chunkTiles, ChangedTileIds, [](int, int)
+        {
+            return false;
+        });
+    });
+
+    const IntVec2_t mapSize_px = GetMapSize_px(tileMap);
+    const SDL_Rect wholeMap_MapPx = {0, 0, mapSize_px.X, mapSize_px.Y};
+
+    for(auto& entry : ViewportRenderStates)
+    {
+        ViewportRenderState_t& state = entry.second;
+
+        int layerIndex = 0;
+
+        while(layerIndex < state.LayerCount && state.Layers[layerIndex] != &tileMap)
+        {
+            layerIndex++;
+        }
+
+        if(layerIndex == state.LayerCount || state.LayerVersions[layerIndex] != previousVersion)
+        {
+            continue;
+        }
+
+        const IntVec2_t viewSize_px = GetZoomedWindowSize_px({state.WindowSize_Tiles.X * cGridSize_px, state.WindowSize_Tiles.Y * cGridSize_px}, state.Zoom);
+        const SDL_Rect window_MapPx = {state.WindowTopLeft_px.X - cMapOrigin.X, state.WindowTopLeft_px.Y - cMapOrigin.Y, viewSize_px.X, viewSize_px.Y};
+
+        SDL_Rect visibleArea_MapPx = {0};
+
+        if(!SDL_IntersectRect(&window_MapPx, &wholeMap_MapPx, &visibleArea_MapPx))
+        {
+            state.LayerVersions[layerIndex] = tileMap.Version;
+            continue;
+        }
+
+        // every tile the visible area touches
+        const IntVec2_t firstTile = FindGridCoordinateForPoint({visibleArea_MapPx.x, visibleArea_MapPx.y}, cGridSize_px);
+        const IntVec2_t endTile = FindGridCoordinateForPoint_RoundUp({visibleArea_MapPx.x + visibleArea_MapPx.w, visibleArea_MapPx.y + visibleArea_MapPx.h}, cGridSize_px);
+        const SDL_Rect visibleTiles = {firstTile.X, firstTile.Y, endTile.X - firstTile.X, endTile.Y - firstTile.Y};
+
+        // one is enough, the viewport stays on the old version so ViewportNeedsRedraw says it needs redrawing
+        const bool canSeeChange = FindMarkedTiles(tileMap, visibleTiles, ChangedTileIds, [](int, int)
+        {
+            return false;
+        });
+
+        if(!canSeeChange)
+        {
+            state.LayerVersions[layerIndex] = tileMap.Version;
+        }
+    }
+
+    return changedCount;
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Spatial index functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Sets up an empty grid over a map mapSize_px big, with cells cellSize_Tiles tiles square. Cells a few times bigger than a typical
+// entity work well: small enough that a window's cells don't hold many entities it can't see, big enough that entities don't change cell every frame.
+void InitSpatialGrid(SpatialGrid_t& grid, const IntVec2_t& mapSize_px, int cellSize_Tiles)
+{
+    assert(cellSize_Tiles > 0);
+
+    grid.CellSize_px = cellSize_Tiles * cGridSize_px;
+
+    const IntVec2_t size_Cells = FindGridCoordinateForPoint_RoundUp(mapSize_px, grid.CellSize_px);
+    grid.Size_Cells = {max(1, size_Cells.X), max(1, size_Cells.Y)};
+
+    grid.CellHeads.assign((size_t)grid.Size_Cells.X * grid.Size_Cells.Y, -1);
+    grid.Entities.clear();
+    grid.FreeEntityIds.clear();
+    grid.MaxEntitySize_px = {0, 0};
+}
+
+// The cell a point (in map px) is in, points off the map go in the nearest cell along the edge
+static inline IntVec2_t FindSpatialGridCell(const SpatialGrid_t& grid, const IntVec2_t& point)
+{
+    // points off the map go in the nearest cell on it
+    const IntVec2_t cell = FindGridCoordinateForPoint(point, grid.CellSize_px);
+
+    return {max(0, min(cell.X, grid.Size_Cells.X - 1)), max(0, min(cell.Y, grid.Size_Cells.Y - 1))};
+}
+
+static void LinkGridEntity(SpatialGrid_t& grid, int entityId, int cellIndex)
+{
+    GridEntity_t& entity = grid.Entities[entityId];
+
+    entity.Cell = cellIndex;
+    entity.PreviousInCell = -1;
+    entity.NextInCell = grid.CellHeads[cellIndex];
+
+    if(entity.NextInCell != -1)
+    {
+        grid.Entities[entity.NextInCell].PreviousInCell = entityId;
+    }
+
+    grid.CellHeads[cellIndex] = entityId;
+}
+
+static void UnlinkGridEntity(SpatialGrid_t& grid, int entityId)
+{
+    GridEntity_t& entity = grid.Entities[entityId];
+
+    if(entity.PreviousInCell != -1)
+    {
+        grid.Entities[entity.PreviousInCell].NextInCell = entity.NextInCell;
+    }
+    else
+    {
+        grid.CellHeads[entity.Cell] = entity.NextInCell;
+    }
+
+    if(entity.NextInCell != -1)
+    {
+        grid.Entities[entity.NextInCell].PreviousInCell = entity.PreviousInCell;
+    }
+
+    entity.Cell = -1;
+    entity.PreviousInCell = -1;
+    entity.NextInCell = -1;
+}
+
+static inline int GetSpatialGridCellIndex(const SpatialGrid_t& grid, const SDL_Rect& bounds)
+{
+    const IntVec2_t cell = FindSpatialGridCell(grid, {bounds.x, bounds.y});
+
+    return cell.Y * grid.Size_Cells.X + cell.X;
+}
+
+// Puts an entity in the grid, bounds is in map px. Returns its entity ID, which stays the same until it's removed (then it gets reused).
+int AddEntity(SpatialGrid_t& grid, const SDL_Rect& bounds)
+{
+    assert(bounds.w >= 0 && bounds.h >= 0);
+
+    int entityId = 0;
+
+    if(!grid.FreeEntityIds.empty())
+    {
+        entityId = grid.FreeEntityIds.back();
+        grid.FreeEntityIds.pop_back();
+    }
+    else
+    {
+        entityId = (int)grid.Entities.size();
+        grid.Entities.push_back({});
+    }
+
+    grid.Entities[entityId].Bounds = bounds;
+    grid.MaxEntitySize_px = {max(grid.MaxEntitySize_px.X, bounds.w), max(grid.MaxEntitySize_px.Y, bounds.h)};
+
+    LinkGridEntity(grid, entityId, GetSpatialGridCellIndex(grid, bounds));
+
+    return entityId;
+}
+
+// Moves (and / or resizes) an entity, O(1) however many entities there are
+void MoveEntity(SpatialGrid_t& grid, int entityId, const SDL_Rect& bounds)
+{
+    assert(bounds.w >= 0 && bounds.h >= 0);
+    assert(grid.Entities[entityId].Cell != -1);
+
+    grid.Entities[entityId].Bounds = bounds;
+    grid.MaxEntitySize_px = {max(grid.MaxEntitySize_px.X, bounds.w), max(grid.MaxEntitySize_px.Y, bounds.h)};
+
+    const int cellIndex = GetSpatialGridCellIndex(grid, bounds);
+
+    // most moves stay in the same cell
+    if(cellIndex != grid.Entities[entityId].Cell)
+    {
+        UnlinkGridEntity(grid, entityId);
+        LinkGridEntity(grid, entityId, cellIndex);
+    }
+}
+
+void RemoveEntity(SpatialGrid_t& grid, int entityId)
+{
+    assert(grid.Entities[entityId].Cell != -1);
+
+    UnlinkGridEntity(grid, entityId);
+    grid.FreeEntityIds.push_back(entityId);
+}
+
+// Finds every entity a window (top left corner relative to the map, in map px) can see, and the part of each one that's in it.
+// visible is cleared first, returns how many were found. They come out a cell at a time, in no particular order within a cell.
+//
+// Only the cells under the window (plus MaxEntitySize_px up and to the left of it) are looked at, so this costs about the same
+// however big the rest of the world is.
+int QueryWindow(const SpatialGrid_t& grid, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize_px, std::vector<VisibleEntity_t>& visible)
+{
+    visible.clear();
+
+    if(windowSize_px.X <= 0 || windowSize_px.Y <= 0)
+    {
+        return 0;
+    }
+
+    // an entity filed further up or left than this can't reach the window, and one filed past the window's last px starts after it
+    const IntVec2_t firstCell = FindSpatialGridCell(grid, {relToMap_WindowTopLeft.X - grid.MaxEntitySize_px.X, relToMap_WindowTopLeft.Y - grid.MaxEntitySize_px.Y});
+    const IntVec2_t lastCell = FindSpatialGridCell(grid, {relToMap_WindowTopLeft.X + windowSize_px.X - 1, relToMap_WindowTopLeft.Y + windowSize_px.Y - 1});
+
+    for(int cellY = firstCell.Y; cellY <= lastCell.Y; cellY++)
+    {
+        for(int cellX = firstCell.X; cellX <= lastCell.X; cellX++)
+        {
+            for(int entityId = grid.CellHeads[cellY * grid.Size_Cells.X + cellX]; entityId != -1; entityId = grid.Entities[entityId].NextInCell)
+            {
+                const SDL_Rect& bounds = grid.Entities[entityId].Bounds;
+
+                // the part of the entity in the window, relative to the window
+                const IntVec2_t spanX = ClipSpan(bounds.x - relToMap_WindowTopLeft.X, bounds.w, windowSize_px.X);
+                const IntVec2_t spanY = ClipSpan(bounds.y - relToMap_WindowTopLeft.Y, bounds.h, windowSize_px.Y);
+
+                if(spanX.Y == 0 || spanY.Y == 0)
+                {
+                    continue;
+                }
+
+                VisibleEntity_t visibleEntity = {0};
+                visibleEntity.EntityId = entityId;
+                visibleEntity.DestRect = {spanX.X, spanY.X, spanX.Y, spanY.Y};
+                visibleEntity.SourceRect = {spanX.X + relToMap_WindowTopLeft.X - bounds.x, spanY.X + relToMap_WindowTopLeft.Y - bounds.y, spanX.Y, spanY.Y};
+
+                visible.push_back(visibleEntity);
+            }
+        }
+    }
+
+    return (int)visible.size();
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// CPU compositor functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// The same pipeline as RenderMapToTexture + CopyRenderedMapToScreen, but drawn by the CPU straight into PixelBuffer_ts,
+// no SDL_Renderer (or GPU) needed. Good for map thumbnails and viewport snapshots on a headless machine.
+//
+// The output is pixel for pixel what the SDL path puts in the screen render texture. Tiles with translucent pixels are blended
+// the way SDL's software renderer does it, GPU renderers can round those a little differently.
+
+// same colors as RenderMapRegion and CopyMapAreaToScreen, in RGBA8888
+const Uint32 cMapBackgroundPixel = 0x00FFFFFF;
+const Uint32 cScreenBackgroundPixel = 0xFFB400FF;
+
+// what the layers over the bottom one are cleared to, see SetMapBackgroundDrawColor
+const Uint32 cLayerBackgroundPixel = 0x00000000;
+
+void ResizePixelBuffer(PixelBuffer_t& buffer, const IntVec2_t& size_px)
+{
+    buffer.Size_px = size_px;
+    buffer.Pixels.resize((size_t)size_px.X * size_px.Y);
+}
+
+void FillPixelBuffer(PixelBuffer_t& buffer, Uint32 pixel)
+{
+    std::fill(buffer.Pixels.begin(), buffer.Pixels.end(), pixel);
+}
+
+// Shrinks source by half each way (rounding up) into dest, for the next mip level down. Every pixel is the average of the 2x2 it covers,
+// with the colors weighted by alpha so see through pixels don't darken the edges of what's next to them.
+// Along an odd right or bottom edge the last row / column is counted twice.
+void HalvePixelBuffer(PixelBuffer_t& dest, const PixelBuffer_t& source)
+{
+    ResizePixelBuffer(dest, {(source.Size_px.X + 1) / 2, (source.Size_px.Y + 1) / 2});
+
+    for(int rowIndex = 0; rowIndex < dest.Size_px.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < dest.Size_px.X; columnIndex++)
+        {
+            Uint32 alphaSum = 0;
+            Uint32 channelSums[3] = {0};
+
+            for(int cornerIndex = 0; cornerIndex < 4; cornerIndex++)
+            {
+                const int sourceX = min(columnIndex * 2 + (cornerIndex & 1), source.Size_px.X - 1);
+                const int sourceY = min(rowIndex * 2 + (cornerIndex >> 1), source.Size_px.Y - 1);
+                const Uint32 pixel = source.Pixels[(size_t)sourceY * source.Size_px.X + sourceX];
+                const Uint32 alpha = pixel & 0xFF;
+
+                alphaSum += alpha;
+
+                for(int channelIndex = 0; channelIndex < 3; channelIndex++)
+                {
+                    channelSums[channelIndex] += ((pixel >> (8 * (channelIndex + 1))) & 0xFF) * alpha;
+                }
+            }
+
+            Uint32 halved = (alphaSum + 2) / 4;
+
+            for(int channelIndex = 0; alphaSum > 0 && channelIndex < 3; channelIndex++)
+            {
+                halved |= ((channelSums[channelIndex] + alphaSum / 2) / alphaSum) << (8 * (channelIndex + 1));
+            }
+
+            dest.Pixels[(size_t)rowIndex * dest.Size_px.X + columnIndex] = halved;
+        }
+    }
+}
+
+// Loads an image file into buffer, returns false if it couldn't be loaded
+bool LoadPixelBuffer(PixelBuffer_t& buffer, const char* path)
+{
+    SDL_Surface* image = IMG_Load(path);
+
+    if(image == nullptr)
+    {
+        printf("Image '%s' could not be loaded. SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(image, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(image);
+
+    if(converted == nullptr)
+    {
+        printf("Image '%s' could not be converted to RGBA8888. SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    ResizePixelBuffer(buffer, {converted->w, converted->h});
+
+    SDL_LockSurface(converted);
+
+    for(int rowIndex = 0; rowIndex < converted->h; rowIndex++)
+    {
+        memcpy(&buffer.Pixels[(size_t)rowIndex * converted->w], (const Uint8*)converted->pixels + (size_t)rowIndex * converted->pitch, converted->w * sizeof(Uint32));
+    }
+
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+
+    return true;
+}
+
+// Works out which cells of a tileset's image are fully opaque, has to be called whenever the image changes
+void UpdateOpaqueCells(CpuTileSet_t& tileSet)
+{
+    tileSet.Size_Cells = FindGridCoordinateForPoint_RoundUp(tileSet.Image.Size_px, cGridSize_px);
+    tileSet.OpaqueCells.assign((size_t)tileSet.Size_Cells.X * tileSet.Size_Cells.Y, 1);
+
+    for(int rowIndex = 0; rowIndex < tileSet.Image.Size_px.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < tileSet.Image.Size_px.X; columnIndex++)
+        {
+            if((tileSet.Image.Pixels[(size_t)rowIndex * tileSet.Image.Size_px.X + columnIndex] & 0xFF) != 0xFF)
+            {
+                tileSet.OpaqueCells[(rowIndex / cGridSize_px) * tileSet.Size_Cells.X + columnIndex / cGridSize_px] = 0;
+            }
+        }
+    }
+}
+
+// Writes a buffer out as a PNG, returns false if it couldn't be saved
+bool SavePixelBuffer(const PixelBuffer_t& buffer, const char* path)
+{
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)buffer.Pixels.data(), buffer.Size_px.X, buffer.Size_px.Y, 32, buffer.Size_px.X * (int)sizeof(Uint32), SDL_PIXELFORMAT_RGBA8888);
+
+    if(surface == nullptr || IMG_SavePNG(surface, path) != 0)
+    {
+        printf("Couldn't save '%s'. SDL Error: %s\n", path, SDL_GetError());
+        SDL_FreeSurface(surface);
+        return false;
+    }
+
+    SDL_FreeSurface(surface);
+    return true;
+}
+
+// true if every pixel of sourceRect in the tileset is opaque
+static bool IsTileSetAreaOpaque(const CpuTileSet_t& tileSet, const SDL_Rect& sourceRect)
+{
+    // a tile source from a map file can hang off the page, BlitPixels clips that part away so it doesn't count here either
+    const IntVec2_t firstCell = FindGridCoordinateForPoint({max(0, sourceRect.x), max(0, sourceRect.y)}, cGridSize_px);
+    const IntVec2_t endCell = FindGridCoordinateForPoint_RoundUp({sourceRect.x + sourceRect.w, sourceRect.y + sourceRect.h}, cGridSize_px);
+
+    for(int cellY = firstCell.Y; cellY < min(endCell.Y, tileSet.Size_Cells.Y); cellY++)
+    {
+        for(int cellX = firstCell.X; cellX < min(endCell.X, tileSet.Size_Cells.X); cellX++)
+        {
+            if(!tileSet.OpaqueCells[cellY * tileSet.Size_Cells.X + cellX])
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void CopyPixelRow_Scalar(Uint32* dest, const Uint32* src, int count)
+{
+    memcpy(dest, src, count * sizeof(Uint32));
+}
+
+#ifdef HAVE_SSE2
+// 4 px per 16 byte copy, so a 16 px tile row is 4 loads and 4 stores
+static void CopyPixelRow_SSE2(Uint32* dest, const Uint32* src, int count)
+{
+    int pixelIndex = 0;
+
+    for(; pixelIndex + 4 <= count; pixelIndex += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dest + pixelIndex), _mm_loadu_si128((const __m128i*)(src + pixelIndex)));
+    }
+
+    CopyPixelRow_Scalar(dest + pixelIndex, src + pixelIndex, count - pixelIndex);
+}
+
+// 8 px per 32 byte copy, so a 16 px tile row is 2 loads and 2 stores
+TARGET_AVX2 static void CopyPixelRow_AVX2(Uint32* dest, const Uint32* src, int count)
+{
+    int pixelIndex = 0;
+
+    for(; pixelIndex + 8 <= count; pixelIndex += 8)
+    {
+        _mm256_storeu_si256((__m256i*)(dest + pixelIndex), _mm256_loadu_si256((const __m256i*)(src + pixelIndex)));
+    }
+
+    for(; pixelIndex + 4 <= count; pixelIndex += 4)
+    {
+        _mm_storeu_si128((__m128i*)(dest + pixelIndex), _mm_loadu_si128((const __m128i*)(src + pixelIndex)));
+    }
+
+    CopyPixelRow_Scalar(dest + pixelIndex, src + pixelIndex, count - pixelIndex);
+}
+#endif
+
+typedef void (*CopyPixelRowFn_t)(Uint32* dest, const Uint32* src, int count);
+
+// the widest row copy the CPU supports, picked once
+static CopyPixelRowFn_t GetCopyPixelRow()
+{
+#ifdef HAVE_SSE2
+    static const CopyPixelRowFn_t copyPixelRow = (SDL_HasAVX2() == SDL_TRUE) ? CopyPixelRow_AVX2 : CopyPixelRow_SSE2;
+    return copyPixelRow;
+#else
+    return CopyPixelRow_Scalar;
+#endif
+}
+
+// SDL_BLENDMODE_BLEND the way SDL's software blitters do it: dstRGB = srcRGB * srcA + dstRGB * (1 - srcA), dstA = srcA + dstA * (1 - srcA)
+static void BlendPixelRow(Uint32* dest, const Uint32* src, int count)
+{
+    for(int pixelIndex = 0; pixelIndex < count; pixelIndex++)
+    {
+        const Uint32 srcPixel = src[pixelIndex];
+        const Uint32 srcAlpha = srcPixel & 0xFF;
+
+        if(srcAlpha == 0xFF)
+        {
+            dest[pixelIndex] = srcPixel;
+            continue;
+        }
+
+        const Uint32 destPixel = dest[pixelIndex];
+        Uint32 blended = srcAlpha + (((0xFF - srcAlpha) * (destPixel & 0xFF)) / 0xFF);
+
+        for(int shift = 8; shift < 32; shift += 8)
+        {
+            const Uint32 srcChannel = (((srcPixel >> shift) & 0xFF) * srcAlpha) / 0xFF;
+            const Uint32 destChannel = (destPixel >> shift) & 0xFF;
+
+            blended |= (srcChannel + (((0xFF - srcAlpha) * destChannel) / 0xFF)) << shift;
+        }
+
+        dest[pixelIndex] = blended;
+    }
+}
+
+// Copies (or blends) sourceRect of source to destTopLeft in dest, 1:1 like an SDL_RenderCopy with same sized rects.
+// Anything hanging off either buffer is clipped off.
+static void BlitPixels(PixelBuffer_t& dest, const IntVec2_t& destTopLeft, const PixelBuffer_t& source, const SDL_Rect& sourceRect, bool blend)
+{
+    // clip against the source, then the destination, moving the other side along with it
+    const IntVec2_t sourceClipX = ClipSpan(sourceRect.x, sourceRect.w, source.Size_px.X);
+    const IntVec2_t sourceClipY = ClipSpan(sourceRect.y, sourceRect.h, source.Size_px.Y);
+
+    const IntVec2_t destClipX = ClipSpan(destTopLeft.X + (sourceClipX.X - sourceRect.x), sourceClipX.Y, dest.Size_px.X);
+    const IntVec2_t destClipY = ClipSpan(destTopLeft.Y + (sourceClipY.X - sourceRect.y), sourceClipY.Y, dest.Size_px.Y);
+
+    if(destClipX.Y == 0 || destClipY.Y == 0)
+    {
+        return;
+    }
+
+    const int sourceX = destClipX.X - destTopLeft.X + sourceRect.x;
+    const int sourceY = destClipY.X - destTopLeft.Y + sourceRect.y;
+
+    const CopyPixelRowFn_t copyPixelRow = blend ? BlendPixelRow : GetCopyPixelRow();
+
+    for(int rowIndex = 0; rowIndex < destClipY.Y; rowIndex++)
+    {
+        Uint32* destRow = &dest.Pixels[(size_t)(destClipY.X + rowIndex) * dest.Size_px.X + destClipX.X];
+        const Uint32* sourceRow = &source.Pixels[(size_t)(sourceY + rowIndex) * source.Size_px.X + sourceX];
+
+        copyPixelRow(destRow, sourceRow, destClipX.Y);
+    }
+}
+
+// Draws every tile in the batch into dest, the CPU version of SubmitTileBatch. The atlas has to have its CPU copies.
+void CPU_SubmitTileBatch(const TileBatch_t& batch, const TileAtlas_t& tileAtlas, PixelBuffer_t& dest)
+{
+    for(const TileDraw_t& draw : batch.Draws)
+    {
+        // tiles are never scaled
+        assert(draw.Source.w == draw.Dest.w && draw.Source.h == draw.Dest.h);
+
+        // same as SubmitTileBatch, a page the atlas doesn't have (a map file made for a different atlas) just isn't drawn
+        if(draw.Page < 0 || draw.Page >= (int)tileAtlas.CpuPages.size())
+        {
+            continue;
+        }
+
+        const CpuTileSet_t& page = tileAtlas.CpuPages[draw.Page];
+
+        BlitPixels(dest, {draw.Dest.x, draw.Dest.y}, page.Image, draw.Source, !IsTileSetAreaOpaque(page, draw.Source));
+    }
+}
+
+// The CPU version of RenderMapRegion: fills mapBuffer (sized one tile bigger than the window each way) with the tiles the window can see
+SDL_Rect CPU_RenderMapRegion(PixelBuffer_t& mapBuffer, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& northWestTile, const IntVec2_t& windowSize_Tiles, bool transparentBackground)
+{
+    ResizePixelBuffer(mapBuffer, {(windowSize_Tiles.X + 1) * cGridSize_px, (windowSize_Tiles.Y + 1) * cGridSize_px});
+    FillPixelBuffer(mapBuffer, transparentBackground ? cLayerBackgroundPixel : cMapBackgroundPixel);
+
+    ClearTileBatch(TileBatch);
+
+    const SDL_Rect renderedArea = DrawTiles(TileBatch, tileMap, northWestTile, windowSize_Tiles);
+
+    CPU_SubmitTileBatch(TileBatch, tileAtlas, mapBuffer);
+
+    return renderedArea;
+}
+
+// The CPU version of CopyRenderedMapToScreen: fills screenBuffer (sized to the window) with what the window sees
+void CPU_CopyRenderedMapToScreen(PixelBuffer_t& screenBuffer, const PixelBuffer_t& mapBuffer, const IntVec2_t& mapSize_px, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize, const SDL_Rect& renderedRectangle)
+{
+    const WindowClip_t clip = ComputeWindowClip(mapSize_px, relToMap_WindowTopLeft, windowSize, cGridSize_px);
+
+    assert(clip.RenderedRect.x == renderedRectangle.x && clip.RenderedRect.w == renderedRectangle.w);
+    assert(clip.RenderedRect.y == renderedRectangle.y && clip.RenderedRect.h == renderedRectangle.h);
+    (void)renderedRectangle;
+
+    ResizePixelBuffer(screenBuffer, windowSize);
+    FillPixelBuffer(screenBuffer, cScreenBackgroundPixel);
+
+    // the map render texture is drawn with no blending in the SDL path too
+    BlitPixels(screenBuffer, clip.DestOffset, mapBuffer, clip.SourceRect, false);
+}
+
+// Blends a layer over the bottom one (drawn by CPU_RenderMapRegion with a transparent background) onto what's already in screenBuffer
+void CPU_CompositeLayerToScreen(PixelBuffer_t& screenBuffer, const PixelBuffer_t& layerBuffer, const IntVec2_t& mapSize_px, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize)
+{
+    const WindowClip_t clip = ComputeWindowClip(mapSize_px, relToMap_WindowTopLeft, windowSize, cGridSize_px);
+
+    BlitPixels(screenBuffer, clip.DestOffset, layerBuffer, clip.SourceRect, true);
+}
+
+// Renders what a window would see of a map with layerCount layers (bottom first) into screenBuffer.
+// mapBuffer is scratch space, it's kept so it doesn't get reallocated every time.
+void CPU_RenderWindow(PixelBuffer_t& screenBuffer, PixelBuffer_t& mapBuffer, const TileAtlas_t& tileAtlas, const TileMap_t* const* layers, int layerCount, const IntVec2_t& windowSize_Tiles, const IntVec2_t& relToMap_WindowTopLeft)
+{
+    const IntVec2_t windowSize_px = {windowSize_Tiles.X * cGridSize_px, windowSize_Tiles.Y * cGridSize_px};
+    const IntVec2_t northWestTile = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+    const IntVec2_t mapSize_px = GetMapSize_px(*layers[0]);
+
+    const SDL_Rect renderedRectangle = CPU_RenderMapRegion(mapBuffer, tileAtlas, *layers[0], northWestTile, windowSize_Tiles, false);
+
+    CPU_CopyRenderedMapToScreen(screenBuffer, mapBuffer, mapSize_px, relToMap_WindowTopLeft, windowSize_px, renderedRectangle);
+
+    for(int layerIndex = 1; layerIndex < layerCount; layerIndex++)
+    {
+        CPU_RenderMapRegion(mapBuffer, tileAtlas, *layers[layerIndex], northWestTile, windowSize_Tiles, true);
+        CPU_CompositeLayerToScreen(screenBuffer, mapBuffer, mapSize_px, relToMap_WindowTopLeft, windowSize_px);
+    }
+}
+
+// Renders what a window would see of a one layer map into screenBuffer
+void CPU_RenderWindow(PixelBuffer_t& screenBuffer, PixelBuffer_t& mapBuffer, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& windowSize_Tiles, const IntVec2_t& relToMap_WindowTopLeft)
+{
+    const TileMap_t* const layers[] = {&tileMap};
+
+    CPU_RenderWindow(screenBuffer, mapBuffer, tileAtlas, layers, 1, windowSize_Tiles, relToMap_WindowTopLeft);
+}
+
+// The whole map at 1:1, with the map background color where there are no tiles
+void CPU_RenderMapThumbnail(PixelBuffer_t& buffer, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap)
+{
+    ResizePixelBuffer(buffer, GetMapSize_px(tileMap));
+    FillPixelBuffer(buffer, cMapBackgroundPixel);
+
+    ClearTileBatch(TileBatch);
+
+    const SDL_Rect wholeMap = {0, 0, tileMap.Size_Tiles.X, tileMap.Size_Tiles.Y};
+    BatchTileArea(TileBatch, tileMap, wholeMap, {0, 0}, tileMap.Size_Tiles);
+
+    CPU_SubmitTileBatch(TileBatch, tileAtlas, buffer);
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Tile atlas functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Works out where to put images of the given sizes in atlas pages no bigger than maxPageSize, using shelf packing:
+// images go in tallest first, left to right along a shelf as tall as the first image on it, and when one doesn't fit
+// across, a new shelf is started under the last one. When a page runs out of room for shelves, a new page is started.
+// Going tallest first keeps the space wasted above the shorter images on each shelf small.
+//
+// placements[i] is where sizes[i] goes, pageSizes gets the size of each page (only as big as what's on it).
+// Returns false if an image is bigger than a page.
+bool PackTileAtlas(const IntVec2_t* sizes, int imageCount, const IntVec2_t& maxPageSize, TileSource_t* placements, std::vector<IntVec2_t>& pageSizes)
+{
+    std::vector<int> packingOrder(imageCount);
+
+    for(int imageIndex = 0; imageIndex < imageCount; imageIndex++)
+    {
+        packingOrder[imageIndex] = imageIndex;
+    }
+
+    std::stable_sort(packingOrder.begin(), packingOrder.end(), [&](int a, int b) { return sizes[a].Y > sizes[b].Y; });
+
+    pageSizes.clear();
+
+    IntVec2_t shelfTopLeft = {0, 0};
+    int shelfHeight = 0;
+
+    for(int imageIndex : packingOrder)
+    {
+        const IntVec2_t& size = sizes[imageIndex];
+
+        if(size.X > maxPageSize.X || size.Y > maxPageSize.Y)
+        {
+            return false;
+        }
+
+        // doesn't fit across this shelf, start a new one underneath
+        if(shelfTopLeft.X + size.X > maxPageSize.X)
+        {
+            shelfTopLeft = {0, shelfTopLeft.Y + shelfHeight};
+            shelfHeight = 0;
+        }
+
+        // doesn't fit down this page (or there's no page yet), start a new page
+        if(pageSizes.empty() || shelfTopLeft.Y + size.Y > maxPageSize.Y)
+        {
+            pageSizes.push_back({0, 0});
+            shelfTopLeft = {0, 0};
+            shelfHeight = 0;
+        }
+
+        const int page = (int)pageSizes.size() - 1;
+
+        placements[imageIndex] = {page, {shelfTopLeft.X, shelfTopLeft.Y, size.X, size.Y}};
+
+        shelfTopLeft.X += size.X;
+        shelfHeight = max(shelfHeight, size.Y);
+
+        pageSizes[page].X = max(pageSizes[page].X, shelfTopLeft.X);
+        pageSizes[page].Y = max(pageSizes[page].Y, shelfTopLeft.Y + size.Y);
+    }
+
+    return true;
+}
+
+void DestroyTileAtlas(TileAtlas_t& atlas)
+{
+    for(SDL_Texture* page : atlas.Pages)
+    {
+        SDL_DestroyTexture(page);
+    }
+
+    for(std::vector<SDL_Texture*>& mipPages : atlas.MipPages)
+    {
+        for(SDL_Texture* page : mipPages)
+        {
+            SDL_DestroyTexture(page);
+        }
+    }
+
+    atlas = TileAtlas_t();
+}
+
+// Makes a texture out of an atlas page (or one of its mip levels), returns nullptr if it couldn't
+static SDL_Texture* CreateAtlasPageTexture(const PixelBuffer_t& image)
+{
+    SDL_Texture* texture = SDL_CreateTexture(SDLGlobals.Renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC, image.Size_px.X, image.Size_px.Y);
+
+    if(texture == nullptr)
+    {
+        printf("Couldn't create a %dx%d atlas page. SDL Error: %s\n", image.Size_px.X, image.Size_px.Y, SDL_GetError());
+        return nullptr;
+    }
+
+    SDL_UpdateTexture(texture, nullptr, image.Pixels.data(), image.Size_px.X * (int)sizeof(Uint32));
+
+    // tilesets can have see through pixels, SDL_CreateTextureFromSurface would do the same for an image with alpha
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    return texture;
+}
+
+// Loads the tileset images at paths, packs them into atlas pages (see PackTileAtlas) and makes a texture of each page,
+// and of each page's mip levels.
+// placements[i] is where the image at paths[i] ended up, AddTileSetTiles turns that into tile IDs for its tiles.
+//
+// If keepCpuCopies is set, the pages are kept in CPU memory as well, for the CPU compositor and ParallelMapRender.
+// Returns false (with the atlas left empty) if an image couldn't be loaded or packed.
+bool BuildTileAtlas(TileAtlas_t& atlas, const char* const* paths, int pathCount, TileSource_t* placements, bool keepCpuCopies, int maxPageSize_px = cMaxAtlasPageSize_px)
+{
+    DestroyTileAtlas(atlas);
+
+    std::vector<PixelBuffer_t> images(pathCount);
+    std::vector<IntVec2_t> sizes(pathCount);
+
+    for(int pathIndex = 0; pathIndex < pathCount; pathIndex++)
+    {
+        if(!LoadPixelBuffer(images[pathIndex], paths[pathIndex]))
+        {
+            return false;
+        }
+
+        sizes[pathIndex] = images[pathIndex].Size_px;
+    }
+
+    // no bigger than the renderer can handle
+    IntVec2_t maxPageSize = {maxPageSize_px, maxPageSize_px};
+    SDL_RendererInfo rendererInfo = {0};
+
+    if(SDL_GetRendererInfo(SDLGlobals.Renderer, &rendererInfo) == 0 && rendererInfo.max_texture_width > 0 && rendererInfo.max_texture_height > 0)
+    {
+        maxPageSize.X = min(maxPageSize.X, rendererInfo.max_texture_width);
+        maxPageSize.Y = min(maxPageSize.Y, rendererInfo.max_texture_height);
+    }
+
+    std::vector<IntVec2_t> pageSizes;
+
+    if(!PackTileAtlas(sizes.data(), pathCount, maxPageSize, placements, pageSizes))
+    {
+        printf("Couldn't pack the tilesets into %dx%d atlas pages, one of them is too big\n", maxPageSize.X, maxPageSize.Y);
+        return false;
+    }
+
+    std::vector<CpuTileSet_t> pages(pageSizes.size());
+
+    for(size_t page = 0; page < pages.size(); page++)
+    {
+        // transparent wherever nothing got packed
+        ResizePixelBuffer(pages[page].Image, pageSizes[page]);
+        FillPixelBuffer(pages[page].Image, 0);
+    }
+
+    for(int pathIndex = 0; pathIndex < pathCount; pathIndex++)
+    {
+        const TileSource_t& placement = placements[pathIndex];
+        const SDL_Rect wholeImage = {0, 0, sizes[pathIndex].X, sizes[pathIndex].Y};
+
+        BlitPixels(pages[placement.Page].Image, {placement.Rect.x, placement.Rect.y}, images[pathIndex], wholeImage, false);
+    }
+
+    for(CpuTileSet_t& page : pages)
+    {
+        SDL_Texture* texture = CreateAtlasPageTexture(page.Image);
+
+        if(texture == nullptr)
+        {
+            DestroyTileAtlas(atlas);
+            return false;
+        }
+
+        atlas.Pages.push_back(texture);
+
+        // each mip level is made from the one before it. Tileset images are whole tiles, so (as long as they're packed on
+        // tile boundaries) every tile still covers whole pixels at every level, just cGridSize_px >> level of them.
+        PixelBuffer_t previousLevel = page.Image;
+        PixelBuffer_t level;
+
+        for(int mipLevel = 1; mipLevel < TILE_MIP_LEVELS; mipLevel++)
+        {
+            HalvePixelBuffer(level, previousLevel);
+
+            SDL_Texture* mipTexture = CreateAtlasPageTexture(level);
+
+            if(mipTexture == nullptr)
+            {
+                DestroyTileAtlas(atlas);
+                return false;
+            }
+
+            atlas.MipPages[mipLevel - 1].push_back(mipTexture);
+
+            std::swap(level, previousLevel);
+        }
+    }
+
+    if(keepCpuCopies)
+    {
+        for(CpuTileSet_t& page : pages)
+        {
+            UpdateOpaqueCells(page);
+        }
+
+        atlas.CpuPages = std::move(pages);
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Worker pool functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Takes a job from queue queueIndex, or steals one from another queue if that one's empty. Returns -1 if there's no work anywhere.
+static int TakeJob(WorkerPool_t& pool, int queueIndex)
+{
+    {
+        WorkerQueue_t& ownQueue = pool.Queues[queueIndex];
+        std::lock_guard<std::mutex> lock(ownQueue.Lock);
+
+        if(!ownQueue.Jobs.empty())
+        {
+            const int job = ownQueue.Jobs.back();
+            ownQueue.Jobs.pop_back();
+            return job;
+        }
+    }
+
+    for(int offset = 1; offset < pool.QueueCount; offset++)
+    {
+        WorkerQueue_t& victimQueue = pool.Queues[(queueIndex + offset) % pool.QueueCount];
+        std::lock_guard<std::mutex> lock(victimQueue.Lock);
+
+        if(!victimQueue.Jobs.empty())
+        {
+            const int job = victimQueue.Jobs.front();
+            victimQueue.Jobs.pop_front();
+            return job;
+        }
+    }
+
+    return -1;
+}
+
+static void RunJobs(WorkerPool_t& pool, int queueIndex)
+{
+    int job = TakeJob(pool, queueIndex);
+
+    while(job >= 0)
+    {
+        pool.Job(job);
+        pool.JobsRemaining.fetch_sub(1, std::memory_order_release);
+
+        job = TakeJob(pool, queueIndex);
+    }
+}
+
+static void WorkerThreadMain(WorkerPool_t* pool, int queueIndex)
+{
+    Uint64 seenGeneration = 0;
+
+    while(1)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool->WakeLock);
+            pool->WakeSignal.wait(lock, [&]{ return pool->Quit || pool->Generation != seenGeneration; });
+
+            if(pool->Quit)
+            {
+                return;
+            }
+
+            seenGeneration = pool->Generation;
+        }
+
+        RunJobs(*pool, queueIndex);
+    }
+}
+
+// Starts one worker per core, not counting the core the caller is on
+void StartWorkerPool(WorkerPool_t& pool)
+{
+    if(pool.QueueCount != 0)
+    {
+        return;
+    }
+
+    pool.QueueCount = max(1, SDL_GetCPUCount());
+    pool.Queues.reset(new WorkerQueue_t[pool.QueueCount]);
+    pool.Generation = 0;
+    pool.Quit = false;
+    pool.JobsRemaining = 0;
+
+    for(int queueIndex = 1; queueIndex < pool.QueueCount; queueIndex++)
+    {
+        pool.Threads.emplace_back(WorkerThreadMain, &pool, queueIndex);
+    }
+}
+
+void StopWorkerPool(WorkerPool_t& pool)
+{
+    {
+        std::lock_guard<std::mutex> lock(pool.WakeLock);
+        pool.Quit = true;
+    }
+
+    pool.WakeSignal.notify_all();
+
+    for(std::thread& thread : pool.Threads)
+    {
+        thread.join();
+    }
+
+    pool.Threads.clear();
+    pool.Queues.reset();
+    pool.QueueCount = 0;
+}
+
+// Calls job(0) ... job(jobCount - 1) spread across the pool, and waits for all of them to finish.
+// The jobs are handed out in contiguous runs (queue 0 gets the first run, and so on), idle workers steal from the others.
+void ParallelFor(WorkerPool_t& pool, int jobCount, const std::function<void(int)>& job)
+{
+    StartWorkerPool(pool);
+
+    pool.Job = job;
+    pool.JobsRemaining.store(jobCount, std::memory_order_relaxed);
+
+    for(int queueIndex = 0; queueIndex < pool.QueueCount; queueIndex++)
+    {
+        WorkerQueue_t& queue = pool.Queues[queueIndex];
+        std::lock_guard<std::mutex> lock(queue.Lock);
+
+        const int firstJob = (int)((long long)jobCount * queueIndex / pool.QueueCount);
+        const int endJob = (int)((long long)jobCount * (queueIndex + 1) / pool.QueueCount);
+
+        // pushed in reverse, so the owner (taking off the back) goes through its run in order
+        for(int jobIndex = endJob - 1; jobIndex >= firstJob; jobIndex--)
+        {
+            queue.Jobs.push_back(jobIndex);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(pool.WakeLock);
+        pool.Generation++;
+    }
+
+    pool.WakeSignal.notify_all();
+
+    RunJobs(pool, 0);
+
+    // everything's been taken, but other threads could still be finishing theirs
+    while(pool.JobsRemaining.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::yield();
+    }
+}
+
+// Same result as RenderMapRegion / RenderMapRegionIncremental (depending on IncrementalMapRender), but the tiles are drawn by
+// the CPU compositor in bands of texture rows, one ParallelFor job per band, then the whole thing is uploaded with one SDL_UpdateTexture.
+//
+// Every row of the texture is redrawn each time, so in incremental mode this keeps the ring buffer layout but doesn't save any drawing.
+SDL_Rect RenderMapRegionParallel(SDL_Texture* mapRenderTexture, const TileAtlas_t& tileAtlas, const TileMap_t& tileMap, const IntVec2_t& northWestTile, const IntVec2_t& windowSize_Tiles, bool transparentBackground)
+{
+    const IntVec2_t textureSize_px = InquireTextureSize(mapRenderTexture);
+    const IntVec2_t textureSize_Tiles = {textureSize_px.X / cGridSize_px, textureSize_px.Y / cGridSize_px};
+
+    const SDL_Rect neededTiles = GetTileRangeToRender(northWestTile, windowSize_Tiles, tileMap.Size_Tiles);
+
+    // which slot map tile (x, y) goes in, see BatchTileArea. The ring buffer wraps around the whole texture,
+    // otherwise the top left tile goes in the top left like DrawTiles does it.
+    const IntVec2_t destOrigin_Tiles = IncrementalMapRender ? IntVec2_t{0, 0} : IntVec2_t{neededTiles.x, neededTiles.y};
+    const IntVec2_t destSize_Tiles = IncrementalMapRender ? textureSize_Tiles : IntVec2_t{windowSize_Tiles.X + 1, windowSize_Tiles.Y + 1};
+
+    assert(neededTiles.w <= destSize_Tiles.X && neededTiles.h <= destSize_Tiles.Y);
+
+    ResizePixelBuffer(MapStagingBuffer, textureSize_px);
+
+    // a few bands per thread so there's something left to steal when the bands take different amounts of time
+    const int bandHeight_Tiles = max(1, textureSize_Tiles.Y / (max(1, SDL_GetCPUCount()) * 4));
+    const int bandCount = (textureSize_Tiles.Y + bandHeight_Tiles - 1) / bandHeight_Tiles;
+
+    if((int)BandTileBatches.size() < bandCount)
+    {
+        BandTileBatches.resize(bandCount);
+    }
+
+    // same background as RenderMapRegion
+    const Uint32 backgroundPixel = transparentBackground ? cLayerBackgroundPixel : cMapBackgroundPixel;
+
+    // the slot row the first needed map row goes in
+    const int firstSlotRow = WrapIndex(neededTiles.y - destOrigin_Tiles.Y, destSize_Tiles.Y);
+
+    ParallelFor(WorkerPool, bandCount, [&](int bandIndex)
+    {
+        TileBatch_t& batch = BandTileBatches[bandIndex];
+        ClearTileBatch(batch);
+
+        const int firstRow = bandIndex * bandHeight_Tiles;
+        const int endRow = min(firstRow + bandHeight_Tiles, textureSize_Tiles.Y);
+
+        std::fill(MapStagingBuffer.Pixels.begin() + (size_t)firstRow * cGridSize_px * textureSize_px.X,
+                  MapStagingBuffer.Pixels.begin() + (size_t)endRow * cGridSize_px * textureSize_px.X, backgroundPixel);
+
+        for(int slotRow = firstRow; slotRow < endRow; slotRow++)
+        {
+            // the map row that lands in this slot row, if any
+            const int mapRow = neededTiles.y + WrapIndex(slotRow - firstSlotRow, destSize_Tiles.Y);
+
+            if(slotRow >= destSize_Tiles.Y || mapRow >= neededTiles.y + neededTiles.h)
+            {
+                continue;
+            }
+
+            const SDL_Rect rowArea = {neededTiles.x, mapRow, neededTiles.w, 1};
+            BatchTileArea(batch, tileMap, rowArea, destOrigin_Tiles, destSize_Tiles);
+        }
+
+        // every tile in this batch is in this band's rows, so no other band touches the same pixels
+        CPU_SubmitTileBatch(batch, tileAtlas, MapStagingBuffer);
+    });
+
+    for(int bandIndex = 0; bandIndex < bandCount; bandIndex++)
+    {
+        FrameProfiler.Current.TilesDrawn += (int)BandTileBatches[bandIndex].Draws.size();
+    }
+
+    SDL_UpdateTexture(mapRenderTexture, nullptr, MapStagingBuffer.Pixels.data(), textureSize_px.X * (int)sizeof(Uint32));
+
+    if(IncrementalMapRender)
+    {
+        MapRenderCache_t& cache = GetMapRenderCache(mapRenderTexture);
+        cache.Tiles = neededTiles;
+        cache.TileMap = &tileMap;
+        cache.MapVersion = tileMap.Version;
+        ClearPendingSlots(cache);
+        cache.Valid = (neededTiles.w != 0);
+    }
+
+    SDL_Rect renderedArea = {0};
+    renderedArea.x = neededTiles.x * cGridSize_px;
+    renderedArea.y = neededTiles.y * cGridSize_px;
+    renderedArea.w = neededTiles.w * cGridSize_px;
+    renderedArea.h = neededTiles.h * cGridSize_px;
+
+    return renderedArea;
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Demo main functions
+//---------------------------------------------------------------------------------------------------------------------------
+
+
+const InitSDLValues_t InitSDL(IntVec2_t windowSize_px)
+{
+    InitSDLValues_t sdlInitResult = {NULL, NULL};
+
+    if (SDL_Init(SDL_INIT_EVERYTHING) < 0) 
+    {
+        return sdlInitResult;
+    }
+
+    // Init the window
+    SDL_Window* window = SDL_CreateWindow("A wild map intersect test program appears!", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowSize_px.X, windowSize_px.Y, SDL_WINDOW_SHOWN);
+    if (!window) 
+    {
+        printf("An error occured while trying to create window : %s\n", SDL_GetError());
+        return sdlInitResult;
+    }
+
+    // Init the renderer. No vsync: FrameScheduler does the pacing (see WaitForNextFrame), and SDL_RenderPresent waiting for
+    // vblank as well would cap 120 / 144 / uncapped at the display's refresh rate and beat against the scheduler's deadlines.
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    if (!renderer) 
+    {
+        printf("An error occured while trying to create renderer : %s\n", SDL_GetError());
+        return sdlInitResult;
+    }
+
+    sdlInitResult.Window = window;
+    sdlInitResult.Renderer = renderer;
+    return sdlInitResult;
+}
+
+// just checks for a quit signal. You can put more keypresses and mouse button handlers here if you want.
+// returns 1 on quit, returns 0 otherwise
+int HandleInput()
+{
+    SDL_Event event = {0};
+
+    while (SDL_PollEvent(&event)) 
+    {
+        // E.g., from hitting the close window button
+        if (event.type == SDL_QUIT) 
+        {
+            return 1;
+        }
+        else if(event.type == SDL_MOUSEMOTION)
+        {
+            MousePosition.X = event.motion.x;
+            MousePosition.Y = event.motion.y;
+        }
+        else if(event.type == SDL_WINDOWEVENT)
+        {
+            // uncovered, resized, restored... the window's contents might be gone, so draw them again
+            ScreenNeedsRedraw = true;
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F12 && !event.key.repeat)
+        {
+            // write out the recent frame timings, see DumpFrameProfiles
+            DumpFrameProfiles();
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p && !event.key.repeat)
+        {
+            ParallelMapRender = !ParallelMapRender;
+            printf("Parallel map render: %s\n", ParallelMapRender ? "on" : "off");
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_l && !event.key.repeat)
+        {
+            // the viewports notice the layer count changed and redraw themselves
+            DEMO_ShowDecorationLayer = !DEMO_ShowDecorationLayer;
+            printf("Decoration layer: %s\n", DEMO_ShowDecorationLayer ? "on" : "off");
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_z && !event.key.repeat)
+        {
+            // the outline of what the viewport sees changes size too, so the whole screen has to be drawn again
+            DEMO_ZoomChoice = (DEMO_ZoomChoice + 1) % (int)(sizeof(cDemoZoomChoices) / sizeof(cDemoZoomChoices[0]));
+            DemoViewports.back().Zoom = cDemoZoomChoices[DEMO_ZoomChoice];
+            ScreenNeedsRedraw = true;
+            printf("Zoom: %g\n", DemoViewports.back().Zoom);
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_s && !event.key.repeat)
+        {
+            // the viewports redraw themselves once more after the sprites are gone
+            DEMO_ShowCritters = !DEMO_ShowCritters;
+            printf("Sprites: %s\n", DEMO_ShowCritters ? "on" : "off");
+        }
+        else if(event.type == SDL_KEYDOWN && event.key.keysym.sym >= SDLK_1 && event.key.keysym.sym <= SDLK_4 && !event.key.repeat)
+        {
+            // 1 / 2 / 3 / 4 pick the frame rate, see cFrameRateChoices
+            SetFrameRate(FrameScheduler, cFrameRateChoices[event.key.keysym.sym - SDLK_1]);
+        }
+    }
+
+    return 0;
+}
+
+void DrawTexture(SDL_Texture *texture, const IntVec2_t& textureSize, const IntVec2_t& screenCoord)
+{
+    SDL_Rect textureRectangle;
+    textureRectangle.x = 0;
+    textureRectangle.y = 0;
+    textureRectangle.w = textureSize.X;
+    textureRectangle.h = textureSize.Y;
+
+    SDL_Rect screenRectangle;
+    screenRectangle.x = screenCoord.X;
+    screenRectangle.y = screenCoord.Y;
+
+    screenRectangle.w = textureSize.X;
+    screenRectangle.h = textureSize.Y;
+
+    SDL_RenderCopy(SDLGlobals.Renderer, texture, &textureRectangle, &screenRectangle);
+    FrameProfiler.Current.RenderCopies++;
+}
+
+
+
+// renderedRectangle is what RenderMapToTexture rendered for the window, its top left corner is the top left of the map render texture
+IntVec2_t DEMO_TextureWindowRegion_RelToTexture(const IntVec2_t& relToMap_WindowTopLeft, const SDL_Rect& renderedRectangle)
+{
+    const IntVec2_t topLeftOfTextureToRegionTopLeft = {relToMap_WindowTopLeft.X - renderedRectangle.x, relToMap_WindowTopLeft.Y - renderedRectangle.y};
+
+    return topLeftOfTextureToRegionTopLeft;
+}
+
+
+
+// draws a magenta outline around the area that we're using as a window over the map
+void DEMO_DrawWindowRegion(const IntVec2_t& testWindowSize, const IntVec2_t& windowTopLeft, Color_t color = cMagenta)
+{
+    SDL_Rect rect = {0};
+    rect.x = windowTopLeft.X;
+    rect.y = windowTopLeft.Y;
+    rect.w = testWindowSize.X;
+    rect.h = testWindowSize.Y;
+
+    SDL_SetRenderDrawColor(SDLGlobals.Renderer, color.R, color.G, color.B, 255);
+
+    SDL_RenderDrawRect(SDLGlobals.Renderer, &rect);
+}
+
+static void ResizeViewportFrameData(ViewportFrameData_t& frame, int viewportCount)
+{
+    frame.RelToMap_WindowTopLeft.resize(viewportCount);
+    frame.WindowGridPoints.resize(viewportCount);
+    frame.WindowSize_px.resize(viewportCount);
+    frame.IntersectTypes.resize(viewportCount);
+    frame.ViewSize_px.resize(viewportCount);
+    frame.RenderedRects.resize(viewportCount);
+    frame.ReadRects.resize(viewportCount);
+    frame.DrawOffsets.resize(viewportCount);
+    frame.Redraw.resize(viewportCount);
+}
+
+// The map render texture a viewport draws layer layerIndex of the map into
+static inline SDL_Texture* GetLayerRenderTexture(const Viewport_t& viewport, int layerIndex)
+{
+    return (layerIndex == 0) ? viewport.MapRenderTexture : viewport.UpperLayerRenderTextures[layerIndex - 1];
+}
+
+// DEMO ONLY: show the contents of a viewport's render textures on the real screen. Expects the screen to be the render target.
+// The map render textures of all layerCount layers are shown stacked up, the way they're composited.
+static void DEMO_ShowViewport(const Viewport_t& viewport, const ViewportFrameData_t& frame, int viewportIndex, int layerCount)
+{
+    const IntVec2_t& mapTexRenderPoint = viewport.MapTexRenderPoint;
+    const IntVec2_t& screenRenderPoint = viewport.ScreenRenderPoint;
+    const IntVec2_t& relToMap_WindowTopLeft = frame.RelToMap_WindowTopLeft[viewportIndex];
+    const IntVec2_t& windowSize_px = frame.WindowSize_px[viewportIndex];
+
+    // for the sake of visualization, render the contents of the rendered map texture to the screen, this would not be done in a real game.
+    // A zoomed viewport doesn't use its map render textures, so there's nothing to show.
+    if(viewport.Zoom == 1.0f)
+    {
+        SDL_Rect mapRenderRect = {0};
+        mapRenderRect.x = mapTexRenderPoint.X;
+        mapRenderRect.y = mapTexRenderPoint.Y;
+        mapRenderRect.w = windowSize_px.X + cGridSize_px;
+        mapRenderRect.h = windowSize_px.Y + cGridSize_px;
+
+        if(IncrementalMapRender)
+        {
+            // the ring buffer's tiles are wrapped around, unwrap them so this looks the same as the non-incremental version
+            SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 255, 255, 255);
+            SDL_RenderFillRect(SDLGlobals.Renderer, &mapRenderRect);
+
+            for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+            {
+                SDL_Texture* layerRenderTexture = GetLayerRenderTexture(viewport, layerIndex);
+
+                CopyFromRingTexture(layerRenderTexture, GetMapRenderCache(layerRenderTexture).Capacity_Tiles, frame.RenderedRects[viewportIndex], mapTexRenderPoint);
+            }
+        }
+        else
+        {
+            // the pooled texture can be bigger than what's used, only show the used part
+            const SDL_Rect usedRect = {0, 0, mapRenderRect.w, mapRenderRect.h};
+
+            for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+            {
+                SDL_RenderCopy(SDLGlobals.Renderer, GetLayerRenderTexture(viewport, layerIndex), &usedRect, &mapRenderRect);
+                FrameProfiler.Current.RenderCopies++;
+            }
+        }
+    }
+
+    // draw the player's simulated screen in the render texture, this would not be done in a real game, this is just for illustrative purposes
+    {
+        const IntVec2_t topLeftOfTextureToRegionTopLeft = DEMO_TextureWindowRegion_RelToTexture(relToMap_WindowTopLeft, frame.RenderedRects[viewportIndex]);        
+        const IntVec2_t windowTopLeft_InMapTexture = {mapTexRenderPoint.X + topLeftOfTextureToRegionTopLeft.X, mapTexRenderPoint.Y + topLeftOfTextureToRegionTopLeft.Y};
+
+        // but don't draw the region if the region's completely outside of the map, the offset won't make any sense
+        if(frame.IntersectTypes[viewportIndex] != WindowIntersectType_t::TotallyOut && viewport.Zoom == 1.0f)
+        {
+            DEMO_DrawWindowRegion(windowSize_px, windowTopLeft_InMapTexture);
+        }
+    }
+
+    // now copy the part of the mapRenderTexture that contains the map onto the screen (with an orangish background behind it)
+    {
+        SDL_Rect screenRenderRect = {0};
+        screenRenderRect.x = screenRenderPoint.X;
+        screenRenderRect.y = screenRenderPoint.Y;
+        screenRenderRect.w = windowSize_px.X;
+        screenRenderRect.h = windowSize_px.Y;
+
+        const SDL_Rect usedRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+
+        SDL_RenderCopy(SDLGlobals.Renderer, viewport.ScreenRenderTexture, &usedRect, &screenRenderRect);
+        FrameProfiler.Current.RenderCopies++;
+    }
+}
+
+// Render what every viewport sees of a map made of layerCount layers, bottom first (e.g., ground, decoration, overlay).
+// Every layer is a tile map of its own, all the same size, with its own Version, so editing one layer leaves the others alone.
+// Every viewport has to have map render textures for that many layers, see AcquireViewportTextures.
+//
+// All of the geometry (intersect types, rendered areas, read areas, draw offsets) is worked out up front in one pass,
+// then the GPU work is done grouped by render target: every map render texture (and chunk thumbnail), then every screen render texture,
+// then everything that goes on the real screen with a single switch back to it.
+//
+// A zoomed viewport (see Viewport_t::Zoom) is drawn from chunk thumbnails instead of its map render textures, see UpdateChunkThumbnail.
+void RenderWindows(const Viewport_t* viewports, int viewportCount, const TileMap_t* const* layers, int layerCount)
+{
+    assert(InRange(1, layerCount, MAX_TILE_LAYERS));
+
+    ViewportFrameData_t& frame = ViewportFrameData;
+    ResizeViewportFrameData(frame, viewportCount);
+
+    ChunkThumbnailFrame++;
+
+    const TileMap_t& tileMap = *layers[0];
+    const IntVec2_t mapSize_px = GetMapSize_px(tileMap);
+
+    for(int layerIndex = 1; layerIndex < layerCount; layerIndex++)
+    {
+        assert(layers[layerIndex]->Size_Tiles.X == tileMap.Size_Tiles.X && layers[layerIndex]->Size_Tiles.Y == tileMap.Size_Tiles.Y);
+    }
+
+    // geometry only, nothing is drawn here
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        const Viewport_t& viewport = viewports[viewportIndex];
+
+        // This variable is probably only important for the sake of this demo, if this were in a real game, you would pass in windowTopLeft
+        // that was already relative to the top of the map, but since this demo contains more than one render window case, we have to do this offset.
+        //
+        // Though maybe this would be useful outside of this demo, if you wanted to offset where the map was drawn
+        frame.RelToMap_WindowTopLeft[viewportIndex] = {viewport.WindowTopLeft_px.X - cMapOrigin.X, viewport.WindowTopLeft_px.Y - cMapOrigin.Y};
+        frame.WindowSize_px[viewportIndex] = {viewport.WindowSize_Tiles.X * cGridSize_px, viewport.WindowSize_Tiles.Y * cGridSize_px};
+        frame.ViewSize_px[viewportIndex] = GetZoomedWindowSize_px(frame.WindowSize_px[viewportIndex], viewport.Zoom);
+
+        frame.Redraw[viewportIndex] = ViewportNeedsRedraw(viewport, layers, layerCount) ? 1 : 0;
+        FrameProfiler.Current.ViewportsRedrawn += frame.Redraw[viewportIndex];
+    }
+
+    // DON'T use relToRenderTexture for the intersect type! It needs to be relative to the map!
+    ClassifyWindowIntersectTypes(mapSize_px, frame.RelToMap_WindowTopLeft.data(), frame.ViewSize_px.data(), viewportCount, frame.IntersectTypes.data());
+    FindGridPoints(frame.RelToMap_WindowTopLeft.data(), viewportCount, cGridSize_px, frame.WindowGridPoints.data());
+
+    // the clip rects come straight from the window's position, they don't need the intersect type
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        const WindowClip_t clip = ComputeWindowClipFromGridPoint(mapSize_px, frame.WindowGridPoints[viewportIndex], frame.ViewSize_px[viewportIndex], cGridSize_px);
+
+        if(viewports[viewportIndex].Zoom != 1.0f)
+        {
+            // the thumbnails are copied straight into the window, there's no map render texture to read from
+            frame.RenderedRects[viewportIndex] = ChunkRectForArea(tileMap, clip.MapRect);
+            frame.ReadRects[viewportIndex] = {0, 0, 0, 0};
+            frame.DrawOffsets[viewportIndex] = {0, 0};
+        }
+        else
+        {
+            frame.RenderedRects[viewportIndex] = clip.RenderedRect;
+            frame.ReadRects[viewportIndex] = clip.SourceRect;
+            frame.DrawOffsets[viewportIndex] = clip.DestOffset;
+        }
+
+        // for file backed maps, start reading the chunks around the window before they're needed,
+        // and the ones further out in whatever direction it's moving
+        const SDL_Rect nearbyArea_MapPx = {clip.MapRect.x - cPageInMargin_px, clip.MapRect.y - cPageInMargin_px, clip.MapRect.w + 2 * cPageInMargin_px, clip.MapRect.h + 2 * cPageInMargin_px};
+
+        for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+        {
+            PageInTileMapArea(*layers[layerIndex], nearbyArea_MapPx);
+
+            PredictChunkPrefetch(ViewportMotions[GetLayerRenderTexture(viewports[viewportIndex], layerIndex)], *layers[layerIndex], frame.RelToMap_WindowTopLeft[viewportIndex], frame.ViewSize_px[viewportIndex]);
+        }
+    }
+
+    // render targets: map render textures
+    const Uint64 mapStageStart = ProfileStageBegin(ProfileStage_t::RenderMapToTexture);
+
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        const Viewport_t& viewport = viewports[viewportIndex];
+
+        // the screen render texture still has exactly this in it
+        if(!frame.Redraw[viewportIndex])
+        {
+            continue;
+        }
+
+        if(viewport.Zoom != 1.0f)
+        {
+            const SDL_Rect& chunkRect = frame.RenderedRects[viewportIndex];
+            const int mipLevel = GetZoomMipLevel(viewport.Zoom);
+
+            // only the thumbnails that are missing or out of date get drawn
+            for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+            {
+                for(int chunkRow = chunkRect.y; chunkRow < chunkRect.y + chunkRect.h; chunkRow++)
+                {
+                    for(int chunkColumn = chunkRect.x; chunkColumn < chunkRect.x + chunkRect.w; chunkColumn++)
+                    {
+                        UpdateChunkThumbnail(*viewport.TileAtlas, *layers[layerIndex], {chunkColumn, chunkRow}, mipLevel, layerIndex != 0);
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        // a layer that hasn't changed since its map render texture was drawn is left as is (unless the window scrolled)
+        for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+        {
+            SDL_Texture* layerRenderTexture = GetLayerRenderTexture(viewport, layerIndex);
+            assert(layerRenderTexture != nullptr);
+
+            const SDL_Rect renderedRectangle = RenderMapToTexture(layerRenderTexture, *viewport.TileAtlas, *layers[layerIndex], viewport.WindowSize_Tiles, frame.RelToMap_WindowTopLeft[viewportIndex], layerIndex != 0);
+
+            assert(renderedRectangle.x == frame.RenderedRects[viewportIndex].x && renderedRectangle.w == frame.RenderedRects[viewportIndex].w);
+            assert(renderedRectangle.y == frame.RenderedRects[viewportIndex].y && renderedRectangle.h == frame.RenderedRects[viewportIndex].h);
+            (void)renderedRectangle;
+        }
+    }
+
+    ProfileStageEnd(ProfileStage_t::RenderMapToTexture, mapStageStart);
+
+    // render targets: screen render textures
+    const Uint64 copyStageStart = ProfileStageBegin(ProfileStage_t::CopyRenderedMapToScreen);
+
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        const Viewport_t& viewport = viewports[viewportIndex];
+
+        if(!frame.Redraw[viewportIndex])
+        {
+            continue;
+        }
+
+        if(viewport.Zoom != 1.0f)
+        {
+            CopyChunkThumbnailsToScreen(viewport.ScreenRenderTexture, layers, layerCount, frame.RelToMap_WindowTopLeft[viewportIndex], frame.WindowSize_px[viewportIndex], viewport.Zoom, frame.RenderedRects[viewportIndex]);
+        }
+        else
+        {
+            SDL_Texture* layerRenderTextures[MAX_TILE_LAYERS] = {0};
+
+            for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+            {
+                layerRenderTextures[layerIndex] = GetLayerRenderTexture(viewport, layerIndex);
+            }
+
+            CopyMapAreaToScreen(viewport.ScreenRenderTexture, layerRenderTextures, layerCount, frame.ReadRects[viewportIndex], frame.DrawOffsets[viewportIndex], frame.RenderedRects[viewportIndex]);
+        }
+
+        // both of those leave the screen render texture as the render target, the sprites go on top of the map
+        if(viewport.SpriteQueue != nullptr)
+        {
+            DrawSpriteQueue(*viewport.SpriteQueue, frame.RelToMap_WindowTopLeft[viewportIndex], frame.ViewSize_px[viewportIndex], viewport.Zoom);
+        }
+
+        RememberViewportRender(viewport, layers, layerCount);
+    }
+
+    ProfileStageEnd(ProfileStage_t::CopyRenderedMapToScreen, copyStageStart);
+
+    // nothing's holding on to thumbnails from before this frame any more
+    TrimChunkThumbnails();
+
+    // render target: the real screen
+    SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+    FrameProfiler.Current.RenderTargetSwitches++;
+
+    if(!DEMO_ShowRenderTextures)
+    {
+        return;
+    }
+
+    for(int viewportIndex = 0; viewportIndex < viewportCount; viewportIndex++)
+    {
+        DEMO_ShowViewport(viewports[viewportIndex], frame, viewportIndex, layerCount);
+    }
+}
+
+// Render what every viewport sees of a one layer map
+void RenderWindows(const Viewport_t* viewports, int viewportCount, const TileMap_t& tileMap)
+{
+    const TileMap_t* const layers[] = {&tileMap};
+
+    RenderWindows(viewports, viewportCount, layers, 1);
+}
+
+// Render what a simulated window would see, if its top left corner were placed at a certain position in the map
+void RenderWindow(SDL_Texture* screenRenderTexture, SDL_Texture* mapRenderTexture, const TileAtlas_t* tileAtlas, const IntVec2_t& windowSize_Tiles, const IntVec2_t& windowTopLeft_px, const IntVec2_t& mapTexRenderPoint, const IntVec2_t& screenRenderPoint)
+{
+    const Viewport_t viewport = {screenRenderTexture, mapRenderTexture, tileAtlas, windowSize_Tiles, windowTopLeft_px, mapTexRenderPoint, screenRenderPoint, {nullptr}};
+
+    RenderWindows(&viewport, 1, DemoTileMap);
+}
+
+// DEMO ONLY: scatters cDemoCritterCount tiles of the map around it, on one of two layers, each heading off in its own direction
+static void DEMO_CreateCritters()
+{
+    const IntVec2_t mapSize_px = GetMapSize_px(DemoTileMap);
+
+    InitSpatialGrid(DemoCritterGrid, mapSize_px, 2);
+    DemoCritters.resize(cDemoCritterCount);
+
+    std::mt19937 random(4242);
+
+    for(DemoCritter_t& critter : DemoCritters)
+    {
+        // tile ID 0 is the empty tile
+        critter.Tile = DemoTileMap.TileSources[1 + random() % (DemoTileMap.TileSources.size() - 1)];
+        critter.Velocity_px = {(int)(random() % 5) - 2, (int)(random() % 5) - 2};
+        critter.Layer = (int)(random() % 2);
+
+        const SDL_Rect bounds = {(int)(random() % mapSize_px.X), (int)(random() % mapSize_px.Y), critter.Tile.Rect.w, critter.Tile.Rect.h};
+        critter.EntityId = AddEntity(DemoCritterGrid, bounds);
+    }
+}
+
+// DEMO ONLY: moves every critter along a frame's worth, bouncing off the edges of the map
+static void DEMO_MoveCritters()
+{
+    const IntVec2_t mapSize_px = GetMapSize_px(DemoTileMap);
+
+    for(DemoCritter_t& critter : DemoCritters)
+    {
+        SDL_Rect bounds = DemoCritterGrid.Entities[critter.EntityId].Bounds;
+
+        bounds.x += critter.Velocity_px.X;
+        bounds.y += critter.Velocity_px.Y;
+
+        // halfway off the map is as far as they go
+        if(bounds.x < -bounds.w / 2 || bounds.x > mapSize_px.X - bounds.w / 2)
+        {
+            critter.Velocity_px.X = -critter.Velocity_px.X;
+        }
+
+        if(bounds.y < -bounds.h / 2 || bounds.y > mapSize_px.Y - bounds.h / 2)
+        {
+            critter.Velocity_px.Y = -critter.Velocity_px.Y;
+        }
+
+        MoveEntity(DemoCritterGrid, critter.EntityId, bounds);
+    }
+}
+
+// DEMO ONLY: queues the critters each viewport can see
+static void DEMO_QueueCritters()
+{
+    std::vector<VisibleEntity_t> visible;
+
+    for(Viewport_t& viewport : DemoViewports)
+    {
+        const IntVec2_t relToMap_WindowTopLeft = {viewport.WindowTopLeft_px.X - cMapOrigin.X, viewport.WindowTopLeft_px.Y - cMapOrigin.Y};
+
+        QueryWindow(DemoCritterGrid, relToMap_WindowTopLeft, GetZoomedWindowSize_px(cWindowSize_px, viewport.Zoom), visible);
+
+        // DrawSpriteQueue does its own clipping, a critter hanging off the window is queued whole
+        for(const VisibleEntity_t& visibleEntity : visible)
+        {
+            const DemoCritter_t& critter = DemoCritters[visibleEntity.EntityId];
+            const SDL_Rect& bounds = DemoCritterGrid.Entities[visibleEntity.EntityId].Bounds;
+
+            QueueSprite(*viewport.SpriteQueue, DemoTileAtlas.Pages[critter.Tile.Page], critter.Tile.Rect, {bounds.x, bounds.y}, critter.Layer);
+        }
+    }
+}
+
+void Render(void)
+{
+    // the last viewport is the moveable one
+    DemoViewports.back().WindowTopLeft_px = MousePosition;
+
+    if(DEMO_ShowCritters)
+    {
+        DEMO_QueueCritters();
+    }
+
+    // bottom first
+    const TileMap_t* const layers[] = {&DemoTileMap, &DemoDecorationLayer};
+    const int layerCount = DEMO_ShowDecorationLayer ? 2 : 1;
+
+    // everything on screen comes from the viewports, so if none of them changed, the last frame is still right.
+    // Nothing's drawn or presented, the frame is just waited out.
+    if(!ScreenNeedsRedraw && !AnyViewportNeedsRedraw(DemoViewports.data(), (int)DemoViewports.size(), layers, layerCount))
+    {
+        return;
+    }
+
+    ScreenNeedsRedraw = false;
+
+    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 40, 60, 255);
+    SDL_RenderClear(SDLGlobals.Renderer);
+
+    // Draw the whole map (would not be used in a real game)
+    DrawTexture(MapTestTexture, MapTextureSize, cMapOrigin);
+
+    // Draw our simulated window regions
+    for(const Viewport_t& viewport : DemoViewports)
+    {
+        DEMO_DrawWindowRegion(GetZoomedWindowSize_px(cWindowSize_px, viewport.Zoom), viewport.WindowTopLeft_px);
+    }
+
+    // Draw what these windows would see
+    RenderWindows(DemoViewports.data(), (int)DemoViewports.size(), layers, layerCount);
+
+    const Uint64 presentStageStart = ProfileStageBegin(ProfileStage_t::Present);
+    SDL_RenderPresent(SDLGlobals.Renderer);
+    ProfileStageEnd(ProfileStage_t::Present, presentStageStart);
+}
+
+// Gives a viewport's textures back to the pool
+void ReleaseViewportTextures(Viewport_t& viewport)
+{
+    // whoever gets these textures next is a different window
+    ViewportMotions.erase(viewport.MapRenderTexture);
+
+    ReleaseRenderTarget(RenderTargetPool, viewport.ScreenRenderTexture);
+    ReleaseRenderTarget(RenderTargetPool, viewport.MapRenderTexture);
+
+    viewport.ScreenRenderTexture = nullptr;
+    viewport.MapRenderTexture = nullptr;
+
+    for(SDL_Texture*& layerRenderTexture : viewport.UpperLayerRenderTextures)
+    {
+        ViewportMotions.erase(layerRenderTexture);
+        ReleaseRenderTarget(RenderTargetPool, layerRenderTexture);
+
+        layerRenderTexture = nullptr;
+    }
+}
+
+// Gets a viewport its screen render texture and a map render texture for each of layerCount map layers, sized for its WindowSize_Tiles.
+// Returns false (with none of the textures held) if the pool couldn't supply them.
+bool AcquireViewportTextures(Viewport_t& viewport, int layerCount = 1)
+{
+    assert(InRange(1, layerCount, MAX_TILE_LAYERS));
+
+    const IntVec2_t windowSize_px = {viewport.WindowSize_Tiles.X * cGridSize_px, viewport.WindowSize_Tiles.Y * cGridSize_px};
+
+    // one more tile each way, see cMapRenderTextureSize_Tiles
+    const IntVec2_t mapRenderTextureSize_px = {windowSize_px.X + cGridSize_px, windowSize_px.Y + cGridSize_px};
+
+    viewport.ScreenRenderTexture = AcquireRenderTarget(RenderTargetPool, windowSize_px);
+    viewport.MapRenderTexture = AcquireRenderTarget(RenderTargetPool, mapRenderTextureSize_px);
+
+    bool acquiredAll = (viewport.ScreenRenderTexture != nullptr && viewport.MapRenderTexture != nullptr);
+
+    for(int layerIndex = 1; layerIndex < layerCount; layerIndex++)
+    {
+        SDL_Texture*& layerRenderTexture = viewport.UpperLayerRenderTextures[layerIndex - 1];
+        layerRenderTexture = AcquireRenderTarget(RenderTargetPool, mapRenderTextureSize_px);
+
+        if(layerRenderTexture == nullptr)
+        {
+            acquiredAll = false;
+            break;
+        }
+
+        // these are mostly transparent, and get blended over the layers under them
+        SDL_SetTextureBlendMode(layerRenderTexture, SDL_BLENDMODE_BLEND);
+    }
+
+    if(!acquiredAll)
+    {
+        ReleaseViewportTextures(viewport);
+        return false;
+    }
+
+    return true;
+}
+
+static void DEMO_CreateViewports()
+{
+    // in absolute pixels from the top left of our real 1024x768 screen
+    IntVec2_t northWestRegion ={416, 306};
+    IntVec2_t northRegion = {480, 306};
+    IntVec2_t northEastRegion = {533, 316};
+    IntVec2_t eastRegion = {532, 370};
+    IntVec2_t southEastRegion = {534, 426};
+    IntVec2_t southRegion = {476, 427};
+    IntVec2_t southWestRegion = {426, 420};
+    IntVec2_t westRegion = {413, 361};
+
+    IntVec2_t allInRegion = {482, 356};
+    IntVec2_t allOutRegion = {364, 308};
+
+    // note: I had trouble getting the exact coordinates of the upper left hand corners of these regions, may be off by +/- 1 px from what's in layout.xcf
+
+    // the render textures are filled in from RenderTargetPool below
+    DemoViewports = {
+    //   screen texture (orange)             map render texture (cyan)       tile atlas      window size        region position     map texture render position     screen texture render position
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, northWestRegion,    {356, 244},                     {301, 192}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, northRegion,        {476, 245},                     {474, 170}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, northEastRegion,    {580, 265},                     {649, 208}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, eastRegion,         {606, 359},                     {686, 357}},
+
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, southEastRegion,    {595, 481},                     {651, 537}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, southRegion,        {468, 491},                     {469, 592}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, southWestRegion,    {361, 464},                     {316, 525}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, westRegion,         {323, 358},                     {271, 410}},
+
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, allInRegion,        {164, 278},                     {82, 294}},
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, allOutRegion,       {164, 337},                     {81, 334}},
+
+        {nullptr,                           nullptr,                        &DemoTileAtlas, cWindowSize_Tiles, MousePosition,      {770, 255},                     {777, 323}},
+    };
+
+    // room for the decoration layer, see DEMO_ShowDecorationLayer
+    for(Viewport_t& viewport : DemoViewports)
+    {
+        AcquireViewportTextures(viewport, 2);
+    }
+
+    // DemoSpriteQueues isn't resized after this, so the pointers stay good
+    DemoSpriteQueues.resize(DemoViewports.size());
+
+    for(size_t viewportIndex = 0; viewportIndex < DemoViewports.size(); viewportIndex++)
+    {
+        DemoViewports[viewportIndex].SpriteQueue = &DemoSpriteQueues[viewportIndex];
+    }
+}
+
+// mapFilePath is a map file to draw instead of the demo map, or nullptr. See DEMO_OpenTileMap.
+void GameRenderLoop(const char* mapFilePath)
+{
+    // initialization
+    SDLGlobals = InitSDL(cScreenResolution);
+
+    MapTestTexture = LoadImage(SDLGlobals.Renderer, "Debug16.png");
+    MapTextureSize = InquireTextureSize(MapTestTexture);
+
+    // the windows draw their tiles out of an atlas, with CPU copies for ParallelMapRender.
+    // There's only one tileset in the demo, a real game would pass all of them here.
+    const char* const tileSetPaths[] = {"Debug16.png"};
+    TileSource_t tileSetPlacement = {0};
+
+    if(!BuildTileAtlas(DemoTileAtlas, tileSetPaths, 1, &tileSetPlacement, true))
+    {
+        return;
+    }
+
+    // the whole map drawn behind the windows is still Debug16.png, so a map file that isn't the demo map won't line up with it
+    if(mapFilePath == nullptr)
+    {
+        DEMO_BuildTileMap(DemoTileMap, tileSetPlacement);
+    }
+    else if(!DEMO_OpenTileMap(DemoTileMap, mapFilePath, tileSetPlacement))
+    {
+        return;
+    }
+
+    DEMO_BuildDecorationLayer(DemoDecorationLayer, DemoTileMap.Size_Tiles, tileSetPlacement);
+
+    RenderTargetPool.MaxBytes = cRenderTargetPoolMaxBytes;
+
+    DEMO_CreateViewports();
+    DEMO_CreateCritters();
+
+    // main loop
+    SetFrameRate(FrameScheduler, cFPS);
+
+    while(1)
+    {
+        ProfileBeginFrame();
+
+        const Uint64 inputStageStart = ProfileStageBegin(ProfileStage_t::Input);
+        int quitSignal = HandleInput();
+        ProfileStageEnd(ProfileStage_t::Input, inputStageStart);
+
+        if(quitSignal)
+        {
+            break;
+        }
+
+        // only the tiles that actually change frame get redrawn, and only in the windows that can see them
+        UpdateTileAnimations(DemoDecorationLayer, GetFrameTime_ms(FrameScheduler));
+
+        if(DEMO_ShowCritters)
+        {
+            DEMO_MoveCritters();
+        }
+
+        Render();
+
+        const Uint64 delayStageStart = ProfileStageBegin(ProfileStage_t::Delay);
+        FrameProfiler.Current.MissedDeadlines = WaitForNextFrame(FrameScheduler);
+        ProfileStageEnd(ProfileStage_t::Delay, delayStageStart);
+
+        ProfileEndFrame();
+    }
+
+    if(FrameScheduler.MissedFrames > 0)
+    {
+        printf("Missed %llu frame deadlines in total\n", (unsigned long long)FrameScheduler.MissedFrames);
+    }
+
+    // whatever was recorded last is kept, so it can be looked at after quitting
+    DumpFrameProfiles();
+
+    for(Viewport_t& viewport : DemoViewports)
+    {
+        ReleaseViewportTextures(viewport);
+    }
+
+    DemoViewports.clear();
+    DemoSpriteQueues.clear();
+
+    ReleaseChunkThumbnails(DemoTileMap);
+    ReleaseChunkThumbnails(DemoDecorationLayer);
+
+    DestroyRenderTargetPool(RenderTargetPool);
+    StopWorkerPool(WorkerPool);
+    StopChunkPrefetcher(ChunkPrefetcher);
+    DestroyTileAtlas(DemoTileAtlas);
+
+    // unmaps the map file, if there is one
+    DemoTileMap = TileMap_t();
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Benchmarks
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Results go to stdout as CSV, one line per benchmark:
+//     benchmark,map_tiles,window_px,pattern,iterations,ns_per_op,ops_per_sec
+// For the render benchmarks an op is a whole frame, so ops_per_sec is frames per second.
+
+// keeps the optimizer from throwing away the work being timed
+volatile int BenchmarkSink = 0;
+
+// Runs fn(iteration) in bigger and bigger batches until at least cBenchmarkMinSeconds has gone by, then reports the last batch
+template<typename BenchmarkFn>
+static void RunBenchmark(const char* name, const IntVec2_t& mapSize_Tiles, const IntVec2_t& windowSize_px, const char* pattern, BenchmarkFn fn)
+{
+    const double cBenchmarkMinSeconds = 0.2;
+    const double frequency = (double)SDL_GetPerformanceFrequency();
+
+    long long iterations = 16;
+    double seconds = 0.0;
+
+    while(1)
+    {
+        const Uint64 start = SDL_GetPerformanceCounter();
+
+        for(long long iteration = 0; iteration < iterations; iteration++)
+        {
+            fn(iteration);
+        }
+
+        seconds = (SDL_GetPerformanceCounter() - start) / frequency;
+
+        if(seconds >= cBenchmarkMinSeconds)
+        {
+            break;
+        }
+
+        iterations *= 2;
+    }
+
+    const double nsPerOp = seconds * 1e9 / iterations;
+    const double opsPerSecond = iterations / seconds;
+
+    printf("%s,%dx%d,%dx%d,%s,%lld,%.2f,%.1f\n", name, mapSize_Tiles.X, mapSize_Tiles.Y, windowSize_px.X, windowSize_px.Y, pattern, iterations, nsPerOp, opsPerSecond);
+    fflush(stdout);
+}
+
+// Window positions (relative to the map) to cycle through. "random" jumps anywhere on or around the map,
+// "scroll" wanders a couple of pixels at a time like a camera following a player.
+static std::vector<IntVec2_t> BENCH_MakeWindowPositions(const IntVec2_t& mapSize_px, const IntVec2_t& windowSize_px, bool scroll)
+{
+    const int cPositionCount = 4096;
+
+    // fixed seed, every run sees the same positions
+    std::mt19937 random(12345);
+
+    std::uniform_int_distribution<int> randomX(-windowSize_px.X, mapSize_px.X);
+    std::uniform_int_distribution<int> randomY(-windowSize_px.Y, mapSize_px.Y);
+    std::uniform_int_distribution<int> randomStep(-2, 2);
+
+    std::vector<IntVec2_t> positions(cPositionCount);
+    IntVec2_t position = {randomX(random), randomY(random)};
+
+    for(IntVec2_t& nextPosition : positions)
+    {
+        if(scroll)
+        {
+            position.X = max(-windowSize_px.X, min(mapSize_px.X, position.X + randomStep(random)));
+            position.Y = max(-windowSize_px.Y, min(mapSize_px.Y, position.Y + randomStep(random)));
+        }
+        else
+        {
+            position = {randomX(random), randomY(random)};
+        }
+
+        nextPosition = position;
+    }
+
+    return positions;
+}
+
+// a map with every tile populated, cycling through the tileset
+static void BENCH_BuildTileMap(TileMap_t& tileMap, const IntVec2_t& mapSize_Tiles, const TileSource_t& tileSet)
+{
+    DEMO_BuildTileMap(tileMap, tileSet);
+    tileMap.Size_Tiles = mapSize_Tiles;
+
+    const int tileSourceCount = (int)tileMap.TileSources.size() - 1;
+
+    for(int rowIndex = 0; rowIndex < mapSize_Tiles.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < mapSize_Tiles.X; columnIndex++)
+        {
+            WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(1 + (rowIndex * 7 + columnIndex) % tileSourceCount));
+        }
+    }
+}
+
+// Looks just like BENCH_BuildTileMap's map, but neighbouring tiles come from different copies of the tileset,
+// so with each copy on its own atlas page every batch has tiles from every page
+static void BENCH_BuildMultiPageTileMap(TileMap_t& tileMap, const IntVec2_t& mapSize_Tiles, const TileSource_t* tileSets, int tileSetCount)
+{
+    BENCH_BuildTileMap(tileMap, mapSize_Tiles, tileSets[0]);
+
+    const int tilesPerTileSet = (int)tileMap.TileSources.size() - 1;
+
+    for(int tileSetIndex = 1; tileSetIndex < tileSetCount; tileSetIndex++)
+    {
+        AddTileSetTiles(tileMap, tileSets[tileSetIndex]);
+    }
+
+    for(int rowIndex = 0; rowIndex < mapSize_Tiles.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < mapSize_Tiles.X; columnIndex++)
+        {
+            const TileId_t tileId = GetTile(tileMap, {columnIndex, rowIndex});
+            WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(tileId + ((rowIndex + columnIndex) % tileSetCount) * tilesPerTileSet));
+        }
+    }
+}
+
+// a layer to go over a map: a tile from the tileset on every fourth tile of every other row, empty everywhere else
+static void BENCH_BuildOverlayLayer(TileMap_t& tileMap, const IntVec2_t& mapSize_Tiles, const TileSource_t& tileSet)
+{
+    tileMap = TileMap_t();
+    tileMap.Size_Tiles = mapSize_Tiles;
+
+    const TileId_t firstTileId = AddTileSetTiles(tileMap, tileSet);
+    const int tileCount = (int)tileMap.TileSources.size() - firstTileId;
+
+    for(int rowIndex = 0; rowIndex < mapSize_Tiles.Y; rowIndex += 2)
+    {
+        for(int columnIndex = rowIndex % 4; columnIndex < mapSize_Tiles.X; columnIndex += 4)
+        {
+            WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(firstTileId + (rowIndex + columnIndex) % tileCount));
+        }
+    }
+}
+
+// Two animations (a quick one with 3 frames, a slow one with 2, both out of the tileset), put on every 8th tile of every 3rd row
+static void BENCH_AddAnimatedTiles(TileMap_t& tileMap, const TileSource_t& tileSet)
+{
+    TileAnimationFrame_t quickFrames[3];
+    TileAnimationFrame_t slowFrames[2];
+
+    for(int frameIndex = 0; frameIndex < 3; frameIndex++)
+    {
+        quickFrames[frameIndex] = {{tileSet.Page, {tileSet.Rect.x + frameIndex * cGridSize_px, tileSet.Rect.y + cGridSize_px, cGridSize_px, cGridSize_px}}, 100};
+    }
+
+    for(int frameIndex = 0; frameIndex < 2; frameIndex++)
+    {
+        slowFrames[frameIndex] = {{tileSet.Page, {tileSet.Rect.x + frameIndex * cGridSize_px, tileSet.Rect.y + 2 * cGridSize_px, cGridSize_px, cGridSize_px}}, 250};
+    }
+
+    const TileId_t animatedTileIds[2] = {AddTileAnimation(tileMap, quickFrames, 3), AddTileAnimation(tileMap, slowFrames, 2)};
+
+    for(int rowIndex = 1; rowIndex < tileMap.Size_Tiles.Y; rowIndex += 3)
+    {
+        for(int columnIndex = rowIndex % 8; columnIndex < tileMap.Size_Tiles.X; columnIndex += 8)
+        {
+            WriteTile(tileMap, {columnIndex, rowIndex}, animatedTileIds[(columnIndex / 8) % 2]);
+        }
+    }
+}
+
+static void BENCH_Geometry(const IntVec2_t& mapSize_Tiles, const IntVec2_t& windowSize_px)
+{
+    const IntVec2_t mapSize_px = {mapSize_Tiles.X * cGridSize_px, mapSize_Tiles.Y * cGridSize_px};
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(mapSize_px, windowSize_px, false);
+    const int positionMask = (int)positions.size() - 1;
+
+    RunBenchmark("GetWindowIntersectType", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        BenchmarkSink += (int)GetWindowIntersectType(mapSize_px, positions[iteration & positionMask], windowSize_px);
+    });
+
+    // one op is one window, so this lines up with GetWindowIntersectType
+    const std::vector<IntVec2_t> sizes(positions.size(), windowSize_px);
+    std::vector<WindowIntersectType_t> intersectTypes(positions.size());
+
+    RunBenchmark("ClassifyWindowIntersectTypes", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        if((iteration & positionMask) == 0)
+        {
+            ClassifyWindowIntersectTypes(mapSize_px, positions.data(), sizes.data(), (int)positions.size(), intersectTypes.data());
+            BenchmarkSink += (int)intersectTypes[iteration & 7];
+        }
+    });
+
+    RunBenchmark("FindGridPoint", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        BenchmarkSink += FindGridPoint(positions[iteration & positionMask], cGridSize_px).Offset.X;
+    });
+
+    // one op is one point again
+    std::vector<GridPoint_t> gridPoints(positions.size());
+
+    RunBenchmark("FindGridPoints", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        if((iteration & positionMask) == 0)
+        {
+            FindGridPoints(positions.data(), (int)positions.size(), cGridSize_px, gridPoints.data());
+            BenchmarkSink += gridPoints[iteration & 7].Offset.X;
+        }
+    });
+
+    RunBenchmark("GetMapRenderRectangle", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        BenchmarkSink += GetMapRenderRectangle(mapSize_px, positions[iteration & positionMask], windowSize_px).w;
+    });
+
+    RunBenchmark("ComputeWindowClip", mapSize_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        BenchmarkSink += ComputeWindowClip(mapSize_px, positions[iteration & positionMask], windowSize_px, cGridSize_px).SourceRect.w;
+    });
+}
+
+// Lots of entities milling about the map (a few of them moving each op), and a scrolling window asking which ones it can see.
+// This should cost about the same on every map size, since the window only looks at the cells under it.
+static void BENCH_QueryWindow(const IntVec2_t& mapSize_Tiles, const IntVec2_t& windowSize_px)
+{
+    constexpr int cEntityCount = 1 << 17;
+    constexpr int cMovesPerQuery = 64;
+
+    const IntVec2_t mapSize_px = {mapSize_Tiles.X * cGridSize_px, mapSize_Tiles.Y * cGridSize_px};
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(mapSize_px, windowSize_px, true);
+    const int positionMask = (int)positions.size() - 1;
+
+    SpatialGrid_t grid;
+    InitSpatialGrid(grid, mapSize_px, 4);
+
+    unsigned int random = 1;
+    auto NextRandom = [&random](int limit) { random = random * 1103515245 + 12345; return (int)((random >> 8) % (unsigned int)limit); };
+
+    for(int entityIndex = 0; entityIndex < cEntityCount; entityIndex++)
+    {
+        AddEntity(grid, {NextRandom(mapSize_px.X), NextRandom(mapSize_px.Y), cGridSize_px, cGridSize_px});
+    }
+
+    std::vector<VisibleEntity_t> visible;
+
+    RunBenchmark("QueryWindow", mapSize_Tiles, windowSize_px, "scroll", [&](long long iteration)
+    {
+        for(int moveIndex = 0; moveIndex < cMovesPerQuery; moveIndex++)
+        {
+            const int entityId = NextRandom(cEntityCount);
+            const SDL_Rect& bounds = grid.Entities[entityId].Bounds;
+
+            MoveEntity(grid, entityId, {WrapIndex(bounds.x + NextRandom(5) - 2, mapSize_px.X), WrapIndex(bounds.y + NextRandom(5) - 2, mapSize_px.Y), bounds.w, bounds.h});
+        }
+
+        BenchmarkSink += QueryWindow(grid, positions[iteration & positionMask], windowSize_px, visible);
+    });
+}
+
+static void BENCH_DrawTiles(const TileMap_t& tileMap, const IntVec2_t& windowSize_px)
+{
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, false);
+    const int positionMask = (int)positions.size() - 1;
+
+    RunBenchmark("DrawTiles", tileMap.Size_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        ClearTileBatch(TileBatch);
+
+        const IntVec2_t topLeftTile = FindGridCoordinateForPoint(positions[iteration & positionMask], cGridSize_px);
+
+        BenchmarkSink += DrawTiles(TileBatch, tileMap, topLeftTile, windowSize_Tiles).w;
+    });
+
+    // the same windows without the TileRenderer_t for their size, to see what it's worth
+    RunBenchmark("DrawTiles_Generic", tileMap.Size_Tiles, windowSize_px, "random", [&](long long iteration)
+    {
+        ClearTileBatch(TileBatch);
+
+        const IntVec2_t topLeftTile = FindGridCoordinateForPoint(positions[iteration & positionMask], cGridSize_px);
+
+        BenchmarkSink += DrawTiles_Generic(TileBatch, tileMap, topLeftTile, windowSize_Tiles, {max(0, topLeftTile.X), max(0, topLeftTile.Y)}, {windowSize_Tiles.X + 1, windowSize_Tiles.Y + 1}).w;
+    });
+}
+
+static void BENCH_RenderWindow(const char* name, const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px, bool scroll)
+{
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, scroll);
+    const int positionMask = (int)positions.size() - 1;
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+
+    if(!AcquireViewportTextures(viewport))
+    {
+        return;
+    }
+
+    RunBenchmark(name, tileMap.Size_Tiles, windowSize_px, scroll ? "scroll" : "random", [&](long long iteration)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[iteration & positionMask];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+        // keeps the per-frame counters from piling up, nothing is published to the history
+        ProfileBeginFrame();
+
+        RenderWindows(&viewport, 1, tileMap);
+
+        // make the renderer actually do the work instead of queueing it
+        SDL_RenderFlush(SDLGlobals.Renderer);
+    });
+
+    ReleaseViewportTextures(viewport);
+}
+
+// A window that stays put over a map with animated tiles in its top layer, 1/60th of a second going by every frame
+static void BENCH_RenderAnimatedWindow(const TileMap_t* const* layers, int layerCount, TileMap_t& animatedLayer, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
+{
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    const IntVec2_t mapSize_px = GetMapSize_px(animatedLayer);
+    const IntVec2_t relToMap_WindowTopLeft = {max(0, (mapSize_px.X - windowSize_px.X) / 2), max(0, (mapSize_px.Y - windowSize_px.Y) / 2)};
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+    viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+    if(!AcquireViewportTextures(viewport, layerCount))
+    {
+        return;
+    }
+
+    RunBenchmark("AnimatedRenderWindow", animatedLayer.Size_Tiles, windowSize_px, "animate", [&](long long iteration)
+    {
+        ProfileBeginFrame();
+
+        UpdateTileAnimations(animatedLayer, (Uint64)iteration * 1000 / 60);
+        RenderWindows(&viewport, 1, layers, layerCount);
+
+        SDL_RenderFlush(SDLGlobals.Renderer);
+    });
+
+    ReleaseViewportTextures(viewport);
+}
+
+// A window that stays put over a map with a layer on top of it, where a tile of the top layer changes every frame (like an animated layer would).
+// editedLayer has to be one of the layers.
+static void BENCH_RenderLayeredWindow(const TileMap_t* const* layers, int layerCount, TileMap_t& editedLayer, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
+{
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    // the middle of the map, or as close as the window can get to it
+    const IntVec2_t mapSize_px = GetMapSize_px(editedLayer);
+    const IntVec2_t relToMap_WindowTopLeft = {max(0, (mapSize_px.X - windowSize_px.X) / 2), max(0, (mapSize_px.Y - windowSize_px.Y) / 2)};
+    const IntVec2_t windowTopLeftTile = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+    viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+    if(!AcquireViewportTextures(viewport, layerCount))
+    {
+        return;
+    }
+
+    const int tileCount = (int)editedLayer.TileSources.size();
+
+    RunBenchmark("LayeredRenderWindow", editedLayer.Size_Tiles, windowSize_px, "edit", [&](long long iteration)
+    {
+        const IntVec2_t editedTile = {min(editedLayer.Size_Tiles.X - 1, windowTopLeftTile.X + (int)(iteration % windowSize_Tiles.X)),
+                                      min(editedLayer.Size_Tiles.Y - 1, windowTopLeftTile.Y + (int)((iteration / windowSize_Tiles.X) % windowSize_Tiles.Y))};
+
+        SetTile(editedLayer, editedTile, (TileId_t)(iteration % tileCount));
+
+        ProfileBeginFrame();
+
+        RenderWindows(&viewport, 1, layers, layerCount);
+
+        SDL_RenderFlush(SDLGlobals.Renderer);
+    });
+
+    ReleaseViewportTextures(viewport);
+}
+
+// A minimap: the same window as BENCH_RenderWindow zoomed out to 1/16, so it sees 256x as much of the map.
+// It's drawn from chunk thumbnails, so it should cost about what the unzoomed window does.
+static void BENCH_RenderMinimapWindow(const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px, bool scroll)
+{
+    const float cMinimapZoom = 1.0f / 16;
+
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), GetZoomedWindowSize_px(windowSize_px, cMinimapZoom), scroll);
+    const int positionMask = (int)positions.size() - 1;
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+    viewport.Zoom = cMinimapZoom;
+
+    if(!AcquireViewportTextures(viewport))
+    {
+        return;
+    }
+
+    RunBenchmark("MinimapRenderWindow", tileMap.Size_Tiles, windowSize_px, scroll ? "scroll" : "random", [&](long long iteration)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[iteration & positionMask];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+        ProfileBeginFrame();
+
+        RenderWindows(&viewport, 1, tileMap);
+
+        SDL_RenderFlush(SDLGlobals.Renderer);
+    });
+
+    ReleaseViewportTextures(viewport);
+    ReleaseChunkThumbnails(tileMap);
+}
+
+// Queues spriteCount sprites scattered over (and a little past) the part of the map a window sees, cut out of random parts of the
+// textures, on 4 layers
+static void BENCH_QueueSprites(SpriteQueue_t& queue, std::mt19937& random, SDL_Texture* const* textures, int textureCount, int spriteCount, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize_px)
+{
+    const int cMaxSpriteSize_px = 24;
+
+    for(int spriteIndex = 0; spriteIndex < spriteCount; spriteIndex++)
+    {
+        SDL_Texture* texture = textures[random() % textureCount];
+        const IntVec2_t textureSize = InquireTextureSize(texture);
+
+        SDL_Rect source = {0, 0, 1 + (int)(random() % min(cMaxSpriteSize_px, textureSize.X)), 1 + (int)(random() % min(cMaxSpriteSize_px, textureSize.Y))};
+        source.x = (int)(random() % (textureSize.X - source.w + 1));
+        source.y = (int)(random() % (textureSize.Y - source.h + 1));
+
+        const IntVec2_t position_px = {relToMap_WindowTopLeft.X - cMaxSpriteSize_px + (int)(random() % (windowSize_px.X + 2 * cMaxSpriteSize_px)),
+                                       relToMap_WindowTopLeft.Y - cMaxSpriteSize_px + (int)(random() % (windowSize_px.Y + 2 * cMaxSpriteSize_px))};
+
+        QueueSprite(queue, texture, source, position_px, (int)(random() % 4));
+    }
+}
+
+// A scrolling window with thousands of sprites over the map, from two textures. Either queued and drawn by RenderWindows (batched),
+// or drawn one SDL_RenderCopy at a time after the map, the way it would be done without a sprite queue.
+static void BENCH_RenderSpriteWindow(const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px, bool batched)
+{
+    const int cSpriteCount = 4096;
+
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, true);
+    const int positionMask = (int)positions.size() - 1;
+
+    SpriteQueue_t spriteQueue = {};
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+    viewport.SpriteQueue = &spriteQueue;
+
+    if(!AcquireViewportTextures(viewport))
+    {
+        return;
+    }
+
+    SDL_Texture* const textures[] = {tileAtlas.Pages[0], tileAtlas.MipPages[0][0]};
+    std::mt19937 random(8642);
+
+    RunBenchmark(batched ? "SpriteQueueRenderWindow" : "SpriteCopyRenderWindow", tileMap.Size_Tiles, windowSize_px, "scroll", [&](long long iteration)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[iteration & positionMask];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+        ProfileBeginFrame();
+
+        BENCH_QueueSprites(spriteQueue, random, textures, 2, cSpriteCount, relToMap_WindowTopLeft, windowSize_px);
+
+        if(batched)
+        {
+            RenderWindows(&viewport, 1, tileMap);
+        }
+        else
+        {
+            std::vector<Sprite_t> sprites;
+            sprites.swap(spriteQueue.Sprites);
+
+            RenderWindows(&viewport, 1, tileMap);
+
+            SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+
+            for(const Sprite_t& sprite : sprites)
+            {
+                const SDL_Rect destRect = {sprite.Position_px.X - relToMap_WindowTopLeft.X, sprite.Position_px.Y - relToMap_WindowTopLeft.Y, sprite.Source.w, sprite.Source.h};
+                SDL_RenderCopy(SDLGlobals.Renderer, sprite.Texture, &sprite.Source, &destRect);
+            }
+
+            SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+        }
+
+        SDL_RenderFlush(SDLGlobals.Renderer);
+    });
+
+    ReleaseViewportTextures(viewport);
+}
+
+static void BENCH_CpuRenderWindow(const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px, bool scroll)
+{
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, scroll);
+    const int positionMask = (int)positions.size() - 1;
+
+    PixelBuffer_t screenBuffer;
+    PixelBuffer_t mapBuffer;
+
+    RunBenchmark("CPU_RenderWindow", tileMap.Size_Tiles, windowSize_px, scroll ? "scroll" : "random", [&](long long iteration)
+    {
+        CPU_RenderWindow(screenBuffer, mapBuffer, tileAtlas, tileMap, windowSize_Tiles, positions[iteration & positionMask]);
+        BenchmarkSink += (int)screenBuffer.Pixels[0];
+    });
+}
+
+// Sets SDL up with the dummy video driver and SDL's software renderer drawing into a plain surface, so no window or GPU is needed.
+// Returns the surface (free it after destroying the renderer), nullptr if SDL couldn't be set up.
+static SDL_Surface* InitHeadlessSDL()
+{
+    SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+
+    if(SDL_Init(SDL_INIT_VIDEO) < 0)
+    {
+        printf("SDL could not be initialized: %s\n", SDL_GetError());
+        return nullptr;
+    }
+
+    SDL_Surface* screenSurface = SDL_CreateRGBSurfaceWithFormat(0, cScreenResolution.X, cScreenResolution.Y, 32, SDL_PIXELFORMAT_RGBA8888);
+    SDLGlobals.Window = nullptr;
+    SDLGlobals.Renderer = SDL_CreateSoftwareRenderer(screenSurface);
+
+    if(SDLGlobals.Renderer == nullptr)
+    {
+        printf("An error occured while trying to create the software renderer : %s\n", SDL_GetError());
+        SDL_FreeSurface(screenSurface);
+        return nullptr;
+    }
+
+    return screenSurface;
+}
+
+// Headless, see InitHeadlessSDL
+int RunBenchmarks()
+{
+    SDL_Surface* screenSurface = InitHeadlessSDL();
+
+    if(screenSurface == nullptr)
+    {
+        return 1;
+    }
+
+    // the tileset on its own, with CPU copies for the CPU compositor
+    const char* const tileSetPaths[] = {"Debug16.png"};
+    TileSource_t tileSetPlacement = {0};
+    TileAtlas_t tileAtlas;
+
+    if(!BuildTileAtlas(tileAtlas, tileSetPaths, 1, &tileSetPlacement, true))
+    {
+        return 1;
+    }
+
+    // copies of it, with pages only big enough for one copy each
+    const char* const multiPageTileSetPaths[] = {"Debug16.png", "Debug16.png", "Debug16.png"};
+    const int multiPageTileSetCount = (int)(sizeof(multiPageTileSetPaths) / sizeof(multiPageTileSetPaths[0]));
+    TileSource_t multiPagePlacements[multiPageTileSetCount] = {};
+    TileAtlas_t multiPageTileAtlas;
+
+    if(!BuildTileAtlas(multiPageTileAtlas, multiPageTileSetPaths, multiPageTileSetCount, multiPagePlacements, false, cTileSetSize_Tiles.X * cGridSize_px))
+    {
+        return 1;
+    }
+
+    DEMO_ShowRenderTextures = false;
+    RenderTargetPool.MaxBytes = cRenderTargetPoolMaxBytes;
+
+    const IntVec2_t mapSizes_Tiles[] = {{8, 8}, {256, 256}, {2048, 2048}};
+    const IntVec2_t windowSizes_px[] = {{32, 32}, {320, 240}, {1920, 1072}};
+
+    printf("benchmark,map_tiles,window_px,pattern,iterations,ns_per_op,ops_per_sec\n");
+
+    for(const IntVec2_t& mapSize_Tiles : mapSizes_Tiles)
+    {
+        TileMap_t tileMap;
+        BENCH_BuildTileMap(tileMap, mapSize_Tiles, tileSetPlacement);
+
+        TileMap_t multiPageTileMap;
+        BENCH_BuildMultiPageTileMap(multiPageTileMap, mapSize_Tiles, multiPagePlacements, multiPageTileSetCount);
+
+        // the same map again, backed by a map file
+        const char* const cBenchmarkMapFilePath = "bench_map.wmimap";
+        TileMap_t mappedTileMap;
+
+        if(!SaveTileMapFile(tileMap, cBenchmarkMapFilePath) || !OpenTileMapFile(mappedTileMap, cBenchmarkMapFilePath))
+        {
+            return 1;
+        }
+
+        RunBenchmark("OpenTileMapFile", mapSize_Tiles, {0, 0}, "none", [&](long long)
+        {
+            TileMap_t openedTileMap;
+            BenchmarkSink += OpenTileMapFile(openedTileMap, cBenchmarkMapFilePath) ? 1 : 0;
+        });
+
+        for(const IntVec2_t& windowSize_px : windowSizes_px)
+        {
+            BENCH_Geometry(mapSize_Tiles, windowSize_px);
+            BENCH_QueryWindow(mapSize_Tiles, windowSize_px);
+            BENCH_DrawTiles(tileMap, windowSize_px);
+            BENCH_RenderWindow("RenderWindow", tileMap, tileAtlas, windowSize_px, false);
+            BENCH_RenderWindow("RenderWindow", tileMap, tileAtlas, windowSize_px, true);
+
+            ParallelMapRender = true;
+            BENCH_RenderWindow("ParallelRenderWindow", tileMap, tileAtlas, windowSize_px, false);
+            BENCH_RenderWindow("ParallelRenderWindow", tileMap, tileAtlas, windowSize_px, true);
+            ParallelMapRender = false;
+
+            BENCH_CpuRenderWindow(tileMap, tileAtlas, windowSize_px, false);
+            BENCH_CpuRenderWindow(tileMap, tileAtlas, windowSize_px, true);
+
+            // a layer over the map that gets edited
+            TileMap_t overlayLayer;
+            BENCH_BuildOverlayLayer(overlayLayer, mapSize_Tiles, tileSetPlacement);
+
+            const TileMap_t* const overlaidLayers[] = {&tileMap, &overlayLayer};
+
+            // the map doesn't change and the layer over it does every frame, only the layer's map render texture should be drawn in
+            BENCH_RenderLayeredWindow(overlaidLayers, 2, overlayLayer, tileAtlas, windowSize_px);
+
+            // the same again with animated tiles in the layer over the map
+            TileMap_t animatedLayer;
+            BENCH_BuildOverlayLayer(animatedLayer, mapSize_Tiles, tileSetPlacement);
+            BENCH_AddAnimatedTiles(animatedLayer, tileSetPlacement);
+
+            const TileMap_t* const animatedLayers[] = {&tileMap, &animatedLayer};
+            BENCH_RenderAnimatedWindow(animatedLayers, 2, animatedLayer, tileAtlas, windowSize_px);
+
+            BENCH_RenderMinimapWindow(tileMap, tileAtlas, windowSize_px, false);
+            BENCH_RenderMinimapWindow(tileMap, tileAtlas, windowSize_px, true);
+
+            // thousands of sprites over the map, queued and batched vs. a copy each
+            BENCH_RenderSpriteWindow(tileMap, tileAtlas, windowSize_px, true);
+            BENCH_RenderSpriteWindow(tileMap, tileAtlas, windowSize_px, false);
+
+            BENCH_RenderWindow("MappedMapRenderWindow", mappedTileMap, tileAtlas, windowSize_px, false);
+            BENCH_RenderWindow("MappedMapRenderWindow", mappedTileMap, tileAtlas, windowSize_px, true);
+
+            // one SDL_RenderGeometry per atlas page
+            BENCH_RenderWindow("MultiPageRenderWindow", multiPageTileMap, multiPageTileAtlas, windowSize_px, false);
+            BENCH_RenderWindow("MultiPageRenderWindow", multiPageTileMap, multiPageTileAtlas, windowSize_px, true);
+        }
+
+        // the file has to be unmapped before it can be deleted on Windows, and the prefetcher can't be looking at it
+        StopChunkPrefetcher(ChunkPrefetcher);
+        mappedTileMap = TileMap_t();
+        remove(cBenchmarkMapFilePath);
+    }
+
+    DestroyRenderTargetPool(RenderTargetPool);
+    StopWorkerPool(WorkerPool);
+    StopChunkPrefetcher(ChunkPrefetcher);
+    DestroyTileAtlas(tileAtlas);
+    DestroyTileAtlas(multiPageTileAtlas);
+    SDL_DestroyRenderer(SDLGlobals.Renderer);
+    SDL_FreeSurface(screenSurface);
+    SDL_Quit();
+
+    return 0;
+}
+
+// The batch classifier has to agree with GetWindowIntersectType everywhere, including the odd sizes the SIMD tail handling sees
+static void DoClassifierTests()
+{
+    const IntVec2_t mapSize_px = {100, 60};
+    const IntVec2_t windowSizes[] = {{0, 0}, {1, 1}, {16, 16}, {50, 50}, {100, 60}, {130, 20}};
+
+    std::vector<IntVec2_t> corners;
+    std::vector<IntVec2_t> sizes;
+
+    for(const IntVec2_t& windowSize : windowSizes)
+    {
+        for(int y = -70; y <= 70; y++)
+        {
+            for(int x = -140; x <= 110; x++)
+            {
+                corners.push_back({x, y});
+                sizes.push_back(windowSize);
+            }
+        }
+    }
+
+    // odd count so every path gets a tail
+    corners.push_back({-3, 5});
+    sizes.push_back({8, 8});
+
+    std::vector<WindowIntersectType_t> batchTypes(corners.size());
+    ClassifyWindowIntersectTypes(mapSize_px, corners.data(), sizes.data(), (int)corners.size(), batchTypes.data());
+
+    for(size_t windowIndex = 0; windowIndex < corners.size(); windowIndex++)
+    {
+        const WindowIntersectType_t scalarType = GetWindowIntersectType(mapSize_px, corners[windowIndex], sizes[windowIndex]);
+
+        if(batchTypes[windowIndex] != scalarType)
+        {
+            printf("Batch classifier mismatch at (%d, %d) size (%d, %d): %d vs %d\n", corners[windowIndex].X, corners[windowIndex].Y, sizes[windowIndex].X, sizes[windowIndex].Y, (int)batchTypes[windowIndex], (int)scalarType);
+            assert(0);
+        }
+    }
+}
 
-        case WindowIntersectType_t::NorthEast:
+static bool SameRect(const SDL_Rect& a, const SDL_Rect& b)
+{
+    // any empty rect is as good as any other
+    if((a.w == 0 || a.h == 0) && (b.w == 0 || b.h == 0))
+    {
+        return true;
+    }
+
+    return (a.x == b.x) && (a.y == b.y) && (a.w == b.w) && (a.h == b.h);
+}
+
+// FindGridPoints (whichever version this CPU gets) has to agree with FindGridPoint, and FindGridPoint with what rounding down means
+static void DoGridPointTests()
+{
+    const int gridSizes[] = {1, 7, 10, 16, 32};
+
+    std::vector<IntVec2_t> points;
+
+    for(int y = -70; y <= 70; y += 3)
+    {
+        for(int x = -140; x <= 110; x++)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = winP.X;
-            mapRenderRect.y = 0;
+            points.push_back({x, y});
+        }
+    }
 
-            mapRenderRect.w = eastWidth;
-            mapRenderRect.h = northHeight;
+    // odd count so the SSE2 version leaves a tail
+    points.push_back({-1000001, 999999});
 
-            return mapRenderRect;
+    std::vector<GridPoint_t> gridPoints(points.size());
+
+    for(int gridSize : gridSizes)
+    {
+        FindGridPoints(points.data(), (int)points.size(), gridSize, gridPoints.data());
+
+        for(size_t pointIndex = 0; pointIndex < points.size(); pointIndex++)
+        {
+            const IntVec2_t& point = points[pointIndex];
+            const GridPoint_t gridPoint = FindGridPoint(point, gridSize);
+            const GridPoint_t& batchGridPoint = gridPoints[pointIndex];
+
+            // the offset is never negative and never reaches the next cell, so the cell has to be the one rounding down gives
+            const bool offsetsInCell = InRange(0, gridPoint.Offset.X, gridSize - 1) && InRange(0, gridPoint.Offset.Y, gridSize - 1);
+            const bool backToPoint = (gridPoint.Cell.X * gridSize + gridPoint.Offset.X == point.X) && (gridPoint.Cell.Y * gridSize + gridPoint.Offset.Y == point.Y);
+
+            const bool sameAsBatch = (batchGridPoint.Cell.X == gridPoint.Cell.X) && (batchGridPoint.Cell.Y == gridPoint.Cell.Y) &&
+                                     (batchGridPoint.Offset.X == gridPoint.Offset.X) && (batchGridPoint.Offset.Y == gridPoint.Offset.Y);
+
+            if(!offsetsInCell || !backToPoint || !sameAsBatch)
+            {
+                printf("Grid point mismatch for (%d, %d) on a %d px grid: cell (%d, %d) offset (%d, %d), batch cell (%d, %d) offset (%d, %d)\n", point.X, point.Y, gridSize,
+                    gridPoint.Cell.X, gridPoint.Cell.Y, gridPoint.Offset.X, gridPoint.Offset.Y, batchGridPoint.Cell.X, batchGridPoint.Cell.Y, batchGridPoint.Offset.X, batchGridPoint.Offset.Y);
+                assert(0);
+            }
         }
+    }
 
-        case WindowIntersectType_t::East:
+    assert(FindGridCoordinateForPoint_RoundUp({-1, 17}, 16).X == 0 && FindGridCoordinateForPoint_RoundUp({-1, 17}, 16).Y == 2);
+    assert(FindGridCoordinateForPoint_RoundUp({-16, 16}, 16).X == -1 && FindGridCoordinateForPoint_RoundUp({-16, 16}, 16).Y == 1);
+}
+
+// ComputeWindowClip has to agree with the per-case functions for every window that's no bigger than the map
+static void DoClipTests()
+{
+    const IntVec2_t mapSize_Tiles = {8, 6};
+    const IntVec2_t mapSize_px = {mapSize_Tiles.X * cGridSize_px, mapSize_Tiles.Y * cGridSize_px};
+    const IntVec2_t windowSizes_Tiles[] = {{1, 1}, {2, 2}, {3, 2}, {8, 6}};
+
+    for(const IntVec2_t& windowSize_Tiles : windowSizes_Tiles)
+    {
+        const IntVec2_t windowSize_px = {windowSize_Tiles.X * cGridSize_px, windowSize_Tiles.Y * cGridSize_px};
+
+        for(int y = -windowSize_px.Y - cGridSize_px; y <= mapSize_px.Y + cGridSize_px; y++)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = winP.X;
-            mapRenderRect.y = winP.Y;
+            for(int x = -windowSize_px.X - cGridSize_px; x <= mapSize_px.X + cGridSize_px; x++)
+            {
+                const IntVec2_t windowTopLeft = {x, y};
 
-            mapRenderRect.w = eastWidth;
-            mapRenderRect.h = winSiz.Y;
+                const WindowClip_t clip = ComputeWindowClip(mapSize_px, windowTopLeft, windowSize_px, cGridSize_px);
 
-            return mapRenderRect;
+                const WindowIntersectType_t intersectType = GetWindowIntersectType(mapSize_px, windowTopLeft, windowSize_px);
+                const SDL_Rect mapRect = GetMapRenderRectangle(mapSize_px, windowTopLeft, windowSize_px);
+                const SDL_Rect renderedRect = GetRenderedRectangle(mapSize_Tiles, windowSize_Tiles, windowTopLeft);
+                const SDL_Rect sourceRect = GetScreenReadArea(windowTopLeft, windowSize_px, intersectType, renderedRect);
+                const IntVec2_t destOffset = GetDrawRenderOffset(sourceRect, windowSize_px, intersectType);
+
+                const bool sourceEmpty = (sourceRect.w == 0 || sourceRect.h == 0);
+
+                const bool same = SameRect(clip.MapRect, mapRect) &&
+                                  SameRect(clip.RenderedRect, renderedRect) &&
+                                  SameRect(clip.SourceRect, sourceRect) &&
+                                  (sourceEmpty || (clip.DestOffset.X == destOffset.X && clip.DestOffset.Y == destOffset.Y));
+
+                if(!same)
+                {
+                    printf("Clip mismatch for a %dx%d window at (%d, %d)\n", windowSize_px.X, windowSize_px.Y, x, y);
+                    assert(0);
+                }
+            }
         }
+    }
+}
 
-        case WindowIntersectType_t::SouthEast:
+// One window for each intersect type, with every rectangle worked out for it by hand. The map is 100 x 100 px in 10 px tiles,
+// the window is 50 x 50 px.
+static void DoIntersectCaseTests()
+{
+    struct IntersectCase_t
+    {
+        IntVec2_t WindowTopLeft;
+        WindowIntersectType_t IntersectType;
+        SDL_Rect MapRect;
+        SDL_Rect RenderedRect;
+        SDL_Rect SourceRect;
+        IntVec2_t DestOffset;
+    };
+
+    const IntVec2_t mapSize_px = {100, 100};
+    const IntVec2_t windowSize_px = {50, 50};
+    const int gridSize = 10;
+
+    const IntersectCase_t cases[] =
+    {
+    //   window top left    intersect type                          map rect                rendered rect           source rect         dest offset
+        {{20, 20},          WindowIntersectType_t::TotallyIn,       {20, 20, 50, 50},       {20, 20, 60, 60},       {0, 0, 50, 50},     {0, 0}},
+        {{200, 200},        WindowIntersectType_t::TotallyOut,      {0, 0, 0, 0},           {0, 0, 0, 0},           {0, 0, 0, 0},       {0, 0}},
+        {{-20, -20},        WindowIntersectType_t::NorthWest,       {0, 0, 30, 30},         {0, 0, 40, 40},         {0, 0, 30, 30},     {20, 20}},
+        {{20, -20},         WindowIntersectType_t::North,           {20, 0, 50, 30},        {20, 0, 60, 40},        {0, 0, 50, 30},     {0, 20}},
+        {{80, -20},         WindowIntersectType_t::NorthEast,       {80, 0, 20, 30},        {80, 0, 20, 40},        {0, 0, 20, 30},     {0, 20}},
+        {{80, 20},          WindowIntersectType_t::East,            {80, 20, 20, 50},       {80, 20, 20, 60},       {0, 0, 20, 50},     {0, 0}},
+        {{80, 80},          WindowIntersectType_t::SouthEast,       {80, 80, 20, 20},       {80, 80, 20, 20},       {0, 0, 20, 20},     {0, 0}},
+        {{25, 80},          WindowIntersectType_t::South,           {25, 80, 50, 20},       {20, 80, 60, 20},       {5, 0, 50, 20},     {0, 0}},
+        {{-20, 80},         WindowIntersectType_t::SouthWest,       {0, 80, 30, 20},        {0, 80, 40, 20},        {0, 0, 30, 20},     {20, 0}},
+        {{-20, 25},         WindowIntersectType_t::West,            {0, 25, 30, 50},        {0, 20, 40, 60},        {0, 5, 30, 50},     {20, 0}},
+    };
+
+    for(const IntersectCase_t& intersectCase : cases)
+    {
+        const WindowIntersectType_t intersectType = GetWindowIntersectType(mapSize_px, intersectCase.WindowTopLeft, windowSize_px);
+        const SDL_Rect mapRect = GetMapRenderRectangle(mapSize_px, intersectCase.WindowTopLeft, windowSize_px);
+        const WindowClip_t clip = ComputeWindowClip(mapSize_px, intersectCase.WindowTopLeft, windowSize_px, gridSize);
+
+        WindowIntersectType_t batchType = WindowIntersectType_t::TotallyOut;
+        ClassifyWindowIntersectTypes(mapSize_px, &intersectCase.WindowTopLeft, &windowSize_px, 1, &batchType);
+
+        const bool same = (intersectType == intersectCase.IntersectType) && (batchType == intersectCase.IntersectType) &&
+                          SameRect(mapRect, intersectCase.MapRect) &&
+                          SameRect(clip.MapRect, intersectCase.MapRect) &&
+                          SameRect(clip.RenderedRect, intersectCase.RenderedRect) &&
+                          SameRect(clip.SourceRect, intersectCase.SourceRect) &&
+                          (clip.DestOffset.X == intersectCase.DestOffset.X) && (clip.DestOffset.Y == intersectCase.DestOffset.Y);
+
+        if(!same)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = winP.X;
-            mapRenderRect.y = winP.Y;
+            printf("Wrong rectangles for the window at (%d, %d), intersect type %d\n", intersectCase.WindowTopLeft.X, intersectCase.WindowTopLeft.Y, (int)intersectType);
+            assert(0);
+        }
+    }
+}
 
-            mapRenderRect.w = eastWidth;
-            mapRenderRect.h = southHeight;
+// Every window position around a small map, checked against what the rectangles have to be rather than against another version of the same code:
+//  - the map rect is just the window and the map intersected
+//  - the intersect type is which sides of the map the window crosses
+//  - the rendered tiles cover the map rect, and copying the source rect to the dest offset puts the map rect in the right place in the window
+static void DoIntersectSweepTests()
+{
+    const IntVec2_t mapSize_Tiles = {8, 6};
+    const IntVec2_t mapSize_px = {mapSize_Tiles.X * cGridSize_px, mapSize_Tiles.Y * cGridSize_px};
+    const SDL_Rect mapArea = {0, 0, mapSize_px.X, mapSize_px.Y};
 
-            return mapRenderRect;
+    // whole tiles like the renderer uses, then some that aren't, then bigger than the map
+    const IntVec2_t windowSizes_px[] = {{16, 16}, {32, 48}, {128, 96}, {5, 7}, {40, 1}, {160, 112}};
+
+    for(const IntVec2_t& windowSize_px : windowSizes_px)
+    {
+        const bool wholeTiles = (windowSize_px.X % cGridSize_px == 0) && (windowSize_px.Y % cGridSize_px == 0);
+        const bool fitsInMap = (windowSize_px.X <= mapSize_px.X) && (windowSize_px.Y <= mapSize_px.Y);
+
+        for(int y = -windowSize_px.Y - cGridSize_px; y <= mapSize_px.Y + cGridSize_px; y++)
+        {
+            for(int x = -windowSize_px.X - cGridSize_px; x <= mapSize_px.X + cGridSize_px; x++)
+            {
+                const IntVec2_t windowTopLeft = {x, y};
+                const SDL_Rect windowArea = {x, y, windowSize_px.X, windowSize_px.Y};
+
+                SDL_Rect expectedMapRect = {0, 0, 0, 0};
+                const bool overlaps = SDL_IntersectRect(&windowArea, &mapArea, &expectedMapRect) == SDL_TRUE;
+
+                // SDL leaves whatever it worked out in there, which can have a negative size
+                if(!overlaps)
+                {
+                    expectedMapRect = {0, 0, 0, 0};
+                }
+
+                const WindowClip_t clip = ComputeWindowClip(mapSize_px, windowTopLeft, windowSize_px, cGridSize_px);
+                bool good = SameRect(clip.MapRect, expectedMapRect);
+
+                // the per-case functions only handle windows that fit in the map, see ComputeWindowClip
+                if(fitsInMap)
+                {
+                    const WindowIntersectType_t intersectType = GetWindowIntersectType(mapSize_px, windowTopLeft, windowSize_px);
+
+                    good = good && SameRect(GetMapRenderRectangle(mapSize_px, windowTopLeft, windowSize_px), expectedMapRect);
+
+                    if(overlaps)
+                    {
+                        // a window corner on the map's east / south edge counts as off the map, same as PointInRect
+                        const bool offNorth = y < 0;
+                        const bool offSouth = y + windowSize_px.Y >= mapSize_px.Y;
+                        const bool offWest = x < 0;
+                        const bool offEast = x + windowSize_px.X >= mapSize_px.X;
+
+                        const WindowIntersectType_t expectedType =
+                            (offNorth && offWest) ? WindowIntersectType_t::NorthWest :
+                            (offNorth && offEast) ? WindowIntersectType_t::NorthEast :
+                            (offSouth && offWest) ? WindowIntersectType_t::SouthWest :
+                            (offSouth && offEast) ? WindowIntersectType_t::SouthEast :
+                            offNorth ? WindowIntersectType_t::North :
+                            offSouth ? WindowIntersectType_t::South :
+                            offWest ? WindowIntersectType_t::West :
+                            offEast ? WindowIntersectType_t::East :
+                                      WindowIntersectType_t::TotallyIn;
+
+                        good = good && (intersectType == expectedType);
+                    }
+                }
+
+                // the renderer's windows are whole tiles, with one more tile each way in the map render texture
+                if(wholeTiles && overlaps)
+                {
+                    const SDL_Rect& rendered = clip.RenderedRect;
+                    SDL_Rect coveredMapRect;
+
+                    good = good && (rendered.x % cGridSize_px == 0) && (rendered.y % cGridSize_px == 0) && (rendered.w % cGridSize_px == 0) && (rendered.h % cGridSize_px == 0);
+                    good = good && SDL_IntersectRect(&rendered, &mapArea, &coveredMapRect) && SameRect(coveredMapRect, rendered);
+                    good = good && SDL_IntersectRect(&rendered, &expectedMapRect, &coveredMapRect) && SameRect(coveredMapRect, expectedMapRect);
+                    good = good && (rendered.w <= windowSize_px.X + cGridSize_px) && (rendered.h <= windowSize_px.Y + cGridSize_px);
+
+                    good = good && (rendered.x + clip.SourceRect.x == expectedMapRect.x) && (clip.SourceRect.w == expectedMapRect.w);
+                    good = good && (rendered.y + clip.SourceRect.y == expectedMapRect.y) && (clip.SourceRect.h == expectedMapRect.h);
+                    good = good && (clip.DestOffset.X == expectedMapRect.x - x) && (clip.DestOffset.Y == expectedMapRect.y - y);
+                }
+
+                if(!good)
+                {
+                    printf("Bad clip for a %dx%d window at (%d, %d)\n", windowSize_px.X, windowSize_px.Y, x, y);
+                    assert(0);
+                }
+            }
         }
+    }
+}
 
-        case WindowIntersectType_t::South:
+// PackTileAtlas has to keep every image inside its page, with no two images on a page overlapping
+static void DoAtlasPackingTests()
+{
+    const IntVec2_t maxPageSize = {64, 64};
+    const IntVec2_t sizes[] = {{16, 16}, {32, 16}, {64, 64}, {16, 48}, {48, 32}, {16, 16}, {64, 16}, {8, 8}, {32, 32}, {24, 40}};
+    const int imageCount = (int)(sizeof(sizes) / sizeof(sizes[0]));
+
+    TileSource_t placements[imageCount] = {};
+    std::vector<IntVec2_t> pageSizes;
+
+    const bool packed = PackTileAtlas(sizes, imageCount, maxPageSize, placements, pageSizes);
+    assert(packed);
+    (void)packed;
+
+    for(int imageIndex = 0; imageIndex < imageCount; imageIndex++)
+    {
+        const TileSource_t& placement = placements[imageIndex];
+
+        const bool inPage = (placement.Page >= 0) && (placement.Page < (int)pageSizes.size()) &&
+                            (placement.Rect.w == sizes[imageIndex].X) && (placement.Rect.h == sizes[imageIndex].Y) &&
+                            (placement.Rect.x >= 0) && (placement.Rect.x + placement.Rect.w <= pageSizes[placement.Page].X) &&
+                            (placement.Rect.y >= 0) && (placement.Rect.y + placement.Rect.h <= pageSizes[placement.Page].Y);
+
+        bool overlaps = false;
+
+        for(int otherIndex = 0; otherIndex < imageIndex; otherIndex++)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = winP.X;
-            mapRenderRect.y = winP.Y;
+            overlaps = overlaps || (placements[otherIndex].Page == placement.Page && SDL_HasIntersection(&placements[otherIndex].Rect, &placement.Rect));
+        }
 
-            mapRenderRect.w = winSiz.X;
-            mapRenderRect.h = southHeight;
+        if(!inPage || overlaps)
+        {
+            printf("Bad atlas placement for a %dx%d image: page %d, (%d, %d)\n", sizes[imageIndex].X, sizes[imageIndex].Y, placement.Page, placement.Rect.x, placement.Rect.y);
+            assert(0);
+        }
+    }
 
-            return mapRenderRect;
+    for(const IntVec2_t& pageSize : pageSizes)
+    {
+        assert(pageSize.X <= maxPageSize.X && pageSize.Y <= maxPageSize.Y);
+        (void)pageSize;
+    }
+
+    // too big for any page
+    const IntVec2_t tooBig = {65, 8};
+    TileSource_t tooBigPlacement = {0};
+
+    const bool tooBigPacked = PackTileAtlas(&tooBig, 1, maxPageSize, &tooBigPlacement, pageSizes);
+    assert(!tooBigPacked);
+    (void)tooBigPacked;
+}
+
+// Checks QueryWindow against looking at every entity, while entities get added, moved about (some a long way, some off the map,
+// some growing) and removed
+static void DoSpatialGridTests()
+{
+    constexpr IntVec2_t cMapSize_px = {40 * cGridSize_px, 30 * cGridSize_px};
+
+    SpatialGrid_t grid;
+    InitSpatialGrid(grid, cMapSize_px, 4);
+
+    std::vector<int> entityIds;
+    std::vector<VisibleEntity_t> visible;
+
+    unsigned int random = 12345;
+    auto NextRandom = [&random](int limit) { random = random * 1103515245 + 12345; return (int)((random >> 8) % (unsigned int)limit); };
+
+    auto RandomBounds = [&NextRandom, &cMapSize_px]() -> SDL_Rect
+    {
+        return {NextRandom(cMapSize_px.X + 200) - 100, NextRandom(cMapSize_px.Y + 200) - 100, NextRandom(3 * cGridSize_px), NextRandom(3 * cGridSize_px)};
+    };
+
+    for(int step = 0; step < 400; step++)
+    {
+        const int action = NextRandom(10);
+
+        if(action < 4 || entityIds.empty())
+        {
+            entityIds.push_back(AddEntity(grid, RandomBounds()));
         }
+        else if(action < 8)
+        {
+            const int entityId = entityIds[NextRandom((int)entityIds.size())];
+            const SDL_Rect& bounds = grid.Entities[entityId].Bounds;
 
-        case WindowIntersectType_t::SouthWest:
+            // mostly little moves, sometimes a jump
+            if(action < 7)
+            {
+                MoveEntity(grid, entityId, {bounds.x + NextRandom(9) - 4, bounds.y + NextRandom(9) - 4, bounds.w, bounds.h});
+            }
+            else
+            {
+                MoveEntity(grid, entityId, RandomBounds());
+            }
+        }
+        else
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = 0;
-            mapRenderRect.y = winP.Y;
+            const int index = NextRandom((int)entityIds.size());
+
+            RemoveEntity(grid, entityIds[index]);
+            entityIds.erase(entityIds.begin() + index);
+        }
+
+        const IntVec2_t windowSize_px = {1 + NextRandom(200), 1 + NextRandom(200)};
+        const IntVec2_t relToMap_WindowTopLeft = {NextRandom(cMapSize_px.X + 400) - 200, NextRandom(cMapSize_px.Y + 400) - 200};
+
+        QueryWindow(grid, relToMap_WindowTopLeft, windowSize_px, visible);
+
+        int expectedCount = 0;
+
+        for(int entityId : entityIds)
+        {
+            const SDL_Rect& bounds = grid.Entities[entityId].Bounds;
+            const SDL_Rect windowRect = {relToMap_WindowTopLeft.X, relToMap_WindowTopLeft.Y, windowSize_px.X, windowSize_px.Y};
+
+            SDL_Rect expected;
+
+            if(!SDL_IntersectRect(&bounds, &windowRect, &expected))
+            {
+                continue;
+            }
+
+            expectedCount++;
+
+            const VisibleEntity_t* found = nullptr;
+
+            for(const VisibleEntity_t& visibleEntity : visible)
+            {
+                found = (visibleEntity.EntityId == entityId) ? &visibleEntity : found;
+            }
+
+            const bool matches = found &&
+                found->DestRect.x == expected.x - windowRect.x && found->DestRect.y == expected.y - windowRect.y &&
+                found->DestRect.w == expected.w && found->DestRect.h == expected.h &&
+                found->SourceRect.x == expected.x - bounds.x && found->SourceRect.y == expected.y - bounds.y &&
+                found->SourceRect.w == expected.w && found->SourceRect.h == expected.h;
+
+            if(!matches)
+            {
+                printf("QueryWindow got entity %d (%d, %d, %d, %d) wrong for a %dx%d window at (%d, %d)\n", entityId, bounds.x, bounds.y, bounds.w, bounds.h,
+                    windowSize_px.X, windowSize_px.Y, relToMap_WindowTopLeft.X, relToMap_WindowTopLeft.Y);
+                assert(0);
+            }
+        }
+
+        assert((int)visible.size() == expectedCount);
+        (void)expectedCount;
+    }
+}
+
+// Every TileRenderer_t has to batch exactly the same tiles as DrawTiles_Generic, in whatever order, into a plain map render
+// texture and into a ring buffer one (which is usually bigger, the render target pool rounds sizes up)
+static void DoTileRendererTests()
+{
+    TileMap_t tileMap;
+    tileMap.Size_Tiles = {150, 100};
+
+    const TileId_t firstTileId = AddTileSetTiles(tileMap, {0, {0, 0, cTileSetSize_Tiles.X * cGridSize_px, cTileSetSize_Tiles.Y * cGridSize_px}});
+    const int tileSetTileCount = cTileSetSize_Tiles.X * cTileSetSize_Tiles.Y;
+
+    for(int rowIndex = 0; rowIndex < tileMap.Size_Tiles.Y; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < tileMap.Size_Tiles.X; columnIndex++)
+        {
+            // some empty tiles, and one whole chunk that's never made
+            const bool inMissingChunk = (ChunkCoordinateForTile({columnIndex, rowIndex}).X == 1) && (ChunkCoordinateForTile({columnIndex, rowIndex}).Y == 1);
+
+            if((columnIndex * 3 + rowIndex) % 5 != 0 && !inMissingChunk)
+            {
+                WriteTile(tileMap, {columnIndex, rowIndex}, (TileId_t)(firstTileId + (rowIndex * 7 + columnIndex) % tileSetTileCount));
+            }
+        }
+    }
+
+    auto DestOrder = [](const TileDraw_t& a, const TileDraw_t& b) { return (a.Dest.y != b.Dest.y) ? (a.Dest.y < b.Dest.y) : (a.Dest.x < b.Dest.x); };
+
+    TileBatch_t specializedBatch;
+    TileBatch_t genericBatch;
+
+    for(const TileRendererSpecialization_t& specialization : cTileRendererSpecializations)
+    {
+        if(specialization.GridSize_px != cGridSize_px)
+        {
+            continue;
+        }
+
+        // every window position for the small windows, a sample for the big ones
+        const int step = 1 + specialization.WindowSize_Tiles.X / 8;
+
+        for(int y = -specialization.WindowSize_Tiles.Y - 2; y <= tileMap.Size_Tiles.Y + 1; y += step)
+        {
+            for(int x = -specialization.WindowSize_Tiles.X - 2; x <= tileMap.Size_Tiles.X + 1; x += step)
+            {
+                // where DrawTiles puts them, and where RenderMapRegionIncremental's ring buffer does
+                const IntVec2_t plainSize_Tiles = {specialization.WindowSize_Tiles.X + 1, specialization.WindowSize_Tiles.Y + 1};
+                const IntVec2_t ringSize_Tiles = {plainSize_Tiles.X + 3, plainSize_Tiles.Y + 5};
+                const IntVec2_t destOrigins_Tiles[] = {{max(0, x), max(0, y)}, {0, 0}};
+                const IntVec2_t destSizes_Tiles[] = {plainSize_Tiles, ringSize_Tiles};
+
+                for(int destIndex = 0; destIndex < 2; destIndex++)
+                {
+                    const IntVec2_t& destOrigin_Tiles = destOrigins_Tiles[destIndex];
+                    const IntVec2_t& destSize_Tiles = destSizes_Tiles[destIndex];
+
+                    ClearTileBatch(specializedBatch);
+                    ClearTileBatch(genericBatch);
+
+                    const SDL_Rect specializedRect = specialization.DrawTiles(specializedBatch, tileMap, {x, y}, destOrigin_Tiles, destSize_Tiles);
+                    const SDL_Rect genericRect = DrawTiles_Generic(genericBatch, tileMap, {x, y}, specialization.WindowSize_Tiles, destOrigin_Tiles, destSize_Tiles);
+
+                    std::sort(specializedBatch.Draws.begin(), specializedBatch.Draws.end(), DestOrder);
+                    std::sort(genericBatch.Draws.begin(), genericBatch.Draws.end(), DestOrder);
+
+                    bool same = SameRect(specializedRect, genericRect) && (specializedBatch.Draws.size() == genericBatch.Draws.size());
+
+                    for(size_t drawIndex = 0; same && drawIndex < genericBatch.Draws.size(); drawIndex++)
+                    {
+                        const TileDraw_t& a = specializedBatch.Draws[drawIndex];
+                        const TileDraw_t& b = genericBatch.Draws[drawIndex];
+
+                        same = (a.Page == b.Page) && SameRect(a.Source, b.Source) && SameRect(a.Dest, b.Dest);
+                    }
+
+                    if(!same)
+                    {
+                        printf("TileRenderer_t for a %dx%d tile window doesn't match DrawTiles_Generic at tile (%d, %d) in a %dx%d texture\n", specialization.WindowSize_Tiles.X, specialization.WindowSize_Tiles.Y, x, y, destSize_Tiles.X, destSize_Tiles.Y);
+                        assert(0);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Quick enough for every time the demo starts: just the handful of hand worked windows
+void DoBasicTests()
+{
+    DoIntersectCaseTests();
+}
+
+// DoBasicTests plus all the sweeps, these only run from RunTests ("make test") since they'd hold up the demo starting
+static void DoAllTests()
+{
+    DoBasicTests();
+    DoClassifierTests();
+    DoGridPointTests();
+    DoClipTests();
+    DoAtlasPackingTests();
+    DoSpatialGridTests();
+    DoTileRendererTests();
+    DoIntersectSweepTests();
+}
+
+//---------------------------------------------------------------------------------------------------------------------------
+// Regression tests
+//---------------------------------------------------------------------------------------------------------------------------
+
+// Where TEST_CheckGoldenImage keeps its images. They have to come from "make test-record" on a real SDL2 build (RunTests draws
+// with SDL's software renderer), looked over, then committed; until they are, every check fails as missing. After a change
+// that's meant to change what's drawn, delete the images it changes and record them again the same way.
+const char* const cGoldenImageFolder = "golden";
+
+// set by RunTests from "--record" or WMI_RECORD_GOLDEN_IMAGES=1, without it a missing golden image is a failure
+static bool RecordGoldenImages = false;
+
+// Compares a window's pixels (SDL_PIXELFORMAT_RGBA8888, rows packed) with the golden image called name. If there isn't one yet,
+// these pixels become it when RecordGoldenImages is on, otherwise that's a failure. On a mismatch, what was drawn is written out
+// next to it as name_actual.png. Returns false on a mismatch or a missing image.
+static bool TEST_CheckGoldenImage(const char* name, std::vector<Uint32>& pixels, const IntVec2_t& size_px)
+{
+    char goldenPath[256];
+    char actualPath[256];
+    snprintf(goldenPath, sizeof(goldenPath), "%s/%s.png", cGoldenImageFolder, name);
+    snprintf(actualPath, sizeof(actualPath), "%s/%s_actual.png", cGoldenImageFolder, name);
+
+    SDL_Surface* drawn = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), size_px.X, size_px.Y, 32, size_px.X * (int)sizeof(Uint32), SDL_PIXELFORMAT_RGBA8888);
+    SDL_Surface* loaded = IMG_Load(goldenPath);
+
+    if(loaded == nullptr && !RecordGoldenImages)
+    {
+        IMG_SavePNG(drawn, actualPath);
+        printf("No golden image %s (run with --record to record it from %s)\n", goldenPath, actualPath);
+
+        SDL_FreeSurface(drawn);
+        return false;
+    }
+
+    if(loaded == nullptr)
+    {
+        const bool saved = (IMG_SavePNG(drawn, goldenPath) == 0);
+
+        if(saved)
+        {
+            printf("Recorded golden image %s\n", goldenPath);
+        }
+        else
+        {
+            printf("Couldn't write golden image %s: %s\n", goldenPath, SDL_GetError());
+        }
+
+        SDL_FreeSurface(drawn);
+        return saved;
+    }
+
+    // whatever format the PNG loaded as, compare it as RGBA8888
+    SDL_Surface* golden = SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA8888, 0);
+    SDL_FreeSurface(loaded);
+
+    bool same = (golden != nullptr) && (golden->w == size_px.X) && (golden->h == size_px.Y);
+
+    for(int rowIndex = 0; same && rowIndex < size_px.Y; rowIndex++)
+    {
+        const Uint8* goldenRow = (const Uint8*)golden->pixels + rowIndex * golden->pitch;
+
+        same = (memcmp(goldenRow, &pixels[(size_t)rowIndex * size_px.X], size_px.X * sizeof(Uint32)) == 0);
+    }
+
+    if(!same)
+    {
+        IMG_SavePNG(drawn, actualPath);
+        printf("Doesn't match golden image %s, see %s\n", goldenPath, actualPath);
+    }
+
+    SDL_FreeSurface(golden);
+    SDL_FreeSurface(drawn);
+
+    return same;
+}
+
+// The CPU compositor drawing cpuTileMap out of cpuTileAtlas has to put out exactly what the SDL path puts in the screen render texture
+// for tileMap and tileAtlas (usually the same map and atlas, but they don't have to be). Returns how many windows didn't match.
+static int TEST_CheckCpuCompositor(const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const TileMap_t& cpuTileMap, const TileAtlas_t& cpuTileAtlas, const IntVec2_t& windowSize_px)
+{
+    const int cCheckedPositionCount = 64;
+
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, false);
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+
+    if(!AcquireViewportTextures(viewport))
+    {
+        return cCheckedPositionCount;
+    }
+
+    PixelBuffer_t screenBuffer;
+    PixelBuffer_t mapBuffer;
+    std::vector<Uint32> rendererPixels((size_t)windowSize_px.X * windowSize_px.Y);
+
+    int mismatchCount = 0;
+
+    for(int positionIndex = 0; positionIndex < cCheckedPositionCount; positionIndex++)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[positionIndex];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+        RenderWindows(&viewport, 1, tileMap);
+
+        const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+        SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+        SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, rendererPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+
+        CPU_RenderWindow(screenBuffer, mapBuffer, cpuTileAtlas, cpuTileMap, windowSize_Tiles, relToMap_WindowTopLeft);
+
+        if(screenBuffer.Pixels != rendererPixels)
+        {
+            mismatchCount++;
+        }
+    }
+
+    ReleaseViewportTextures(viewport);
+
+    return mismatchCount;
+}
+
+// Edits made with SetTiles have to show up in the windows that can see them, exactly like a full redraw would draw them,
+// and viewports that can't see an edit mustn't be marked for redrawing. editedTileMap is the one of the map's layers that gets edited,
+// tileAtlas has CPU copies. Returns how many windows didn't match.
+static int TEST_CheckTileEdits(const TileMap_t* const* layers, int layerCount, TileMap_t& editedTileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
+{
+    const int cCheckedPositionCount = 64;
+    const int cMaxEditSize_Tiles = 3;
+
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+    const IntVec2_t mapSize_px = GetMapSize_px(editedTileMap);
+
+    // scrolling, so most of the map render texture is kept and the edits are what gets drawn into it
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(mapSize_px, windowSize_px, true);
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+
+    if(!AcquireViewportTextures(viewport, layerCount))
+    {
+        return cCheckedPositionCount;
+    }
+
+    std::mt19937 random(54321);
+    // empty tiles too, so the layers under the edited one show through
+    std::uniform_int_distribution<int> randomTileId(0, (int)editedTileMap.TileSources.size() - 1);
+    std::uniform_int_distribution<int> randomColumn(0, editedTileMap.Size_Tiles.X - 1);
+    std::uniform_int_distribution<int> randomRow(0, editedTileMap.Size_Tiles.Y - 1);
+    std::uniform_int_distribution<int> randomEditSize(1, cMaxEditSize_Tiles);
+
+    PixelBuffer_t screenBuffer;
+    PixelBuffer_t mapBuffer;
+    std::vector<Uint32> rendererPixels((size_t)windowSize_px.X * windowSize_px.Y);
+    TileId_t editTileIds[cMaxEditSize_Tiles * cMaxEditSize_Tiles];
+
+    int mismatchCount = 0;
+
+    for(int positionIndex = 0; positionIndex < cCheckedPositionCount; positionIndex++)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[positionIndex];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+
+        RenderWindows(&viewport, 1, layers, layerCount);
+
+        // one tile anywhere on the map: the viewport only needs redrawing if it can see it
+        const IntVec2_t anywhereTile = {randomColumn(random), randomRow(random)};
+        const SDL_Rect anywhereTile_MapPx = {anywhereTile.X * cGridSize_px, anywhereTile.Y * cGridSize_px, cGridSize_px, cGridSize_px};
+        const SDL_Rect window_MapPx = {relToMap_WindowTopLeft.X, relToMap_WindowTopLeft.Y, windowSize_px.X, windowSize_px.Y};
+        const TileId_t anywhereTileId = (TileId_t)randomTileId(random);
+        const bool anywhereTileChanges = (GetTile(editedTileMap, anywhereTile) != anywhereTileId);
 
-            mapRenderRect.w = westWidth;
-            mapRenderRect.h = southHeight;
+        SetTile(editedTileMap, anywhereTile, anywhereTileId);
 
-            return mapRenderRect;
+        if(ViewportNeedsRedraw(viewport, layers, layerCount) != (anywhereTileChanges && SDL_HasIntersection(&window_MapPx, &anywhereTile_MapPx)))
+        {
+            mismatchCount++;
         }
 
-        case WindowIntersectType_t::West:
+        // a block starting somewhere around the window (SetTiles clips whatever's off the map)
+        const SDL_Rect editArea = {relToMap_WindowTopLeft.X / cGridSize_px + randomColumn(random) % (windowSize_Tiles.X + 1) - 1,
+                                   relToMap_WindowTopLeft.Y / cGridSize_px + randomRow(random) % (windowSize_Tiles.Y + 1) - 1,
+                                   randomEditSize(random), randomEditSize(random)};
+
+        for(int tileIndex = 0; tileIndex < editArea.w * editArea.h; tileIndex++)
         {
-            SDL_Rect mapRenderRect{0};
-            mapRenderRect.x = 0;
-            mapRenderRect.y = winP.Y;
+            editTileIds[tileIndex] = (TileId_t)randomTileId(random);
+        }
 
-            mapRenderRect.w = westWidth;
-            mapRenderRect.h = winSiz.Y;
+        SetTiles(editedTileMap, editArea, editTileIds);
 
-            return mapRenderRect;
-        }
+        RenderWindows(&viewport, 1, layers, layerCount);
 
-        default:
+        const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+        SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+        SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, rendererPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+
+        CPU_RenderWindow(screenBuffer, mapBuffer, tileAtlas, layers, layerCount, windowSize_Tiles, relToMap_WindowTopLeft);
+
+        if(screenBuffer.Pixels != rendererPixels)
         {
-            assert(0);
-            throw std::logic_error("Impossible intersect type dected.");
+            mismatchCount++;
         }
     }
-    
 
+    ReleaseViewportTextures(viewport);
+
+    return mismatchCount;
 }
 
-// try and draw a window, return the rectangle that it drew
-// draw the tileset underneath it in red, draw the area it rendered in white maybe
-SDL_Rect DrawTiles(SDL_Texture* mapRenderTexture, SDL_Texture* tileSetTexture, const IntVec2_t& topLeftTile, const IntVec2_t& topLeftOfTileToWindow_px, const IntVec2_t& windowSize_Tiles, const IntVec2_t& mapSize_Tiles)
-{ 
-    // if the window is shifted right or down in the tile it's in, you'll have to render one extra tile to the east / south
-    IntVec2_t renderNextOffset = {0,0};
+// Animated tiles have to show up on the right frame in the windows that can see them, exactly like a full redraw would draw them,
+// and a viewport mustn't be marked for redrawing when none of the tiles it can see changed frame. animatedLayer is the one of the map's
+// layers that has the animations, tileAtlas has CPU copies. Returns how many windows didn't match.
+static int TEST_CheckTileAnimations(const TileMap_t* const* layers, int layerCount, TileMap_t& animatedLayer, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
+{
+    const int cCheckedPositionCount = 64;
 
-    if(topLeftOfTileToWindow_px.X > 0)
-    {
-        renderNextOffset.X = 1;
-    }
+    // not a multiple of any frame duration, so some steps change a frame and some don't
+    const Uint64 cTimeStep_ms = 70;
+
+    const IntVec2_t windowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+    const IntVec2_t mapSize_px = GetMapSize_px(animatedLayer);
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(mapSize_px, windowSize_px, true);
 
-    if(topLeftOfTileToWindow_px.Y > 0)
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = windowSize_Tiles;
+
+    if(!AcquireViewportTextures(viewport, layerCount))
     {
-        renderNextOffset.Y = 1;
+        return cCheckedPositionCount;
     }
 
+    PixelBuffer_t screenBuffer;
+    PixelBuffer_t mapBuffer;
+    std::vector<Uint32> rendererPixels((size_t)windowSize_px.X * windowSize_px.Y);
+    std::vector<int> previousFrames;
 
-    int maxEast = min(mapSize_Tiles.X - 1, topLeftTile.X + windowSize_Tiles.X + renderNextOffset.X);
-    int maxSouth = min(mapSize_Tiles.Y - 1, topLeftTile.Y + windowSize_Tiles.Y + renderNextOffset.Y);
-
-    int minWest = max(0, topLeftTile.X);
-    int minNorth = max(0, topLeftTile.Y);
+    Uint64 time_ms = 0;
+    int mismatchCount = 0;
 
-    int validRows = 0;
-    int validColumns = 0;
+    UpdateTileAnimations(animatedLayer, time_ms);
 
-    
-    for(int rowIndex = topLeftTile.Y; rowIndex <= (topLeftTile.Y + windowSize_Tiles.Y); rowIndex++)
+    for(int positionIndex = 0; positionIndex < cCheckedPositionCount; positionIndex++)
     {
-        if(!InRange(minNorth, rowIndex, maxSouth))
-        {
-            continue; 
-        }
+        const IntVec2_t& relToMap_WindowTopLeft = positions[positionIndex];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
 
-        int oldValidColumns = validColumns;
-        
-        if(oldValidColumns != 0)
+        RenderWindows(&viewport, 1, layers, layerCount);
+
+        previousFrames.clear();
+
+        for(const TileAnimation_t& animation : animatedLayer.Animations)
         {
-            // should not change shape from one row to the next
-            assert(oldValidColumns == validColumns);
+            previousFrames.push_back(animation.CurrentFrame);
         }
 
-        validColumns = 0;
-        // look 1 past the size, otherwise if you're in the middle of tile 1,
-        // 1 + 2,  < 3, stop at tile 2
-        for(int columnIndex = topLeftTile.X; columnIndex <= (topLeftTile.X + windowSize_Tiles.X); columnIndex++)
+        time_ms += cTimeStep_ms;
+        UpdateTileAnimations(animatedLayer, time_ms);
+
+        // the slow way: is there an animated tile anywhere in the window whose frame changed
+        bool visibleTileChanged = false;
+
+        for(int rowIndex = max(0, relToMap_WindowTopLeft.Y / cGridSize_px - 1); rowIndex < animatedLayer.Size_Tiles.Y && !visibleTileChanged; rowIndex++)
         {
-            if(!InRange(minWest, columnIndex, maxEast))
+            for(int columnIndex = max(0, relToMap_WindowTopLeft.X / cGridSize_px - 1); columnIndex < animatedLayer.Size_Tiles.X; columnIndex++)
             {
-                continue;
-            }
+                const SDL_Rect tile_MapPx = {columnIndex * cGridSize_px, rowIndex * cGridSize_px, cGridSize_px, cGridSize_px};
+                const SDL_Rect window_MapPx = {relToMap_WindowTopLeft.X, relToMap_WindowTopLeft.Y, windowSize_px.X, windowSize_px.Y};
 
-            IntVec2_t mapCoordinate_Tiles = {columnIndex, rowIndex};
-            IntVec2_t textureCoordinate_Tiles = {validColumns, validRows};
-            DEMO_DrawTile(mapRenderTexture, tileSetTexture, mapCoordinate_Tiles, textureCoordinate_Tiles);
+                if(!SDL_HasIntersection(&tile_MapPx, &window_MapPx))
+                {
+                    continue;
+                }
 
-            validColumns++;
+                const TileId_t tileId = GetTile(animatedLayer, {columnIndex, rowIndex});
+
+                for(size_t animationIndex = 0; animationIndex < animatedLayer.Animations.size(); animationIndex++)
+                {
+                    const TileAnimation_t& animation = animatedLayer.Animations[animationIndex];
+                    visibleTileChanged |= (animation.TileId == tileId && animation.CurrentFrame != previousFrames[animationIndex]);
+                }
+            }
+        }
+
+        if(ViewportNeedsRedraw(viewport, layers, layerCount) != visibleTileChanged)
+        {
+            mismatchCount++;
         }
 
-        // don't count the row if it contained zero valid columns
-        if(validColumns != 0)
+        RenderWindows(&viewport, 1, layers, layerCount);
+
+        const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+        SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+        SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, rendererPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+
+        CPU_RenderWindow(screenBuffer, mapBuffer, tileAtlas, layers, layerCount, windowSize_Tiles, relToMap_WindowTopLeft);
+
+        if(screenBuffer.Pixels != rendererPixels)
         {
-            validRows++;
+            mismatchCount++;
         }
     }
 
-    SDL_Rect resultRect = {0};
-    resultRect.w = validColumns * cGridSize_px;
-    resultRect.h = validRows * cGridSize_px;
-    resultRect.x = minWest * cGridSize_px;
-    resultRect.y = minNorth * cGridSize_px;
+    ReleaseViewportTextures(viewport);
 
-    return resultRect;
+    return mismatchCount;
 }
 
-// Returns a 2D point giving the top left corner of a rectangle that serves as the destination of where the map pixels will be copied to the screen.
-// This is needed because we don't copy the map pixels to the bottom left of the map render texture
-// (and it wouldn't help anyway because the map render texture is 1 tile bigger than the screen in width and height)
-//
-// This might be a bit hard to visualize, but if you stood on the northwest corner of the map, you would see the map in the bottom right corner,
-// and the sky would fill the rest of the top left
-IntVec2_t GetDrawRenderOffset(const SDL_Rect& srcFromRenderRect, const IntVec2_t& windowSize, const WindowIntersectType_t& intersectType)
+// What a window zoomed out to 1 / 2^mipLevel should look like, drawn by the CPU compositor from mipAtlas (the atlas's CPU copies
+// shrunk to mipLevel with HalvePixelBuffer). The window has to be on a 2^mipLevel px boundary, anywhere else the edges of the
+// chunk thumbnails land on fractions of a pixel.
+static void TEST_CpuRenderZoomedWindow(PixelBuffer_t& screenBuffer, PixelBuffer_t& layerBuffer, const TileAtlas_t& mipAtlas, int mipLevel, const TileMap_t* const* layers, int layerCount,
+                                       const IntVec2_t& windowSize_px, const IntVec2_t& relToMap_WindowTopLeft)
 {
-    switch(intersectType)
-    {
-        case WindowIntersectType_t::TotallyOut:
-        case WindowIntersectType_t::TotallyIn:
-        {
-            return {0, 0};
-        }
+    ResizePixelBuffer(screenBuffer, windowSize_px);
+    FillPixelBuffer(screenBuffer, cScreenBackgroundPixel);
 
-        case WindowIntersectType_t::NorthWest:
-        {
-            // put it in the bottom right corner
-            IntVec2_t result = {windowSize.X - srcFromRenderRect.w, windowSize.Y - srcFromRenderRect.h};
-            return result;
-        }
+    // just the tiles the window can see
+    const WindowClip_t clip = ComputeWindowClip(GetMapSize_px(*layers[0]), relToMap_WindowTopLeft, {windowSize_px.X << mipLevel, windowSize_px.Y << mipLevel}, cGridSize_px);
 
-        case WindowIntersectType_t::North:
-        {
-            // put it on the bottom
-            IntVec2_t result = {0, windowSize.Y - srcFromRenderRect.h};
-            return result;
-        }
-        case WindowIntersectType_t::NorthEast:
-        {
-            // put it on the bottom
-            IntVec2_t result = {0, windowSize.Y - srcFromRenderRect.h};
-            return result;
-        }
+    if(clip.MapRect.w == 0)
+    {
+        return;
+    }
 
-        case WindowIntersectType_t::East:
-        {
-            // leave as is
-            IntVec2_t result = {0,0};
-            return result;
-        }
+    const IntVec2_t firstTile = FindGridCoordinateForPoint({clip.MapRect.x, clip.MapRect.y}, cGridSize_px);
+    const IntVec2_t endTile = FindGridCoordinateForPoint_RoundUp({clip.MapRect.x + clip.MapRect.w, clip.MapRect.y + clip.MapRect.h}, cGridSize_px);
+    const SDL_Rect visibleTiles = {firstTile.X, firstTile.Y, endTile.X - firstTile.X, endTile.Y - firstTile.Y};
 
-        case WindowIntersectType_t::SouthEast:
-        {
-            // leave as is
-            IntVec2_t result = {0,0};
-            return result;
-        }
+    const int mipGridSize_px = cGridSize_px >> mipLevel;
+    const IntVec2_t layerTopLeft = {(firstTile.X * cGridSize_px - relToMap_WindowTopLeft.X) >> mipLevel, (firstTile.Y * cGridSize_px - relToMap_WindowTopLeft.Y) >> mipLevel};
+    const SDL_Rect wholeLayer = {0, 0, visibleTiles.w * mipGridSize_px, visibleTiles.h * mipGridSize_px};
 
-        case WindowIntersectType_t::South:
-        {
-            // leave as is
-            IntVec2_t result = {0,0};
-            return result;
-        }
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        ResizePixelBuffer(layerBuffer, {wholeLayer.w, wholeLayer.h});
+        FillPixelBuffer(layerBuffer, (layerIndex == 0) ? cMapBackgroundPixel : cLayerBackgroundPixel);
 
+        ClearTileBatch(TileBatch);
+        BatchTileArea(TileBatch, *layers[layerIndex], visibleTiles, firstTile, {visibleTiles.w, visibleTiles.h});
+        ShrinkTileBatch(TileBatch, mipLevel);
 
-        case WindowIntersectType_t::SouthWest:
-        {
-            // offset to right
-            IntVec2_t result = {windowSize.X - srcFromRenderRect.w,0};
-            return result;
-        }
-        
-        case WindowIntersectType_t::West:
-        {
-            //offset to right
-            IntVec2_t result = {windowSize.X - srcFromRenderRect.w,0};
-            return result;
-        }
+        CPU_SubmitTileBatch(TileBatch, mipAtlas, layerBuffer);
 
-        default:
-        {
-            assert(0);
-            throw std::logic_error("Impossible intersection type");
-        }
-        
+        BlitPixels(screenBuffer, layerTopLeft, layerBuffer, wholeLayer, layerIndex != 0);
     }
 }
 
-// Returns a rectangle showing the area to copy from, to get all of the useful pixels rendered from the map that would be in the player's view
-SDL_Rect GetTextureReadArea(const IntVec2_t& windowTopLeft_RelToTextureTopLeft, const IntVec2_t& windowSize, const WindowIntersectType_t& intersectType, const SDL_Rect& renderedRectangle)
+// A zoomed out window has to look exactly like its part of the map drawn from the atlas's mip levels, at every mip level,
+// with tiles being edited around it (so its chunk thumbnails have to be kept up to date). editedLayer is one of the map's layers,
+// tileAtlas has CPU copies. Returns how many windows didn't match.
+static int TEST_CheckZoomedWindow(const TileMap_t* const* layers, int layerCount, TileMap_t& editedLayer, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
 {
-    // yeah, we do need the offset to be not clamped at 0, because otherwise hit doesn't truncate the northeast case
-    const IntVec2_t textureOffset = {max(0, windowTopLeft_RelToTextureTopLeft.X), max(0, windowTopLeft_RelToTextureTopLeft.Y)};
+    const int cCheckedPositionCount = 16;
+    const int cMaxEditSize_Tiles = 3;
 
-    switch(intersectType)
+    const IntVec2_t mapSize_px = GetMapSize_px(editedLayer);
+
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+
+    if(!AcquireViewportTextures(viewport, layerCount))
     {
-        case WindowIntersectType_t::TotallyOut:
+        return cCheckedPositionCount * (TILE_MIP_LEVELS - 1);
+    }
+
+    std::mt19937 random(97531);
+    std::uniform_int_distribution<int> randomTileId(0, (int)editedLayer.TileSources.size() - 1);
+    std::uniform_int_distribution<int> randomEditSize(1, cMaxEditSize_Tiles);
+
+    PixelBuffer_t screenBuffer;
+    PixelBuffer_t layerBuffer;
+    std::vector<Uint32> rendererPixels((size_t)windowSize_px.X * windowSize_px.Y);
+    TileId_t editTileIds[cMaxEditSize_Tiles * cMaxEditSize_Tiles];
+
+    // shrunk one more level each time around
+    TileAtlas_t mipAtlas;
+    mipAtlas.CpuPages = tileAtlas.CpuPages;
+
+    int mismatchCount = 0;
+
+    for(int mipLevel = 1; mipLevel < TILE_MIP_LEVELS; mipLevel++)
+    {
+        for(CpuTileSet_t& page : mipAtlas.CpuPages)
         {
-            SDL_Rect rect = {0,0,0,0};
+            PixelBuffer_t halved;
+            HalvePixelBuffer(halved, page.Image);
 
-            // there's really no reason for CheckArea to be in this case, but it's a handy breakpoint location
-            CheckArea(rect, windowSize);
-            return rect;
+            page.Image = std::move(halved);
+            UpdateOpaqueCells(page);
         }
-        case WindowIntersectType_t::TotallyIn:
+
+        viewport.Zoom = 1.0f / (1 << mipLevel);
+
+        const IntVec2_t viewSize_px = GetZoomedWindowSize_px(windowSize_px, viewport.Zoom);
+        const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(mapSize_px, viewSize_px, false);
+
+        for(int positionIndex = 0; positionIndex < cCheckedPositionCount; positionIndex++)
         {
-            SDL_Rect rect = {0};
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = windowSize.X;
-            rect.h = windowSize.Y;
+            // rounded down to a 2^mipLevel px boundary, see TEST_CpuRenderZoomedWindow
+            const int boundaryMask = ~((1 << mipLevel) - 1);
+            const IntVec2_t relToMap_WindowTopLeft = {positions[positionIndex].X & boundaryMask, positions[positionIndex].Y & boundaryMask};
+            viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
 
-            CheckArea(rect, windowSize);
+            RenderWindows(&viewport, 1, layers, layerCount);
 
-            return rect;
-        }
+            // a block somewhere the window can see (SetTiles clips whatever's off the map), so a thumbnail it's using goes out of date
+            const SDL_Rect editArea = {(relToMap_WindowTopLeft.X + (int)(random() % viewSize_px.X)) / cGridSize_px,
+                                       (relToMap_WindowTopLeft.Y + (int)(random() % viewSize_px.Y)) / cGridSize_px,
+                                       randomEditSize(random), randomEditSize(random)};
 
-        // maybe I can reduce some of this by doing some kind of absolute value for some of the width and height calculations
-        // I'm not sure it's worth it, I thought I had a more elegant method about 3 times now.
+            for(int tileIndex = 0; tileIndex < editArea.w * editArea.h; tileIndex++)
+            {
+                editTileIds[tileIndex] = (TileId_t)randomTileId(random);
+            }
 
-        // very special case, can't be merged with anything
-        case WindowIntersectType_t::NorthWest:
-        {
-            SDL_Rect rect = {0};
-            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft.X, which is NOT zero
-            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
-            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // really is plus! windowTopLeft is negative!
-            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // really is plus! windowTopLeft is negative!
+            SetTiles(editedLayer, editArea, editTileIds);
 
-            CheckArea(rect, windowSize);
+            RenderWindows(&viewport, 1, layers, layerCount);
 
-            return rect;
+            const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+            SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+            SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, rendererPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+            SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+
+            TEST_CpuRenderZoomedWindow(screenBuffer, layerBuffer, mipAtlas, mipLevel, layers, layerCount, windowSize_px, relToMap_WindowTopLeft);
+
+            if(screenBuffer.Pixels != rendererPixels)
+            {
+                mismatchCount++;
+            }
         }
+    }
 
-        // possible merge with N/NE
-        case WindowIntersectType_t::North:
-        {
-            SDL_Rect rect = {0};
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
-            rect.w = windowSize.X;
-            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // really is plus! windowTopLeft is negative!
+    ReleaseViewportTextures(viewport);
 
-            CheckArea(rect, windowSize);
+    for(int layerIndex = 0; layerIndex < layerCount; layerIndex++)
+    {
+        ReleaseChunkThumbnails(*layers[layerIndex]);
+    }
 
-            return rect;
-        }
-        case WindowIntersectType_t::East:
-        {
-            SDL_Rect rect = {0};
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
-            rect.h = windowSize.Y;
+    return mismatchCount;
+}
 
-            CheckArea(rect, windowSize);
+// Sprites drawn by RenderWindows have to look exactly like drawing each one with SDL_RenderCopy, in (layer, texture, bottom edge) order,
+// and take no more draw calls than there are layer and texture pairs. Returns how many windows didn't.
+static int TEST_CheckSpriteQueue(const TileMap_t& tileMap, const TileAtlas_t& tileAtlas, const IntVec2_t& windowSize_px)
+{
+    const int cCheckedPositionCount = 16;
+    const int cSpriteCount = 512;
 
-            return rect;
-        }
-        
-        case WindowIntersectType_t::NorthEast:
-        {
-            SDL_Rect rect = {0};
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = 0; // is NOT windowTopLeft_RelToTextureTopLeft.Y, which is NOT zero
-            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
-            rect.h = windowSize.Y + windowTopLeft_RelToTextureTopLeft.Y; // for east, windowTopLeft_RelToTexturetopLeft will be 0; really is plus, Y is negative for NE
+    const std::vector<IntVec2_t> positions = BENCH_MakeWindowPositions(GetMapSize_px(tileMap), windowSize_px, false);
 
-            CheckArea(rect, windowSize);
+    SpriteQueue_t spriteQueue = {};
 
-            return rect;
-        }
-        case WindowIntersectType_t::SouthEast:
-        {
-            SDL_Rect rect = {0};
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = renderedRectangle.w - windowTopLeft_RelToTextureTopLeft.X;
-            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
+    viewport.SpriteQueue = &spriteQueue;
 
-            CheckArea(rect, windowSize);
+    if(!AcquireViewportTextures(viewport))
+    {
+        return cCheckedPositionCount;
+    }
 
-            return rect;
-        }
-        case WindowIntersectType_t::South:
-        {
-            SDL_Rect rect = {0};
+    SDL_Texture* const textures[] = {tileAtlas.Pages[0], tileAtlas.MipPages[0][0]};
+    std::mt19937 random(1357);
 
-            rect.x = windowTopLeft_RelToTextureTopLeft.X;
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = windowSize.X;
-            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+    const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+    std::vector<Uint32> queuedPixels((size_t)windowSize_px.X * windowSize_px.Y);
+    std::vector<Uint32> copiedPixels((size_t)windowSize_px.X * windowSize_px.Y);
 
-            CheckArea(rect, windowSize);
+    int mismatchCount = 0;
 
-            return rect;
-        }
+    for(int positionIndex = 0; positionIndex < cCheckedPositionCount; positionIndex++)
+    {
+        const IntVec2_t& relToMap_WindowTopLeft = positions[positionIndex];
+        viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
 
-        case WindowIntersectType_t::SouthWest:
+        BENCH_QueueSprites(spriteQueue, random, textures, 2, cSpriteCount, relToMap_WindowTopLeft, windowSize_px);
+        const std::vector<Sprite_t> sprites = spriteQueue.Sprites;
+
+        RenderWindows(&viewport, 1, tileMap);
+
+        SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+        SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, queuedPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+
+        // the same sprites again, straight into the window, to count the draw calls
+        spriteQueue.Sprites = sprites;
+        const int drawCallCount = DrawSpriteQueue(spriteQueue, relToMap_WindowTopLeft, windowSize_px, 1.0f);
+
+        // the queue's empty now, so this is just the map (and it has to notice the sprites need rubbing out)
+        RenderWindows(&viewport, 1, tileMap);
+
+        // the window's sprites in the order they should be drawn, textures numbered in the order they're first seen
+        std::vector<const Sprite_t*> visibleSprites;
+        std::vector<SDL_Texture*> textureOrder;
+
+        for(const Sprite_t& sprite : sprites)
         {
-            SDL_Rect rect = {0};
-            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft, which is NOT zero
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // is NOT minus, X is negative, we want to truncate off the part to the left of the texture's bounds
-            rect.h = renderedRectangle.h - windowTopLeft_RelToTextureTopLeft.Y;
+            const SDL_Rect bounds = {sprite.Position_px.X - relToMap_WindowTopLeft.X, sprite.Position_px.Y - relToMap_WindowTopLeft.Y, sprite.Source.w, sprite.Source.h};
 
-            CheckArea(rect, windowSize);
+            if(SDL_HasIntersection(&bounds, &windowRect))
+            {
+                visibleSprites.push_back(&sprite);
 
-            return rect;
+                if(std::find(textureOrder.begin(), textureOrder.end(), sprite.Texture) == textureOrder.end())
+                {
+                    textureOrder.push_back(sprite.Texture);
+                }
+            }
         }
 
-        case WindowIntersectType_t::West:
+        std::stable_sort(visibleSprites.begin(), visibleSprites.end(), [&textureOrder](const Sprite_t* a, const Sprite_t* b)
         {
-            SDL_Rect rect = {0};
-            rect.x = 0; // is NOT windowTopLeft_RelToTextureTopLeft, which is NOT zero
-            rect.y = windowTopLeft_RelToTextureTopLeft.Y;
-            rect.w = windowSize.X + windowTopLeft_RelToTextureTopLeft.X; // is NOT minus, X is negative, we want to truncate off the part to the left of the texture's bounds
-            rect.h = windowSize.Y;
+            const long long aTexture = std::find(textureOrder.begin(), textureOrder.end(), a->Texture) - textureOrder.begin();
+            const long long bTexture = std::find(textureOrder.begin(), textureOrder.end(), b->Texture) - textureOrder.begin();
+
+            if(a->Layer != b->Layer)
+            {
+                return a->Layer < b->Layer;
+            }
 
-            CheckArea(rect, windowSize);
+            if(aTexture != bTexture)
+            {
+                return aTexture < bTexture;
+            }
 
-            return rect;
-        }
+            return a->Position_px.Y + a->Source.h < b->Position_px.Y + b->Source.h;
+        });
 
-        default:
+        SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+        SDL_RenderSetClipRect(SDLGlobals.Renderer, &windowRect);
+
+        for(const Sprite_t* sprite : visibleSprites)
         {
-            assert(0);
-            throw std::logic_error("Impossible intersection type");
+            const SDL_Rect destRect = {sprite->Position_px.X - relToMap_WindowTopLeft.X, sprite->Position_px.Y - relToMap_WindowTopLeft.Y, sprite->Source.w, sprite->Source.h};
+            SDL_RenderCopy(SDLGlobals.Renderer, sprite->Texture, &sprite->Source, &destRect);
         }
-        
-    }
-}
-
-SDL_Rect RenderMapRegion(SDL_Texture* mapRenderTexture, SDL_Texture* tileSetTexture, const IntVec2_t& northWestTile, const IntVec2_t& topLeftOfTileToWindow_px, const IntVec2_t& windowSize_Tiles, const IntVec2_t& mapSize_tiles)
-{
-    SDL_SetRenderTarget(SDLGlobals.Renderer, mapRenderTexture);
-
-    // you should never see this cyan color in this example, because the map has no transparent pixels.
-    // in a real game you may want transparent pixels in the middle of the map to show some background.
-    // 
-    // If you do want that, use
-    //     SDL_SetTextureBlendMode(mapRenderTexture, SDL_BLENDMODE_BLEND);
-    //     SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 0, 0, 0);
-    // instead.
-    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 255, 255, 255);
-    SDL_RenderClear(SDLGlobals.Renderer);
 
-    // The non-demo code would draw tiles spanning between the northWestTile and southEastTile to your mapRenderTexture
-    // I'm not going to do that in this demo, I'm just going to use a pre-rendered map texture. In this demo the map is already "rendered" in full.
-    // I just want to focus on the geometry of what's visible, so this example does not show the code for tiles and their tile pictures.
+        SDL_RenderSetClipRect(SDLGlobals.Renderer, nullptr);
+        SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, copiedPixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
 
-    SDL_Rect renderedArea = DrawTiles(mapRenderTexture, tileSetTexture, northWestTile, topLeftOfTileToWindow_px, windowSize_Tiles, mapSize_tiles);
+        // 4 layers, 2 textures
+        if(queuedPixels != copiedPixels || drawCallCount > 4 * 2)
+        {
+            mismatchCount++;
+        }
+    }
 
-    return renderedArea;
+    ReleaseViewportTextures(viewport);
 
+    return mismatchCount;
 }
 
-SDL_Rect RenderMapToTexture(SDL_Texture* mapRenderTexture, SDL_Texture* tileSetTexture, const IntVec2_t& windowSize_Tiles, const IntVec2_t& relToMap_WindowTopLeft)
+// A file backed map has to read back exactly what was saved, and edits have to land in memory without touching the file.
+// Returns how many tiles didn't match.
+static int TEST_CheckMappedMap(const TileMap_t& tileMap, TileMap_t& mappedTileMap)
 {
-    const IntVec2_t gridCoordOfWindow_TopLeft = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+    int mismatchCount = (mappedTileMap.Size_Tiles.X != tileMap.Size_Tiles.X || mappedTileMap.Size_Tiles.Y != tileMap.Size_Tiles.Y) ? 1 : 0;
 
-    const IntVec2_t coordOfTopLeftOfEnclosingGrid_px = {gridCoordOfWindow_TopLeft.X * cGridSize_px, gridCoordOfWindow_TopLeft.Y * cGridSize_px};
+    for(int rowIndex = 0; rowIndex < tileMap.Size_Tiles.Y && mismatchCount == 0; rowIndex++)
+    {
+        for(int columnIndex = 0; columnIndex < tileMap.Size_Tiles.X; columnIndex++)
+        {
+            mismatchCount += (GetTile(mappedTileMap, {columnIndex, rowIndex}) != GetTile(tileMap, {columnIndex, rowIndex})) ? 1 : 0;
+        }
+    }
 
-    const IntVec2_t topLeftOfTileToWindow_px = {relToMap_WindowTopLeft.X - coordOfTopLeftOfEnclosingGrid_px.X, relToMap_WindowTopLeft.Y - coordOfTopLeftOfEnclosingGrid_px.Y};
+    // copy on write: the edited tile changes, its neighbour in the same chunk doesn't, and it can be put back
+    const TileId_t originalTile = GetTile(mappedTileMap, {1, 0});
 
-    // render the part of the map the player can see to a texture
-    SDL_Rect renderedRectangle = RenderMapRegion(mapRenderTexture, tileSetTexture, gridCoordOfWindow_TopLeft, topLeftOfTileToWindow_px, windowSize_Tiles, cMapSize_Tiles);
+    WriteTile(mappedTileMap, {0, 0}, cEmptyTile);
+    mismatchCount += (GetTile(mappedTileMap, {0, 0}) != cEmptyTile) ? 1 : 0;
+    mismatchCount += (GetTile(mappedTileMap, {1, 0}) != originalTile) ? 1 : 0;
 
-    return renderedRectangle;
+    WriteTile(mappedTileMap, {0, 0}, GetTile(tileMap, {0, 0}));
+    mismatchCount += (GetTile(mappedTileMap, {0, 0}) != GetTile(tileMap, {0, 0})) ? 1 : 0;
 
+    return mismatchCount;
 }
 
-void CopyRenderedMapToScreen(SDL_Texture* screenRenderTexture, SDL_Texture* mapRenderTexture, const IntVec2_t& relToMap_WindowTopLeft, const IntVec2_t& windowSize, const SDL_Rect& renderedRectangle)
+// Damages a copy of a saved map file a few different ways and checks that opening it either fails or can't index off the end
+// of anything. The map has to have tile 0, 0 filled in. Returns how many of the damaged files weren't caught.
+static int TEST_CheckDamagedMapFiles(const char* savedPath)
 {
-    const IntVec2_t gridCoordOfWindow_TopLeft = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+    const char* const cDamagedMapFilePath = "test_map_damaged.wmimap";
 
-    // This is the northwest most tile coordinate that our region touches.
-    const IntVec2_t topLeftValidTile = {max(0, gridCoordOfWindow_TopLeft.X), max(0, gridCoordOfWindow_TopLeft.Y)};
+    std::vector<Uint8> saved;
+    FILE* file = fopen(savedPath, "rb");
 
-    // DON'T use relToRenderTexture for the intersect type! It needs to be relative to the map!
-    const WindowIntersectType_t intersectType = GetWindowIntersectType(MapTextureSize, relToMap_WindowTopLeft, windowSize);
+    if(file == nullptr)
+    {
+        return 1;
+    }
 
-    SDL_SetRenderTarget(SDLGlobals.Renderer, screenRenderTexture);
+    Uint8 buffer[4096];
 
-    // I'm using this orangish color to simulate a sky texture or background color.
-    // in a real game you will probably want this to be set to transparent instead, 
-    // If you do want that, use
-    //     SDL_SetTextureBlendMode(screenRenderTexture, SDL_BLENDMODE_BLEND);
-    //     SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 0, 0, 0);
-    // instead.
-    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 255, 180, 0, 255);
-    SDL_RenderClear(SDLGlobals.Renderer);
+    for(size_t readSize; (readSize = fread(buffer, 1, sizeof(buffer), file)) != 0; )
+    {
+        saved.insert(saved.end(), buffer, buffer + readSize);
+    }
 
-    const IntVec2_t topLeftValidTileTopLeft_px = {topLeftValidTile.X * cGridSize_px, topLeftValidTile.Y * cGridSize_px};
-    const IntVec2_t validTopLeftTileToRegionTopLeft = {relToMap_WindowTopLeft.X - topLeftValidTileTopLeft_px.X, relToMap_WindowTopLeft.Y - topLeftValidTileTopLeft_px.Y};
+    fclose(file);
 
-    const SDL_Rect srcRect = GetTextureReadArea(validTopLeftTileToRegionTopLeft , windowSize, intersectType, renderedRectangle);
+    TileMapFileHeader_t header = {};
+    memcpy(&header, saved.data(), sizeof(header));
 
-    const IntVec2_t screenDestOrigin = GetDrawRenderOffset(srcRect, windowSize, intersectType);
+    // writes the damaged copy out and opens it
+    auto openDamaged = [&](const std::vector<Uint8>& damaged, TileMap_t& tileMap)
+    {
+        FILE* damagedFile = fopen(cDamagedMapFilePath, "wb");
+        const bool written = (damagedFile != nullptr) && (fwrite(damaged.data(), 1, damaged.size(), damagedFile) == damaged.size());
 
-    SDL_Rect destRect = {0};
-    destRect.x = screenDestOrigin.X;
-    destRect.y = screenDestOrigin.Y;
-    destRect.w = srcRect.w;
-    destRect.h = srcRect.h;
+        if(damagedFile != nullptr)
+        {
+            fclose(damagedFile);
+        }
 
-    SDL_RenderCopy(SDLGlobals.Renderer, mapRenderTexture, &srcRect, &destRect);
-}
+        return written && OpenTileMapFile(tileMap, cDamagedMapFilePath);
+    };
 
-//---------------------------------------------------------------------------------------------------------------------------
-// Demo main functions
-//---------------------------------------------------------------------------------------------------------------------------
+    Uint64 firstChunkOffset = 0;
+    memcpy(&firstChunkOffset, &saved[header.ChunkTableOffset], sizeof(firstChunkOffset));
 
+    int uncaughtCount = 0;
 
-const InitSDLValues_t InitSDL(IntVec2_t windowSize_px)
-{
-    InitSDLValues_t sdlInitResult = {NULL, NULL};
+    // chunk offsets that aren't lined up, or would wrap around when the chunk size is added on
+    const Uint64 badOffsets[] = {firstChunkOffset + 1, ~(Uint64)0 / sizeof(TileChunk_t) * sizeof(TileChunk_t), ~(Uint64)0, (Uint64)saved.size()};
 
-    if (SDL_Init(SDL_INIT_EVERYTHING) < 0) 
+    for(Uint64 badOffset : badOffsets)
     {
-        return sdlInitResult;
-    }
+        std::vector<Uint8> damaged = saved;
+        memcpy(&damaged[header.ChunkTableOffset], &badOffset, sizeof(badOffset));
 
-    // Init the window
-    SDL_Window* window = SDL_CreateWindow("A wild map intersect test program appears!", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, windowSize_px.X, windowSize_px.Y, SDL_WINDOW_SHOWN);
-    if (!window) 
-    {
-        printf("An error occured while trying to create window : %s\n", SDL_GetError());
-        return sdlInitResult;
+        TileMap_t tileMap;
+        uncaughtCount += openDamaged(damaged, tileMap) ? 1 : 0;
     }
 
-    // Init the renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!renderer) 
+    // a tile source on a page that can't exist
     {
-        printf("An error occured while trying to create renderer : %s\n", SDL_GetError());
-        return sdlInitResult;
+        std::vector<Uint8> damaged = saved;
+        const Sint32 badPage = -1;
+        memcpy(&damaged[header.TileSourceTableOffset + 4 * sizeof(Sint32)], &badPage, sizeof(badPage));
+
+        TileMap_t tileMap;
+        uncaughtCount += openDamaged(damaged, tileMap) ? 1 : 0;
     }
 
-    sdlInitResult.Window = window;
-    sdlInitResult.Renderer = renderer;
-    return sdlInitResult;
-}
+    // a tile ID with no tile source: the file opens, but the chunk it's in reads as empty
+    {
+        std::vector<Uint8> damaged = saved;
+        const TileId_t badTileId = (TileId_t)header.TileSourceCount;
+        memcpy(&damaged[firstChunkOffset], &badTileId, sizeof(badTileId));
 
-// just checks for a quit signal. You can put more keypresses and mouse button handlers here if you want.
-// returns 1 on quit, returns 0 otherwise
-int HandleInput()
-{
-    SDL_Event event = {0};
+        TileMap_t tileMap;
 
-    while (SDL_PollEvent(&event)) 
-    {
-        // E.g., from hitting the close window button
-        if (event.type == SDL_QUIT) 
+        if(!openDamaged(damaged, tileMap))
         {
-            return 1;
+            uncaughtCount++;
         }
-        else if(event.type == SDL_MOUSEMOTION)
+        else
         {
-            MousePosition.X = event.motion.x;
-            MousePosition.Y = event.motion.y;
+            uncaughtCount += (GetTile(tileMap, {0, 0}) != cEmptyTile || GetTile(tileMap, {1, 0}) != cEmptyTile) ? 1 : 0;
+
+            // editing it starts from an empty chunk, not a copy of the bad one
+            WriteTile(tileMap, {1, 0}, 1);
+            uncaughtCount += (GetTile(tileMap, {0, 0}) != cEmptyTile || GetTile(tileMap, {1, 0}) != 1) ? 1 : 0;
         }
     }
 
-    return 0;
+    remove(cDamagedMapFilePath);
+
+    return uncaughtCount;
 }
 
-void DrawTexture(SDL_Texture *texture, const IntVec2_t& textureSize, const IntVec2_t& screenCoord)
+// Checks PredictChunkPrefetch on a file backed map: a window sitting still asks for nothing, one moving steadily east asks for
+// the rows it's in from where it is to about where it'll be in cPrefetchLookahead_frames, and once it stops it stops asking.
+// Returns how many of those were wrong.
+static int TEST_CheckChunkPrefetch(const TileMap_t& mappedTileMap, const IntVec2_t& windowSize_px)
 {
-    SDL_Rect textureRectangle;
-    textureRectangle.x = 0;
-    textureRectangle.y = 0;
-    textureRectangle.w = textureSize.X;
-    textureRectangle.h = textureSize.Y;
+    const int speed_px = 8;
 
-    SDL_Rect screenRectangle;
-    screenRectangle.x = screenCoord.X;
-    screenRectangle.y = screenCoord.Y;
+    ViewportMotion_t motion = {};
+    IntVec2_t windowTopLeft = {0, 0};
+    int failureCount = 0;
 
-    screenRectangle.w = textureSize.X;
-    screenRectangle.h = textureSize.Y;
+    for(int frameIndex = 0; frameIndex < 10; frameIndex++)
+    {
+        failureCount += PredictChunkPrefetch(motion, mappedTileMap, windowTopLeft, windowSize_px) ? 1 : 0;
+    }
 
-    SDL_RenderCopy(SDLGlobals.Renderer, texture, &textureRectangle, &screenRectangle);
-}
+    int requestCount = 0;
 
+    for(int frameIndex = 0; frameIndex < 10; frameIndex++)
+    {
+        windowTopLeft.X += speed_px;
+        requestCount += PredictChunkPrefetch(motion, mappedTileMap, windowTopLeft, windowSize_px) ? 1 : 0;
+    }
 
+    // the average speed is still creeping up on speed_px, so it's somewhere between half and all of the way there
+    const SDL_Rect windowChunks = ChunkRectForArea(mappedTileMap, {windowTopLeft.X, windowTopLeft.Y, windowSize_px.X, windowSize_px.Y});
+    const SDL_Rect leastAhead = ChunkRectForArea(mappedTileMap, {windowTopLeft.X, windowTopLeft.Y, windowSize_px.X + speed_px * cPrefetchLookahead_frames / 2, windowSize_px.Y});
+    const SDL_Rect mostAhead = ChunkRectForArea(mappedTileMap, {windowTopLeft.X, windowTopLeft.Y, windowSize_px.X + speed_px * cPrefetchLookahead_frames, windowSize_px.Y});
+    const SDL_Rect& requested = motion.RequestedChunks;
 
-IntVec2_t DEMO_TextureWindowRegion_RelToTexture(const IntVec2_t& relToMap_WindowTopLeft)
-{
-    const IntVec2_t gridCoordOfWindow_TopLeft = FindGridCoordinateForPoint(relToMap_WindowTopLeft, cGridSize_px);
+    const bool requestedAhead = (requestCount > 0) && (requested.x == windowChunks.x) && (requested.y == windowChunks.y) && (requested.h == windowChunks.h) &&
+                                (requested.w >= leastAhead.w) && (requested.w <= mostAhead.w);
 
-    // This is the northwest most tile coordinate that our region touches.
-    const IntVec2_t topLeftValidTile = {max(0, gridCoordOfWindow_TopLeft.X), max(0, gridCoordOfWindow_TopLeft.Y)};
+    failureCount += requestedAhead ? 0 : 1;
 
-    const IntVec2_t topLeftOfNorthWestTile_RelToMap_px = {topLeftValidTile.X * cGridSize_px, topLeftValidTile.Y * cGridSize_px};
+    // it can still ask for less while it's slowing down, just not once it's below cMinPrefetchVelocity
+    for(int frameIndex = 0; frameIndex < 10; frameIndex++)
+    {
+        const bool requestedAny = PredictChunkPrefetch(motion, mappedTileMap, windowTopLeft, windowSize_px);
+        const bool stopped = (std::fabs(motion.VelocityX) < cMinPrefetchVelocity) && (std::fabs(motion.VelocityY) < cMinPrefetchVelocity);
 
-    const IntVec2_t topLeftOfTextureToRegionTopLeft = {relToMap_WindowTopLeft.X - topLeftOfNorthWestTile_RelToMap_px.X, relToMap_WindowTopLeft.Y - topLeftOfNorthWestTile_RelToMap_px.Y}; 
+        failureCount += (requestedAny && stopped) ? 1 : 0;
+    }
 
-    return topLeftOfTextureToRegionTopLeft;
+    return failureCount;
 }
 
-
-
-// draws a magenta outline around the area that we're using as a window over the map
-void DEMO_DrawWindowRegion(const IntVec2_t& testWindowSize, const IntVec2_t& windowTopLeft, Color_t color = cMagenta)
+// Says how many windows a check found wrong (if any) and passes the count on, so it can be added to the failures
+static int TEST_CountFailures(const char* what, int failureCount, const IntVec2_t& mapSize_Tiles, const IntVec2_t& windowSize_px)
 {
-    SDL_Rect rect = {0};
-    rect.x = windowTopLeft.X;
-    rect.y = windowTopLeft.Y;
-    rect.w = testWindowSize.X;
-    rect.h = testWindowSize.Y;
-
-    SDL_SetRenderDrawColor(SDLGlobals.Renderer, color.R, color.G, color.B, 255);
+    if(failureCount != 0)
+    {
+        printf("%s for %d windows (map %dx%d, window %dx%d)\n", what, failureCount, mapSize_Tiles.X, mapSize_Tiles.Y, windowSize_px.X, windowSize_px.Y);
+    }
 
-    SDL_RenderDrawRect(SDLGlobals.Renderer, &rect);
+    return failureCount;
 }
 
-// Render what a simulated window would see, if its top left corner were placed at a certain position in the map
-void RenderWindow(SDL_Texture* screenRenderTexture, SDL_Texture* mapRenderTexture, SDL_Texture* tileSetTexture, const IntVec2_t& windowSize_Tiles, const IntVec2_t& windowTopLeft_px, const IntVec2_t& mapTexRenderPoint, const IntVec2_t& screenRenderPoint)
+// Checks what RenderWindows draws (and how it decides what to draw) on generated maps, mostly against the CPU compositor, for a
+// few map and window sizes. tileAtlas has to have CPU copies. Returns how many windows were wrong, across all the checks.
+static int TEST_RunRenderChecks(const TileAtlas_t& tileAtlas, const TileSource_t& tileSetPlacement)
 {
-    
-    const IntVec2_t windowSize_px = {windowSize_Tiles.X * cGridSize_px, windowSize_Tiles.Y * cGridSize_px};
-
-    // This variable is probably only important for the sake of this demo, if this were in a real game, you would pass in windowTopLeft
-    // that was already relative to the top of the map, but since this demo contains more than one render window case, we have to do this offset.
-    //
-    // Though maybe this would be useful outside of this demo, if you wanted to offset where the map was drawn
-    const IntVec2_t relToMap_WindowTopLeft = {windowTopLeft_px.X - cMapOrigin.X, windowTopLeft_px.Y- cMapOrigin.Y };
+    const IntVec2_t mapSizes_Tiles[] = {{8, 8}, {96, 64}};
+    const IntVec2_t windowSizes_px[] = {{32, 32}, {320, 240}};
 
-    SDL_Rect mapTextureRenderedRectangle = RenderMapToTexture(mapRenderTexture, tileSetTexture, windowSize_Tiles, relToMap_WindowTopLeft);
+    // copies of the tileset, with pages only big enough for one copy each
+    const char* const multiPageTileSetPaths[] = {"Debug16.png", "Debug16.png", "Debug16.png"};
+    const int multiPageTileSetCount = (int)(sizeof(multiPageTileSetPaths) / sizeof(multiPageTileSetPaths[0]));
+    TileSource_t multiPagePlacements[multiPageTileSetCount] = {};
+    TileAtlas_t multiPageTileAtlas;
 
-    // DEMO ONLY: for the sake of visualization, render the contents of the rendered map texture to the screen, this would not be done in a real game
+    if(!BuildTileAtlas(multiPageTileAtlas, multiPageTileSetPaths, multiPageTileSetCount, multiPagePlacements, false, cTileSetSize_Tiles.X * cGridSize_px))
     {
-        SDL_Rect mapRenderRect = {0};
-        mapRenderRect.x = mapTexRenderPoint.X;
-        mapRenderRect.y = mapTexRenderPoint.Y;
-        mapRenderRect.w = cMapRenderTextureSize_px.X;
-        mapRenderRect.h = cMapRenderTextureSize_px.Y;
-
-        // Now set the render target back to the screen
-        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
-        SDL_RenderCopy(SDLGlobals.Renderer, mapRenderTexture, nullptr, &mapRenderRect);
+        return 1;
     }
 
-    // DEMO ONLY: draw the player's simulated screen in the render texture, this would not be done in a real game, this is just for illustrative purposes
+    const char* const cTestMapFilePath = "test_map.wmimap";
+    int failureCount = 0;
+
+    for(const IntVec2_t& mapSize_Tiles : mapSizes_Tiles)
     {
-        const IntVec2_t topLeftOfTextureToRegionTopLeft = DEMO_TextureWindowRegion_RelToTexture(relToMap_WindowTopLeft);        
-        const IntVec2_t windowTopLeft_InMapTexture = {mapTexRenderPoint.X + topLeftOfTextureToRegionTopLeft.X, mapTexRenderPoint.Y + topLeftOfTextureToRegionTopLeft.Y};
+        TileMap_t tileMap;
+        BENCH_BuildTileMap(tileMap, mapSize_Tiles, tileSetPlacement);
 
-        const WindowIntersectType_t intersectType = GetWindowIntersectType(MapTextureSize, relToMap_WindowTopLeft, windowSize_px);
+        TileMap_t multiPageTileMap;
+        BENCH_BuildMultiPageTileMap(multiPageTileMap, mapSize_Tiles, multiPagePlacements, multiPageTileSetCount);
 
-        // but don't draw the region if the region's completely outside of the map, the offset won't make any sense
-        if(intersectType != WindowIntersectType_t::TotallyOut)
+        // the same map again, backed by a map file
+        TileMap_t mappedTileMap;
+
+        if(!SaveTileMapFile(tileMap, cTestMapFilePath) || !OpenTileMapFile(mappedTileMap, cTestMapFilePath))
         {
-            DEMO_DrawWindowRegion(windowSize_px, windowTopLeft_InMapTexture);
+            failureCount++;
+            continue;
         }
-    }
 
-    CopyRenderedMapToScreen(screenRenderTexture, mapRenderTexture, relToMap_WindowTopLeft, windowSize_px, mapTextureRenderedRectangle);
+        const int mappedMismatchCount = TEST_CheckMappedMap(tileMap, mappedTileMap);
 
-    // DEMO ONLY: now copy the part of the mapRenderTexture that contains the map onto the screen (with an orangish background behind it)
-    {
-        SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
-        // Then copy the window texture to the screen
-        SDL_Rect screenRenderRect = {0};
-        screenRenderRect.x = screenRenderPoint.X;
-        screenRenderRect.y = screenRenderPoint.Y;
-        screenRenderRect.w = windowSize_px.X;
-        screenRenderRect.h = windowSize_px.Y;
+        if(mappedMismatchCount != 0)
+        {
+            printf("File backed map doesn't match the map it was saved from for %d tiles (map %dx%d)\n", mappedMismatchCount, mapSize_Tiles.X, mapSize_Tiles.Y);
+            failureCount += mappedMismatchCount;
+        }
 
-        SDL_RenderCopy(SDLGlobals.Renderer, screenRenderTexture, nullptr, &screenRenderRect);
-    
-    }
+        // the file has tile 0, 0 filled in, so it'll do to damage
+        const int damagedUncaughtCount = TEST_CheckDamagedMapFiles(cTestMapFilePath);
 
+        if(damagedUncaughtCount != 0)
+        {
+            printf("%d damaged map files weren't caught (map %dx%d)\n", damagedUncaughtCount, mapSize_Tiles.X, mapSize_Tiles.Y);
+            failureCount += damagedUncaughtCount;
+        }
 
-}
+        for(const IntVec2_t& windowSize_px : windowSizes_px)
+        {
+            failureCount += TEST_CountFailures("CPU compositor doesn't match the renderer", TEST_CheckCpuCompositor(tileMap, tileAtlas, tileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-void Render(void)
-{
-    SDL_SetRenderDrawColor(SDLGlobals.Renderer, 0, 40, 60, 255);
-    SDL_RenderClear(SDLGlobals.Renderer);
+            ParallelMapRender = true;
+            failureCount += TEST_CountFailures("CPU compositor doesn't match the renderer with ParallelMapRender", TEST_CheckCpuCompositor(tileMap, tileAtlas, tileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
+            ParallelMapRender = false;
 
-    // Draw the whole map (would not be used in a real game)
-    DrawTexture(MapTestTexture, MapTextureSize, cMapOrigin);
+            failureCount += TEST_CountFailures("CPU compositor doesn't match the renderer for a file backed map", TEST_CheckCpuCompositor(mappedTileMap, tileAtlas, tileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    // in absolute pixels from the top left of our real 1024x768 screen
-    IntVec2_t northWestRegion ={416, 306};
-    IntVec2_t northRegion = {480, 306};
-    IntVec2_t northEastRegion = {533, 316};
-    IntVec2_t eastRegion = {532, 370};
-    IntVec2_t southEastRegion = {534, 426};
-    IntVec2_t southRegion = {476, 427};
-    IntVec2_t southWestRegion = {426, 420};
-    IntVec2_t westRegion = {413, 361};
+            // one SDL_RenderGeometry per atlas page, it has to look exactly like the one page version
+            failureCount += TEST_CountFailures("Tiles from a multi page atlas don't match the one page atlas", TEST_CheckCpuCompositor(multiPageTileMap, multiPageTileAtlas, tileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    IntVec2_t allInRegion = {482, 356};
-    IntVec2_t allOutRegion = {364, 308};
+            failureCount += TEST_CountFailures("Chunk prefetching doesn't follow the window", TEST_CheckChunkPrefetch(mappedTileMap, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    // Draw our simulated window regions
-    DEMO_DrawWindowRegion(cWindowSize_px, northWestRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, northRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, northEastRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, eastRegion);
+            // sorted, batched and drawn in no more calls than there are layer and texture pairs
+            failureCount += TEST_CountFailures("Queued sprites don't match drawing them one at a time", TEST_CheckSpriteQueue(tileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    DEMO_DrawWindowRegion(cWindowSize_px, southEastRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, southRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, southWestRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, westRegion);
+            // a copy of the map that gets edited as the window scrolls around it, on its own and then under a layer that gets edited
+            TileMap_t editedTileMap;
+            BENCH_BuildTileMap(editedTileMap, mapSize_Tiles, tileSetPlacement);
 
-    DEMO_DrawWindowRegion(cWindowSize_px, allInRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, allOutRegion);
-    DEMO_DrawWindowRegion(cWindowSize_px, MousePosition); // moveable region
+            const TileMap_t* const editedLayers[] = {&editedTileMap};
+            failureCount += TEST_CountFailures("Edited tiles aren't redrawn correctly", TEST_CheckTileEdits(editedLayers, 1, editedTileMap, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    // Draw what these windows would see
-    // note: I had trouble getting the exact coordinates of the upper left hand corners of these regions, may be off by +/- 1 px from what's in layout.xcf
+            TileMap_t overlayLayer;
+            BENCH_BuildOverlayLayer(overlayLayer, mapSize_Tiles, tileSetPlacement);
+
+            const TileMap_t* const overlaidLayers[] = {&tileMap, &overlayLayer};
+            failureCount += TEST_CountFailures("Edited tiles in a layer over the map aren't redrawn correctly", TEST_CheckTileEdits(overlaidLayers, 2, overlayLayer, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    //          screen texture (orange)             map render texture (cyan)       tileset         window size        region position     map texture render position     screen texture render position
-    RenderWindow(ScreenRenderTextures.NorthWest,    MapRenderTextures.NorthWest,    MapTestTexture, cWindowSize_Tiles, northWestRegion,    {356, 244},                     {301, 192});
-    RenderWindow(ScreenRenderTextures.North,        MapRenderTextures.North,        MapTestTexture, cWindowSize_Tiles, northRegion,        {476, 245},                     {474, 170});
-    RenderWindow(ScreenRenderTextures.NorthEast,    MapRenderTextures.NorthEast,    MapTestTexture, cWindowSize_Tiles, northEastRegion,    {580, 265},                     {649, 208});
-    RenderWindow(ScreenRenderTextures.East,         MapRenderTextures.East,         MapTestTexture, cWindowSize_Tiles, eastRegion,         {606, 359},                     {686, 357});
+            // zoomed out, drawn from chunk thumbnails at each mip level, while the layer over the map is edited
+            failureCount += TEST_CountFailures("Zoomed out windows don't match the atlas's mip levels", TEST_CheckZoomedWindow(overlaidLayers, 2, overlayLayer, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
 
-    RenderWindow(ScreenRenderTextures.SouthEast,    MapRenderTextures.SouthEast,    MapTestTexture, cWindowSize_Tiles, southEastRegion,    {595, 481},                     {651, 537});
-    RenderWindow(ScreenRenderTextures.South,        MapRenderTextures.South,        MapTestTexture, cWindowSize_Tiles, southRegion,        {468, 491},                     {469, 592});
-    RenderWindow(ScreenRenderTextures.SouthWest,    MapRenderTextures.SouthWest,    MapTestTexture, cWindowSize_Tiles, southWestRegion,    {361, 464},                     {316, 525});
-    RenderWindow(ScreenRenderTextures.West,         MapRenderTextures.West,         MapTestTexture, cWindowSize_Tiles, westRegion,         {323, 358},                     {271, 410});
+            // animated tiles in a layer over the map
+            TileMap_t animatedLayer;
+            BENCH_BuildOverlayLayer(animatedLayer, mapSize_Tiles, tileSetPlacement);
+            BENCH_AddAnimatedTiles(animatedLayer, tileSetPlacement);
 
-    RenderWindow(ScreenRenderTextures.AllIn,        MapRenderTextures.AllIn,        MapTestTexture, cWindowSize_Tiles, allInRegion,        {164, 278},                     {82, 294});
-    RenderWindow(ScreenRenderTextures.AllOut,       MapRenderTextures.AllOut,       MapTestTexture, cWindowSize_Tiles, allOutRegion,       {164, 337},                     {81, 334});
+            const TileMap_t* const animatedLayers[] = {&tileMap, &animatedLayer};
+            failureCount += TEST_CountFailures("Animated tiles aren't redrawn correctly", TEST_CheckTileAnimations(animatedLayers, 2, animatedLayer, tileAtlas, windowSize_px), mapSize_Tiles, windowSize_px);
+        }
+
+        // the file has to be unmapped before it can be deleted on Windows, and the prefetcher can't be looking at it
+        StopChunkPrefetcher(ChunkPrefetcher);
+        mappedTileMap = TileMap_t();
+        remove(cTestMapFilePath);
+    }
 
-    RenderWindow(ScreenRenderTextures.AllOut,       MapRenderTextures.AllOut,       MapTestTexture, cWindowSize_Tiles, MousePosition,      {770, 255},                     {777, 323});
+    DestroyTileAtlas(multiPageTileAtlas);
 
-    SDL_RenderPresent(SDLGlobals.Renderer);
+    return failureCount;
 }
 
-void FrameDelay(unsigned int targetTicks)
+// Headless (see InitHeadlessSDL): runs DoAllTests, then draws a window for each intersect type (and a few other kinds of window)
+// every way RenderWindows can draw one, and checks every one of them against the same golden image, then runs TEST_RunRenderChecks.
+// Returns the number of mismatches (up to 255), so it can be used as the exit code. "--record" (or WMI_RECORD_GOLDEN_IMAGES=1) records any golden images that are missing.
+int RunTests(int argc, char* argv[])
 {
-    // Block at 60 fps
+    const char* recordVariable = getenv("WMI_RECORD_GOLDEN_IMAGES");
+    RecordGoldenImages = (recordVariable != nullptr && strcmp(recordVariable, "1") == 0);
 
-    // ticks is in ms
-    unsigned int ticks = SDL_GetTicks();
-
-    if (targetTicks < ticks) 
+    for(int argIndex = 1; argIndex < argc; argIndex++)
     {
-        return;
+        RecordGoldenImages = RecordGoldenImages || (strcmp(argv[argIndex], "--record") == 0);
     }
 
-    if (targetTicks > ticks + cFrameDuration_ms) 
+    DoAllTests();
+    printf("Basic tests and sweeps passed\n");
+
+    SDL_Surface* screenSurface = InitHeadlessSDL();
+
+    if(screenSurface == nullptr)
     {
-        SDL_Delay(cFrameDuration_ms);
-    } 
-    else 
+        return 1;
+    }
+
+    // the demo's map and decoration layer
+    const char* const tileSetPaths[] = {"Debug16.png"};
+    TileSource_t tileSetPlacement = {0};
+    TileAtlas_t tileAtlas;
+
+    if(!BuildTileAtlas(tileAtlas, tileSetPaths, 1, &tileSetPlacement, true))
     {
-        SDL_Delay(targetTicks - ticks);
+        return 1;
     }
-}
 
+    TileMap_t tileMap;
+    TileMap_t decorationLayer;
+    DEMO_BuildTileMap(tileMap, tileSetPlacement);
+    DEMO_BuildDecorationLayer(decorationLayer, tileMap.Size_Tiles, tileSetPlacement);
 
-// convenience functions to reduce typing and typos
-static SDL_Texture* AllocateTexture(const IntVec2_t& size)
-{
-    return SDL_CreateTexture(SDLGlobals.Renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, size.X, size.Y);
-}
+    const TileMap_t* const layers[] = {&tileMap, &decorationLayer};
 
-static TestTextures_t AllocateTestTextures(const IntVec2_t& size)
-{
-    TestTextures_t textures = {0};
+#ifdef _WIN32
+    CreateDirectoryA(cGoldenImageFolder, nullptr);
+#else
+    mkdir(cGoldenImageFolder, 0755);
+#endif
 
-    textures.NorthWest  = AllocateTexture(size);
-    textures.North      = AllocateTexture(size);
-    textures.NorthEast  = AllocateTexture(size);
-    textures.East       = AllocateTexture(size);
+    DEMO_ShowRenderTextures = false;
+    RenderTargetPool.MaxBytes = cRenderTargetPoolMaxBytes;
 
-    textures.SouthEast  = AllocateTexture(size);
-    textures.South      = AllocateTexture(size);
-    textures.SouthWest  = AllocateTexture(size);
-    textures.West       = AllocateTexture(size);
+    // 3 x 2 tiles, so a mixed up X and Y shows
+    const IntVec2_t windowSize_px = {3 * cGridSize_px, 2 * cGridSize_px};
 
-    textures.AllIn      = AllocateTexture(size);
-    textures.AllOut     = AllocateTexture(size);
-    textures.Moveable   = AllocateTexture(size);
+    SpriteQueue_t spriteQueue = {};
 
-    return textures;
-}
+    Viewport_t viewport = {0};
+    viewport.TileAtlas = &tileAtlas;
+    viewport.WindowSize_Tiles = {windowSize_px.X / cGridSize_px, windowSize_px.Y / cGridSize_px};
 
-static void FreeTextures(TestTextures_t& textures)
-{
-    SDL_DestroyTexture(textures.NorthWest);
-    SDL_DestroyTexture(textures.North);
-    SDL_DestroyTexture(textures.NorthEast);
-    SDL_DestroyTexture(textures.East);
+    if(!AcquireViewportTextures(viewport, 2))
+    {
+        return 1;
+    }
 
-    SDL_DestroyTexture(textures.SouthEast);
-    SDL_DestroyTexture(textures.South);
-    SDL_DestroyTexture(textures.SouthWest);
-    SDL_DestroyTexture(textures.West);
+    struct GoldenCase_t
+    {
+        const char* Name;
+        IntVec2_t WindowTopLeft;    // relative to the map
+        WindowIntersectType_t IntersectType;
+        int LayerCount;
+        float Zoom;
+        bool Sprites;
+    };
+
+    const GoldenCase_t goldenCases[] =
+    {
+        {"totally_in",      {40, 40},       WindowIntersectType_t::TotallyIn,   1,  1.0f,   false},
+        {"totally_out",     {200, 200},     WindowIntersectType_t::TotallyOut,  1,  1.0f,   false},
+        {"north_west",      {-20, -9},      WindowIntersectType_t::NorthWest,   1,  1.0f,   false},
+        {"north",           {40, -10},      WindowIntersectType_t::North,       1,  1.0f,   false},
+        {"north_east",      {100, -10},     WindowIntersectType_t::NorthEast,   1,  1.0f,   false},
+        {"east",            {100, 50},      WindowIntersectType_t::East,        1,  1.0f,   false},
+        {"south_east",      {100, 110},     WindowIntersectType_t::SouthEast,   1,  1.0f,   false},
+        {"south",           {40, 110},      WindowIntersectType_t::South,       1,  1.0f,   false},
+        {"south_west",      {-20, 110},     WindowIntersectType_t::SouthWest,   1,  1.0f,   false},
+        {"west",            {-20, 50},      WindowIntersectType_t::West,        1,  1.0f,   false},
+
+        {"layered",         {-20, 50},      WindowIntersectType_t::West,        2,  1.0f,   false},
+        {"zoomed",          {-20, -9},      WindowIntersectType_t::NorthWest,   2,  0.5f,   false},
+        {"sprites",         {100, 110},     WindowIntersectType_t::SouthEast,   2,  1.0f,   true},
+    };
+
+    // every way a window can get drawn, they all have to come out the same
+    struct RenderMode_t
+    {
+        const char* Name;
+        bool Incremental;
+        bool Parallel;
+        bool Scrolled;      // drawn somewhere else first, so the ring buffer only draws the tiles that scrolled in
+    };
 
-    SDL_DestroyTexture(textures.AllIn);
-    SDL_DestroyTexture(textures.AllOut);
-    SDL_DestroyTexture(textures.Moveable);
+    const RenderMode_t renderModes[] =
+    {
+        {"full",                    false,  false,  false},
+        {"ring buffer",             true,   false,  false},
+        {"scrolled ring buffer",    true,   false,  true},
+        {"parallel",                false,  true,   false},
+    };
 
-    textures = {0};
-}
+    std::vector<Uint32> pixels((size_t)windowSize_px.X * windowSize_px.Y);
+    int failureCount = 0;
 
+    for(const GoldenCase_t& goldenCase : goldenCases)
+    {
+        const IntVec2_t viewSize_px = GetZoomedWindowSize_px(windowSize_px, goldenCase.Zoom);
 
-void GameRenderLoop()
-{
-    // initialization
-    SDLGlobals = InitSDL(cScreenResolution);
+        // the picture has to be of what it says it is
+        assert(GetWindowIntersectType(GetMapSize_px(tileMap), goldenCase.WindowTopLeft, viewSize_px) == goldenCase.IntersectType);
+        (void)viewSize_px;
 
-    MapTestTexture = LoadImage(SDLGlobals.Renderer, "Debug16.png");
-    MapTextureSize = InquireTextureSize(MapTestTexture);
+        viewport.Zoom = goldenCase.Zoom;
+        viewport.SpriteQueue = goldenCase.Sprites ? &spriteQueue : nullptr;
+
+        auto renderAt = [&](const IntVec2_t& relToMap_WindowTopLeft)
+        {
+            // a couple of tiles hanging off the window on each layer, the queue's emptied every time it's drawn
+            if(goldenCase.Sprites)
+            {
+                for(int spriteIndex = 0; spriteIndex < 6; spriteIndex++)
+                {
+                    const SDL_Rect source = {tileSetPlacement.Rect.x + spriteIndex * cGridSize_px, tileSetPlacement.Rect.y + spriteIndex * cGridSize_px, cGridSize_px, cGridSize_px};
+                    const IntVec2_t position_px = {relToMap_WindowTopLeft.X - 8 + spriteIndex * 9, relToMap_WindowTopLeft.Y - 6 + (spriteIndex % 3) * 11};
 
-    ScreenRenderTextures    = AllocateTestTextures(cWindowSize_px);
-    MapRenderTextures       = AllocateTestTextures(cMapRenderTextureSize_px);
+                    QueueSprite(spriteQueue, tileAtlas.Pages[tileSetPlacement.Page], source, position_px, spriteIndex % 2);
+                }
+            }
 
-    // main loop
-    unsigned int targetTicks = SDL_GetTicks() + cFrameDuration_ms;
-    while(1)
-    {
-        int quitSignal = HandleInput();
+            viewport.WindowTopLeft_px = {relToMap_WindowTopLeft.X + cMapOrigin.X, relToMap_WindowTopLeft.Y + cMapOrigin.Y};
+            RenderWindows(&viewport, 1, layers, goldenCase.LayerCount);
+        };
 
-        if(quitSignal)
+        for(const RenderMode_t& renderMode : renderModes)
         {
-            break;
-        }
+            IncrementalMapRender = renderMode.Incremental;
+            ParallelMapRender = renderMode.Parallel;
 
-        Render();
-        FrameDelay(targetTicks);
-        targetTicks = SDL_GetTicks() + cFrameDuration_ms;
+            // start from nothing, so nothing's left over from the last mode
+            InvalidateViewportRender(viewport.ScreenRenderTexture);
+
+            for(int layerIndex = 0; layerIndex < 2; layerIndex++)
+            {
+                InvalidateMapRenderCache(GetLayerRenderTexture(viewport, layerIndex));
+            }
+
+            if(renderMode.Scrolled)
+            {
+                renderAt({goldenCase.WindowTopLeft.X - 13, goldenCase.WindowTopLeft.Y - 7});
+            }
+
+            renderAt(goldenCase.WindowTopLeft);
+
+            const SDL_Rect windowRect = {0, 0, windowSize_px.X, windowSize_px.Y};
+            SDL_SetRenderTarget(SDLGlobals.Renderer, viewport.ScreenRenderTexture);
+            SDL_RenderReadPixels(SDLGlobals.Renderer, &windowRect, SDL_PIXELFORMAT_RGBA8888, pixels.data(), windowSize_px.X * (int)sizeof(Uint32));
+            SDL_SetRenderTarget(SDLGlobals.Renderer, nullptr);
+
+            if(!TEST_CheckGoldenImage(goldenCase.Name, pixels, windowSize_px))
+            {
+                printf("    (%s drawn with %s)\n", goldenCase.Name, renderMode.Name);
+                failureCount++;
+            }
+        }
     }
 
-    FreeTextures(ScreenRenderTextures);
-    FreeTextures(MapRenderTextures);
+    IncrementalMapRender = true;
+    ParallelMapRender = false;
+
+    printf("%d golden image checks, %d failed\n", (int)(sizeof(goldenCases) / sizeof(goldenCases[0]) * sizeof(renderModes) / sizeof(renderModes[0])), failureCount);
+
+    const int renderCheckFailureCount = TEST_RunRenderChecks(tileAtlas, tileSetPlacement);
+    printf("Render and map file checks: %d failures\n", renderCheckFailureCount);
 
+    ReleaseViewportTextures(viewport);
+    ReleaseChunkThumbnails(tileMap);
+    ReleaseChunkThumbnails(decorationLayer);
+
+    DestroyRenderTargetPool(RenderTargetPool);
+    StopWorkerPool(WorkerPool);
+    StopChunkPrefetcher(ChunkPrefetcher);
+    DestroyTileAtlas(tileAtlas);
+    SDL_DestroyRenderer(SDLGlobals.Renderer);
+    SDL_FreeSurface(screenSurface);
+    SDL_Quit();
+
+    // exit codes only go up to 255, and 256 failures mustn't look like none
+    return min(failureCount + renderCheckFailureCount, 255);
 }
 
-void DoBasicTests()
-{
-    constexpr IntVec2_t cWindowSize_px = {50, 50};
-    constexpr IntVec2_t cMapSize_Tiles = {100, 100};
-
-    constexpr IntVec2_t allInPoint = {20, 20};
-    constexpr IntVec2_t allOutPoint = {200, 200};
-
-    // these points are all the coordinate of the top left point of the window,
-    // relative to the top left point of the map
-    constexpr IntVec2_t northWestPoint  = {-20, -20};
-    constexpr IntVec2_t northPoint      = {20, -20};
-    constexpr IntVec2_t northEastPoint  = {80, -20};
-    constexpr IntVec2_t eastPoint       = {80, 20};
-
-    constexpr IntVec2_t southEastPoint  = {80, 80};
-    constexpr IntVec2_t southPoint      = {25, 80};
-    constexpr IntVec2_t southWestPoint  = {-20, 80};
-    constexpr IntVec2_t westPoint       = {-20, 25};
-
-    SDL_Rect northWestArea = GetMapRenderRectangle(cMapSize_Tiles, northWestPoint, cWindowSize_px);
-    SDL_Rect northArea = GetMapRenderRectangle(cMapSize_Tiles, northPoint, cWindowSize_px);
-    SDL_Rect northEastArea = GetMapRenderRectangle(cMapSize_Tiles, northEastPoint, cWindowSize_px);
-    SDL_Rect eastArea = GetMapRenderRectangle(cMapSize_Tiles, eastPoint, cWindowSize_px);
-
-    SDL_Rect southEastArea = GetMapRenderRectangle(cMapSize_Tiles, southEastPoint, cWindowSize_px);
-    SDL_Rect southArea = GetMapRenderRectangle(cMapSize_Tiles, southPoint, cWindowSize_px);
-    SDL_Rect southWestArea = GetMapRenderRectangle(cMapSize_Tiles, southWestPoint, cWindowSize_px);
-    SDL_Rect westArea = GetMapRenderRectangle(cMapSize_Tiles, westPoint, cWindowSize_px);
-
-    /*
-        (gdb) call northWestArea
-        $1 = {x = 0, y = 0, w = 30, h = 30}
-        (gdb) call northArea
-        $2 = {x = 20, y = 0, w = 50, h = 30}
-        (gdb) call northEastArea
-        $3 = {x = 80, y = 0, w = 20, h = 30}
-        (gdb) call eastArea
-        $4 = {x = 80, y = 20, w = 20, h = 50}
-        (gdb) call southEastArea
-        $5 = {x = 80, y = 80, w = 20, h = 20}
-        (gdb) call southArea
-        $6 = {x = 25, y = 80, w = 50, h = 20}
-        (gdb) call southWestArea
-        $7 = {x = 0, y = 80, w = 30, h = 20}
-        (gdb) call westArea
-        $8 = {x = 0, y = 25, w = 30, h = 50}
-    */
-
-   
-}
-
-int main()
+int main(int argc, char* argv[])
 {
+#ifdef WMI_BENCHMARK
+    // built with "make bench"
+    return RunBenchmarks();
+#endif
+
+#ifdef WMI_TESTS
+    // built with "make test"
+    return RunTests(argc, argv);
+#endif
+
     // For testing whether the core functions are working properly
     DoBasicTests();
 
-    GameRenderLoop();
+    // "WindowMapIntersect map.wmimap" draws that map file instead of the demo map
+    GameRenderLoop((argc > 1) ? argv[1] : nullptr);
 
 
     return 0;